@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Implementation of the OS_CryptoDigest functions of the OS_Crypto API for
+ * running the keystore backends on a Linux host. Only SHA256 is supported, it
+ * is computed in software with OS_KeystoreFile_Sha256.
+ *
+ * Every call waits for a configurable time before it returns, to model the
+ * RPC into a Crypto component.
+ */
+
+#pragma once
+
+#include "OS_Crypto.h"
+
+#include <stdint.h>
+
+
+/**
+ * Creates a Crypto instance that can be passed to the keystore.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_PARAMETER   pHandle is NULL.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate memory.
+ *
+ * @param[out] pHandle      Receives the handle.
+ * @param[in]  latencyNs    Time every call waits before it returns.
+ */
+OS_Error_t
+FakeCrypto_init(
+    OS_Crypto_Handle_t* pHandle,
+    uint64_t            latencyNs);
+
+void
+FakeCrypto_free(
+    OS_Crypto_Handle_t  hCrypto);
+
+//! Returns the number of OS_CryptoDigest calls.
+uint64_t
+FakeCrypto_getNumCalls(
+    OS_Crypto_Handle_t  hCrypto);
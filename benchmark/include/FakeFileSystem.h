@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * In-memory implementation of the file functions of the OS_FileSystem API for
+ * running the keystore backends on a Linux host.
+ *
+ * Every call waits for a configurable time before it returns, to model the
+ * latency of a storage device or of the RPC into a FileSystem component.
+ * Directories are not modeled, a path is just a file name.
+ */
+
+#pragma once
+
+#include "OS_FileSystem.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Counters of the calls into the fake, to relate the timings to the number of
+ * FileSystem requests.
+ */
+typedef struct
+{
+    uint64_t    opens;
+    uint64_t    closes;
+    uint64_t    reads;
+    uint64_t    writes;
+    uint64_t    deletes;
+    uint64_t    getSizes;
+    //! Number of bytes read and written.
+    uint64_t    bytesRead;
+    uint64_t    bytesWritten;
+}
+FakeFileSystem_Stats_t;
+
+
+/**
+ * Creates an empty file system.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_PARAMETER   pHandle is NULL.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate memory.
+ *
+ * @param[out] pHandle      Receives the handle to be passed to the keystore.
+ * @param[in]  latencyNs    Time every call waits before it returns.
+ */
+OS_Error_t
+FakeFileSystem_init(
+    OS_FileSystem_Handle_t* pHandle,
+    uint64_t                latencyNs);
+
+/**
+ * Frees the file system and all of its files.
+ */
+void
+FakeFileSystem_free(
+    OS_FileSystem_Handle_t  hFs);
+
+void
+FakeFileSystem_getStats(
+    OS_FileSystem_Handle_t  hFs,
+    FakeFileSystem_Stats_t* stats);
+
+//! Returns the number of files.
+size_t
+FakeFileSystem_getNumFiles(
+    OS_FileSystem_Handle_t  hFs);
+
+//! Waits for the given time, also used by the other fakes. It busy waits
+//! unless FakeFileSystem_setSleeping() has been called.
+void
+FakeFileSystem_spin(
+    uint64_t    ns);
+
+//! Lets FakeFileSystem_spin() sleep instead, so parallel calls do not need a
+//! CPU each to overlap their latencies.
+void
+FakeFileSystem_setSleeping(
+    bool    isSleeping);
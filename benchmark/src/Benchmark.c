@@ -0,0 +1,821 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Measures the OS_Keystore operations of the keystore backends on a Linux
+ * host, using FakeFileSystem and FakeCrypto in place of the FileSystem and
+ * Crypto components.
+ *
+ * For every backend, number of keys and key size, the keys are stored into
+ * keystore A, loaded, copied into keystore B, deleted from B, moved from A to
+ * B and finally B is wiped. The throughput and the median and 99th percentile
+ * of the latency of every operation are printed as one line each.
+ *
+ * Usage: os_keystore_benchmark [-b backend] [-n maxKeys] [-s keySize]
+ *                              [-f fsLatencyNs] [-c cryptoLatencyNs] [-w]
+ *                              [-p maxThreads] [-t traceFile]
+ *
+ * With -p, the keys of keystore A are also loaded by 1, 2, 4, ... up to
+ * maxThreads threads in parallel, which share the handle through a pthread
+ * reader/writer lock. Every thread loads all keys, the throughput is the one
+ * of all threads together.
+ *
+ * With -w, the fakes sleep for their latency instead of busy waiting. This
+ * models calls that block in the RPC to the component, so parallel loads can
+ * overlap their latencies also on a host with fewer CPUs than threads.
+ *
+ * With -t, the last TRACE_EVENTS trace events of the keystores are written to
+ * traceFile in the format of the Chrome trace viewer. This requires the
+ * keystore to be built with OS_KEYSTORE_TRACE.
+ */
+
+#include "OS_KeystoreFile.h"
+#include "OS_KeystoreRamFV.h"
+#include "OS_KeystoreCached.h"
+#include "OS_KeystoreTrace.h"
+#include "FakeFileSystem.h"
+#include "FakeCrypto.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NAME_LEN            16
+#define RAM_FV_MAX_KEYS     10000
+#define CACHE_SIZE          (64 * 1024)
+// Large enough to pack the largest key count at all key sizes up to
+// OS_KeystoreFile_PACK_MAX_KEY_SIZE.
+#define PACK_SEGMENT_SIZE   (8 * 1024 * 1024)
+#define TRACE_EVENTS        (256 * 1024)
+
+static const size_t keyCounts[] = { 10, 100, 1000, 10000, 100000 };
+static const size_t keySizes[]  = { 16, 256, 2080 };
+
+typedef struct
+{
+    OS_FileSystem_Handle_t      hFs;
+    OS_Crypto_Handle_t          hCrypto;
+    uint64_t                    fsLatencyNs;
+    uint64_t                    cryptoLatencyNs;
+    //! Maximum number of threads of the parallel loads, 0 to skip them.
+    size_t                      maxThreads;
+    //! Receives the trace events of all keystores, if set.
+    OS_KeystoreTrace_Handle_t   hTrace;
+}
+Env_t;
+
+typedef struct
+{
+    OS_Keystore_Handle_t    hKeystore;
+    //! Keystore wrapped by hKeystore, if any.
+    OS_Keystore_Handle_t    hInner;
+    //! Memory owned by the instance.
+    void*                   buf;
+}
+Instance_t;
+
+typedef struct
+{
+    const char* name;
+    //! Maximum number of keys, 0 for no limit.
+    size_t      maxKeys;
+    OS_Error_t  (*create)(Instance_t* inst, Env_t* env, const char* name,
+                          size_t numKeys);
+}
+Backend_t;
+
+typedef struct
+{
+    char        (*names)[NAME_LEN];
+    uint8_t*    keyData;
+    uint8_t*    outData;
+    size_t      keySize;
+    size_t      numKeys;
+    uint64_t*   samples;
+}
+Run_t;
+
+typedef struct
+{
+    Run_t const*            run;
+    OS_Keystore_Handle_t    hKeystore;
+    //! Index of the first key loaded by the thread.
+    size_t                  first;
+    uint64_t*               samples;
+    OS_Error_t              err;
+    uint8_t                 outData[OS_KeystoreRamFV_MAX_KEY_SIZE];
+}
+Worker_t;
+
+
+// Backends --------------------------------------------------------------------
+
+static OS_Error_t
+createFile(
+    Instance_t* inst,
+    Env_t*      env,
+    const char* name,
+    size_t      numKeys)
+{
+    (void) numKeys;
+
+    return OS_KeystoreFile_init(&inst->hKeystore, env->hFs, env->hCrypto,
+                                name);
+}
+
+static OS_Error_t
+createFilePack(
+    Instance_t* inst,
+    Env_t*      env,
+    const char* name,
+    size_t      numKeys)
+{
+    (void) numKeys;
+
+    OS_KeystoreFile_Config_t config = {
+        .packSegmentSize = PACK_SEGMENT_SIZE,
+    };
+
+    return OS_KeystoreFile_initWithConfig(&inst->hKeystore, env->hFs,
+                                          env->hCrypto, name, &config);
+}
+
+static OS_Error_t
+createCachedFile(
+    Instance_t* inst,
+    Env_t*      env,
+    const char* name,
+    size_t      numKeys)
+{
+    (void) numKeys;
+
+    OS_Error_t err = OS_KeystoreFile_init(&inst->hInner, env->hFs,
+                                          env->hCrypto, name);
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    return OS_KeystoreCached_init(&inst->hKeystore, inst->hInner, CACHE_SIZE);
+}
+
+static OS_Error_t
+createRamFV(
+    Instance_t* inst,
+    Env_t*      env,
+    const char* name,
+    size_t      numKeys)
+{
+    (void) name;
+
+    size_t bufSize = OS_KeystoreRamFV_SIZE_OF_BUFFER(numKeys);
+    // One record per thread of the parallel loads.
+    size_t readBufSize = OS_KeystoreRamFV_SIZE_OF_READ_BUFFER(env->maxThreads);
+
+    inst->buf = malloc(bufSize + readBufSize);
+    if (NULL == inst->buf)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    OS_KeystoreRamFV_Config_t config = {
+        .buf         = inst->buf,
+        .bufSize     = bufSize,
+        .readBuf     = (uint8_t*) inst->buf + bufSize,
+        .readBufSize = readBufSize,
+    };
+
+    return OS_KeystoreRamFV_initWithConfig(&inst->hKeystore, &config);
+}
+
+static const Backend_t backends[] =
+{
+    { "file",        0,                 createFile },
+    { "file-pack",   0,                 createFilePack },
+    { "cached-file", 0,                 createCachedFile },
+    // The RAM of the instance is allocated for all keys upfront.
+    { "ram_fv",      RAM_FV_MAX_KEYS,   createRamFV },
+};
+
+static void
+destroy(
+    Instance_t* inst)
+{
+    if (NULL != inst->hKeystore)
+    {
+        OS_Keystore_free(inst->hKeystore);
+    }
+    if (NULL != inst->hInner)
+    {
+        OS_Keystore_free(inst->hInner);
+    }
+    free(inst->buf);
+    memset(inst, 0, sizeof(*inst));
+}
+
+
+// Measurement -----------------------------------------------------------------
+
+static uint64_t
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t
+getTimeNs(
+    void*   ctx)
+{
+    (void) ctx;
+
+    return now();
+}
+
+static int
+compareSamples(
+    const void* a,
+    const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+// The throughput is computed from elapsedNs, or from the sum of the samples
+// if elapsedNs is 0, i.e. if the operations ran one after the other.
+static void
+report(
+    const char* backend,
+    Run_t*      run,
+    const char* op,
+    size_t      numSamples,
+    uint64_t    elapsedNs)
+{
+    uint64_t total = elapsedNs;
+
+    for (size_t i = 0; (0 == elapsedNs) && (i < numSamples); i++)
+    {
+        total += run->samples[i];
+    }
+
+    qsort(run->samples, numSamples, sizeof(uint64_t), compareSamples);
+
+    printf("%-12s %7zu %5zu  %-7s %12.0f %10.2f %10.2f\n",
+           backend, run->numKeys, run->keySize, op,
+           (total > 0) ? (double) numSamples * 1e9 / (double) total : 0.0,
+           (double) run->samples[(numSamples - 1) * 50 / 100] / 1000.0,
+           (double) run->samples[(numSamples - 1) * 99 / 100] / 1000.0);
+}
+
+
+// Tracing ---------------------------------------------------------------------
+
+static OS_Error_t
+attachTrace(
+    OS_Keystore_Handle_t    hKeystore,
+    Env_t*                  env)
+{
+    OS_Error_t err;
+    OS_Keystore_Clock_t clock = { .getTimeNs = getTimeNs };
+    OS_Keystore_TraceHook_t hook;
+
+    if ((NULL == hKeystore) || (NULL == env->hTrace))
+    {
+        return OS_SUCCESS;
+    }
+
+    if (((err = OS_Keystore_setClock(hKeystore, &clock)) != OS_SUCCESS)
+        || ((err = OS_KeystoreTrace_getHook(env->hTrace, &hook)) != OS_SUCCESS)
+        || ((err = OS_Keystore_setTraceHook(hKeystore, &hook)) != OS_SUCCESS))
+    {
+        fprintf(stderr, "Tracing failed with error code %d, is the keystore"
+                " built with OS_KEYSTORE_TRACE?\n", err);
+    }
+
+    return err;
+}
+
+static OS_Error_t
+writeFile(
+    void*       ctx,
+    const char* data,
+    size_t      len)
+{
+    return (fwrite(data, 1, len, (FILE*) ctx) == len) ?
+           OS_SUCCESS : OS_ERROR_GENERIC;
+}
+
+static OS_Error_t
+exportTrace(
+    Env_t*      env,
+    const char* path)
+{
+    OS_Error_t err;
+    uint64_t numLost;
+    FILE* f = fopen(path, "w");
+
+    if (NULL == f)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return OS_ERROR_GENERIC;
+    }
+
+    OS_KeystoreTrace_Writer_t writer = { .write = writeFile, .ctx = f };
+    err = OS_KeystoreTrace_exportChrome(env->hTrace, &writer, &numLost);
+
+    if ((fclose(f) != 0) && (OS_SUCCESS == err))
+    {
+        err = OS_ERROR_GENERIC;
+    }
+    if (err != OS_SUCCESS)
+    {
+        fprintf(stderr, "Writing %s failed with error code %d\n", path, err);
+    }
+
+    return err;
+}
+
+
+// Parallel loads --------------------------------------------------------------
+
+static void
+lockRead(
+    void*   ctx)
+{
+    pthread_rwlock_rdlock(ctx);
+}
+
+static void
+lockWrite(
+    void*   ctx)
+{
+    pthread_rwlock_wrlock(ctx);
+}
+
+static void
+unlock(
+    void*   ctx)
+{
+    pthread_rwlock_unlock(ctx);
+}
+
+static void
+yield(
+    void*   ctx)
+{
+    (void) ctx;
+    sched_yield();
+}
+
+static void*
+runLoads(
+    void*   arg)
+{
+    Worker_t* worker = arg;
+    Run_t const* run = worker->run;
+
+    // The threads start at different keys, so they do not load the same key
+    // at the same time.
+    for (size_t i = 0; i < run->numKeys; i++)
+    {
+        const char* name = run->names[(worker->first + i) % run->numKeys];
+        size_t size = sizeof(worker->outData);
+
+        uint64_t start = now();
+        worker->err = OS_Keystore_loadKey(worker->hKeystore, name,
+                                          worker->outData, &size);
+        worker->samples[i] = now() - start;
+
+        if (worker->err != OS_SUCCESS)
+        {
+            fprintf(stderr, "load of key '%s' failed with error code %d\n",
+                    name, worker->err);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static OS_Error_t
+runParallelLoads(
+    Backend_t const*        backend,
+    Env_t*                  env,
+    Run_t*                  run,
+    OS_Keystore_Handle_t    hKeystore)
+{
+    OS_Error_t err;
+    pthread_rwlock_t rwLock;
+    OS_Keystore_RwLock_t lock = {
+        .lockRead    = lockRead,
+        .unlockRead  = unlock,
+        .lockWrite   = lockWrite,
+        .unlockWrite = unlock,
+        .ctx         = &rwLock,
+        .yield       = yield,
+    };
+    Worker_t* workers = calloc(env->maxThreads, sizeof(Worker_t));
+    pthread_t* threads = calloc(env->maxThreads, sizeof(pthread_t));
+
+    if ((NULL == workers) || (NULL == threads)
+        || (pthread_rwlock_init(&rwLock, NULL) != 0))
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(threads);
+        free(workers);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    if ((err = OS_Keystore_setLock(hKeystore, &lock)) != OS_SUCCESS)
+    {
+        goto out;
+    }
+
+    for (size_t numThreads = 1; numThreads <= env->maxThreads; numThreads *= 2)
+    {
+        size_t started = 0;
+        char op[16];
+
+        uint64_t start = now();
+        for (; started < numThreads; started++)
+        {
+            Worker_t* worker = &workers[started];
+
+            worker->run       = run;
+            worker->hKeystore = hKeystore;
+            worker->first     = started * run->numKeys / numThreads;
+            worker->samples   = &run->samples[started * run->numKeys];
+            worker->err       = OS_SUCCESS;
+
+            if (pthread_create(&threads[started], NULL, runLoads, worker) != 0)
+            {
+                fprintf(stderr, "Creating a thread failed\n");
+                err = OS_ERROR_GENERIC;
+                break;
+            }
+        }
+        for (size_t i = 0; i < started; i++)
+        {
+            pthread_join(threads[i], NULL);
+            if (workers[i].err != OS_SUCCESS)
+            {
+                err = workers[i].err;
+            }
+        }
+        uint64_t elapsed = now() - start;
+
+        if (err != OS_SUCCESS)
+        {
+            break;
+        }
+
+        snprintf(op, sizeof(op), "load/%zu", numThreads);
+        report(backend->name, run, op, numThreads * run->numKeys, elapsed);
+    }
+
+    OS_Keystore_setLock(hKeystore, NULL);
+
+out:
+    pthread_rwlock_destroy(&rwLock);
+    free(threads);
+    free(workers);
+
+    return err;
+}
+
+
+// Operations ------------------------------------------------------------------
+
+typedef enum
+{
+    OP_STORE,
+    OP_LOAD,
+    OP_COPY,
+    OP_DELETE,
+    OP_MOVE,
+}
+Op_t;
+
+static const char* const opNames[] = {
+    "store", "load", "copy", "delete", "move"
+};
+
+static OS_Error_t
+runOp(
+    Run_t*                  run,
+    Op_t                    op,
+    OS_Keystore_Handle_t    hSrc,
+    OS_Keystore_Handle_t    hDst)
+{
+    for (size_t i = 0; i < run->numKeys; i++)
+    {
+        const char* name = run->names[i];
+        size_t size = run->keySize;
+        OS_Error_t err = OS_ERROR_GENERIC;
+
+        uint64_t start = now();
+        switch (op)
+        {
+        case OP_STORE:
+            err = OS_Keystore_storeKey(hSrc, name, run->keyData, size);
+            break;
+        case OP_LOAD:
+            err = OS_Keystore_loadKey(hSrc, name, run->outData, &size);
+            break;
+        case OP_COPY:
+            err = OS_Keystore_copyKey(hSrc, name, hDst);
+            break;
+        case OP_DELETE:
+            err = OS_Keystore_deleteKey(hSrc, name);
+            break;
+        case OP_MOVE:
+            err = OS_Keystore_moveKey(hSrc, name, hDst);
+            break;
+        }
+        run->samples[i] = now() - start;
+
+        if (err != OS_SUCCESS)
+        {
+            fprintf(stderr, "%s of key '%s' failed with error code %d\n",
+                    opNames[op], name, err);
+            return err;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+runBackend(
+    Backend_t const*    backend,
+    Env_t*              env,
+    Run_t*              run)
+{
+    OS_Error_t err;
+    Instance_t a = { 0 };
+    Instance_t b = { 0 };
+
+    // Every run starts with an empty file system, so the results do not
+    // depend on the runs before.
+    if ((err = FakeFileSystem_init(&env->hFs, env->fsLatencyNs)) != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    if (((err = backend->create(&a, env, "a", run->numKeys)) != OS_SUCCESS)
+        || ((err = backend->create(&b, env, "b", run->numKeys)) != OS_SUCCESS))
+    {
+        fprintf(stderr, "%s: creating the keystores failed with error code %d\n",
+                backend->name, err);
+        goto out;
+    }
+
+    if (((err = attachTrace(a.hKeystore, env)) != OS_SUCCESS)
+        || ((err = attachTrace(a.hInner, env)) != OS_SUCCESS)
+        || ((err = attachTrace(b.hKeystore, env)) != OS_SUCCESS)
+        || ((err = attachTrace(b.hInner, env)) != OS_SUCCESS))
+    {
+        goto out;
+    }
+
+    static const struct
+    {
+        Op_t    op;
+        bool    toB;
+        bool    onB;
+    }
+    steps[] =
+    {
+        { OP_STORE,  false, false },
+        { OP_LOAD,   false, false },
+        { OP_COPY,   true,  false },
+        { OP_DELETE, false, true },
+        { OP_MOVE,   true,  false },
+    };
+
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        err = runOp(run, steps[i].op,
+                    steps[i].onB ? b.hKeystore : a.hKeystore,
+                    steps[i].toB ? b.hKeystore : NULL);
+        if (err != OS_SUCCESS)
+        {
+            goto out;
+        }
+        report(backend->name, run, opNames[steps[i].op], run->numKeys, 0);
+
+        // A holds all keys after the loads, the parallel loads go next.
+        if ((OP_LOAD == steps[i].op) && (env->maxThreads > 0)
+            && ((err = runParallelLoads(backend, env, run, a.hKeystore))
+                != OS_SUCCESS))
+        {
+            goto out;
+        }
+    }
+
+    // B holds all keys now, a wipe is a single operation.
+    uint64_t start = now();
+    err = OS_Keystore_wipeKeystore(b.hKeystore);
+    run->samples[0] = now() - start;
+    if (err != OS_SUCCESS)
+    {
+        fprintf(stderr, "wipe failed with error code %d\n", err);
+        goto out;
+    }
+    report(backend->name, run, "wipe", 1, 0);
+
+out:
+    destroy(&b);
+    destroy(&a);
+    FakeFileSystem_free(env->hFs);
+    env->hFs = NULL;
+
+    return err;
+}
+
+
+// Main ------------------------------------------------------------------------
+
+static void
+usage(
+    const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-b backend] [-n maxKeys] [-s keySize]"
+            " [-f fsLatencyNs] [-c cryptoLatencyNs] [-w] [-p maxThreads]"
+            " [-t traceFile]\n"
+            "Backends:",
+            prog);
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        fprintf(stderr, " %s", backends[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int
+main(
+    int     argc,
+    char**  argv)
+{
+    const char* onlyBackend = NULL;
+    const char* tracePath = NULL;
+    size_t maxKeys = 0;
+    size_t onlySize = 0;
+    Env_t env = { 0 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:n:s:f:c:wp:t:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            onlyBackend = optarg;
+            break;
+        case 'n':
+            maxKeys = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            onlySize = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            env.fsLatencyNs = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            env.cryptoLatencyNs = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            FakeFileSystem_setSleeping(true);
+            break;
+        case 'p':
+            env.maxThreads = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if ((onlySize > OS_KeystoreRamFV_MAX_KEY_SIZE) || (optind < argc))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (FakeCrypto_init(&env.hCrypto, env.cryptoLatencyNs) != OS_SUCCESS)
+    {
+        return 1;
+    }
+
+    if ((NULL != tracePath)
+        && (OS_KeystoreTrace_init(&env.hTrace, TRACE_EVENTS) != OS_SUCCESS))
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    size_t largest = keyCounts[sizeof(keyCounts) / sizeof(keyCounts[0]) - 1];
+    // The parallel loads take a sample per key and thread.
+    size_t maxSamples = largest * ((env.maxThreads > 0) ? env.maxThreads : 1);
+    Run_t run = {
+        .names   = malloc(largest * sizeof(*run.names)),
+        .keyData = malloc(OS_KeystoreRamFV_MAX_KEY_SIZE),
+        .outData = malloc(OS_KeystoreRamFV_MAX_KEY_SIZE),
+        .samples = malloc(maxSamples * sizeof(*run.samples)),
+    };
+
+    if ((NULL == run.names) || (NULL == run.keyData) || (NULL == run.outData)
+        || (NULL == run.samples))
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < largest; i++)
+    {
+        snprintf(run.names[i], NAME_LEN, "key%zu", i);
+    }
+    for (size_t i = 0; i < OS_KeystoreRamFV_MAX_KEY_SIZE; i++)
+    {
+        run.keyData[i] = (uint8_t) (i * 31 + 7);
+    }
+
+    printf("# fs latency %" PRIu64 " ns, crypto latency %" PRIu64 " ns\n",
+           env.fsLatencyNs, env.cryptoLatencyNs);
+    printf("%-12s %7s %5s  %-7s %12s %10s %10s\n",
+           "# backend", "keys", "size", "op", "ops/s", "p50[us]", "p99[us]");
+
+    int ret = 0;
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        Backend_t const* backend = &backends[i];
+
+        if ((NULL != onlyBackend) && (strcmp(onlyBackend, backend->name) != 0))
+        {
+            continue;
+        }
+
+        // A key size given on the command line replaces the default ones.
+        size_t numSizes = (onlySize > 0) ? 1 : sizeof(keySizes) / sizeof(keySizes[0]);
+
+        for (size_t j = 0; j < numSizes; j++)
+        {
+            for (size_t k = 0; k < sizeof(keyCounts) / sizeof(keyCounts[0]); k++)
+            {
+                if (((maxKeys > 0) && (keyCounts[k] > maxKeys))
+                    || ((backend->maxKeys > 0)
+                        && (keyCounts[k] > backend->maxKeys)))
+                {
+                    continue;
+                }
+
+                run.keySize = (onlySize > 0) ? onlySize : keySizes[j];
+                run.numKeys = keyCounts[k];
+
+                if (runBackend(backend, &env, &run) != OS_SUCCESS)
+                {
+                    ret = 1;
+                }
+            }
+        }
+    }
+
+    free(run.names);
+    free(run.keyData);
+    free(run.outData);
+    free(run.samples);
+    FakeCrypto_free(env.hCrypto);
+
+    if (NULL != env.hTrace)
+    {
+        if (exportTrace(&env, tracePath) != OS_SUCCESS)
+        {
+            ret = 1;
+        }
+        OS_KeystoreTrace_free(env.hTrace);
+    }
+
+    return ret;
+}
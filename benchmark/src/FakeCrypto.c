@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "FakeCrypto.h"
+#include "FakeFileSystem.h"
+#include "OS_KeystoreFile_Sha256.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// The handles are cast from and to these types, so the fake does not depend
+// on how the Crypto API defines its handle types.
+typedef struct
+{
+    uint64_t            latencyNs;
+    // Loads hash in parallel.
+    _Atomic uint64_t    numCalls;
+}
+FakeCrypto_t;
+
+typedef struct
+{
+    FakeCrypto_t*           crypto;
+    OS_KeystoreFile_Sha256  sha256;
+}
+FakeDigest_t;
+
+
+// Private functions -----------------------------------------------------------
+
+static void
+enter(
+    FakeCrypto_t*   crypto)
+{
+    FakeFileSystem_spin(crypto->latencyNs);
+    crypto->numCalls++;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+FakeCrypto_init(
+    OS_Crypto_Handle_t* pHandle,
+    uint64_t            latencyNs)
+{
+    if (NULL == pHandle)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeCrypto_t* self = calloc(1, sizeof(*self));
+    if (NULL == self)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    self->latencyNs = latencyNs;
+    *pHandle = (OS_Crypto_Handle_t) self;
+
+    return OS_SUCCESS;
+}
+
+void
+FakeCrypto_free(
+    OS_Crypto_Handle_t  hCrypto)
+{
+    free((FakeCrypto_t*) hCrypto);
+}
+
+uint64_t
+FakeCrypto_getNumCalls(
+    OS_Crypto_Handle_t  hCrypto)
+{
+    return ((FakeCrypto_t*) hCrypto)->numCalls;
+}
+
+
+// OS_CryptoDigest API ---------------------------------------------------------
+
+OS_Error_t
+OS_CryptoDigest_init(
+    OS_CryptoDigest_Handle_t*   self,
+    const OS_Crypto_Handle_t    hCrypto,
+    const OS_CryptoDigest_Alg_t algorithm)
+{
+    if ((NULL == self) || (NULL == hCrypto))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    enter((FakeCrypto_t*) hCrypto);
+
+    if (algorithm != OS_CryptoDigest_ALG_SHA256)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    FakeDigest_t* digest = malloc(sizeof(*digest));
+    if (NULL == digest)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    digest->crypto = (FakeCrypto_t*) hCrypto;
+    OS_KeystoreFile_Sha256_init(&digest->sha256);
+    *self = (OS_CryptoDigest_Handle_t) digest;
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_CryptoDigest_free(
+    OS_CryptoDigest_Handle_t    self)
+{
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeDigest_t* fake = (FakeDigest_t*) self;
+
+    enter(fake->crypto);
+    free(fake);
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_CryptoDigest_process(
+    OS_CryptoDigest_Handle_t    self,
+    const void*                 data,
+    const size_t                dataSize)
+{
+    if ((NULL == self) || (NULL == data))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeDigest_t* fake = (FakeDigest_t*) self;
+
+    enter(fake->crypto);
+    OS_KeystoreFile_Sha256_process(&fake->sha256, data, dataSize);
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_CryptoDigest_finalize(
+    OS_CryptoDigest_Handle_t    self,
+    void*                       digest,
+    size_t*                     digestSize)
+{
+    if ((NULL == self) || (NULL == digest) || (NULL == digestSize))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeDigest_t* fake = (FakeDigest_t*) self;
+
+    enter(fake->crypto);
+
+    if (*digestSize < OS_KeystoreFile_Sha256_SIZE)
+    {
+        *digestSize = OS_KeystoreFile_Sha256_SIZE;
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    OS_KeystoreFile_Sha256_finalize(&fake->sha256, digest);
+    *digestSize = OS_KeystoreFile_Sha256_SIZE;
+
+    // Like the real implementation, the digest object can be used again right
+    // away.
+    OS_KeystoreFile_Sha256_init(&fake->sha256);
+
+    return OS_SUCCESS;
+}
@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "FakeFileSystem.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_OPEN_FILES      64
+#define MIN_BUCKETS         1024
+
+// See FakeFileSystem_setSleeping().
+static bool sleeping = false;
+
+typedef struct FakeFile FakeFile_t;
+
+struct FakeFile
+{
+    FakeFile_t* next;
+    uint32_t    hash;
+    char*       name;
+    uint8_t*    data;
+    size_t      size;
+    size_t      capacity;
+};
+
+struct OS_FileSystem
+{
+    uint64_t                latencyNs;
+    //! Taken after the latency, so parallel calls wait for it together.
+    pthread_mutex_t         mutex;
+    //! Hash table of the files, chained per bucket.
+    FakeFile_t**            buckets;
+    size_t                  numBuckets;
+    size_t                  numFiles;
+    //! Open files, indexed by OS_FileSystemFile_Handle_t.
+    FakeFile_t*             open[MAX_OPEN_FILES];
+    FakeFileSystem_Stats_t  stats;
+};
+
+
+// Private functions -----------------------------------------------------------
+
+static uint32_t
+hashName(
+    const char* name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (uint8_t) *name;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static FakeFile_t**
+findLink(
+    OS_FileSystem_t*    self,
+    const char*         name,
+    uint32_t            hash)
+{
+    FakeFile_t** link = &self->buckets[hash & (self->numBuckets - 1)];
+
+    while ((NULL != *link)
+           && (((*link)->hash != hash) || (strcmp((*link)->name, name) != 0)))
+    {
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+static bool
+grow(
+    OS_FileSystem_t*    self)
+{
+    size_t numBuckets = self->numBuckets * 2;
+    FakeFile_t** buckets = calloc(numBuckets, sizeof(*buckets));
+
+    if (NULL == buckets)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < self->numBuckets; i++)
+    {
+        FakeFile_t* file = self->buckets[i];
+
+        while (NULL != file)
+        {
+            FakeFile_t* next = file->next;
+            FakeFile_t** head = &buckets[file->hash & (numBuckets - 1)];
+
+            file->next = *head;
+            *head = file;
+            file = next;
+        }
+    }
+
+    free(self->buckets);
+    self->buckets    = buckets;
+    self->numBuckets = numBuckets;
+
+    return true;
+}
+
+static FakeFile_t*
+createFile(
+    OS_FileSystem_t*    self,
+    const char*         name,
+    uint32_t            hash)
+{
+    if ((self->numFiles + 1 > self->numBuckets) && !grow(self))
+    {
+        return NULL;
+    }
+
+    FakeFile_t* file = calloc(1, sizeof(*file));
+    if (NULL == file)
+    {
+        return NULL;
+    }
+
+    file->name = strdup(name);
+    if (NULL == file->name)
+    {
+        free(file);
+        return NULL;
+    }
+
+    FakeFile_t** head = &self->buckets[hash & (self->numBuckets - 1)];
+
+    file->hash = hash;
+    file->next = *head;
+    *head = file;
+    self->numFiles++;
+
+    return file;
+}
+
+static void
+freeFile(
+    FakeFile_t* file)
+{
+    free(file->name);
+    free(file->data);
+    free(file);
+}
+
+static FakeFile_t*
+getOpenFile(
+    OS_FileSystem_t*                    self,
+    const OS_FileSystemFile_Handle_t    hFile)
+{
+    if ((hFile < 0) || (hFile >= MAX_OPEN_FILES))
+    {
+        return NULL;
+    }
+
+    return self->open[hFile];
+}
+
+// The calls of the API wait for the latency and then run one of these with
+// the mutex held, so the keystore can call into the fake from several threads.
+static OS_Error_t
+openFile(
+    OS_FileSystem_t*                self,
+    OS_FileSystemFile_Handle_t*     hFile,
+    const char*                     name,
+    const OS_FileSystem_OpenFlags_t flags)
+{
+    self->stats.opens++;
+
+    int fd = 0;
+    while ((fd < MAX_OPEN_FILES) && (NULL != self->open[fd]))
+    {
+        fd++;
+    }
+    if (MAX_OPEN_FILES == fd)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    uint32_t hash = hashName(name);
+    FakeFile_t* file = *findLink(self, name, hash);
+
+    if (NULL == file)
+    {
+        if (!(flags & OS_FileSystem_OpenFlags_CREATE))
+        {
+            return OS_ERROR_FS_FILE_NOT_FOUND;
+        }
+
+        file = createFile(self, name, hash);
+        if (NULL == file)
+        {
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+    }
+
+    if (flags & OS_FileSystem_OpenFlags_TRUNCATE)
+    {
+        file->size = 0;
+    }
+
+    self->open[fd] = file;
+    *hFile = fd;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+closeFile(
+    OS_FileSystem_t*                    self,
+    const OS_FileSystemFile_Handle_t    hFile)
+{
+    if (NULL == getOpenFile(self, hFile))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    self->stats.closes++;
+    self->open[hFile] = NULL;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+readFile(
+    OS_FileSystem_t*                    self,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    void*                               buffer)
+{
+    FakeFile_t* file = getOpenFile(self, hFile);
+
+    if (NULL == file)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    self->stats.reads++;
+
+    if ((size_t) offset + len > file->size)
+    {
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    memcpy(buffer, file->data + offset, len);
+    self->stats.bytesRead += len;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+writeFile(
+    OS_FileSystem_t*                    self,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    const void*                         buffer)
+{
+    FakeFile_t* file = getOpenFile(self, hFile);
+
+    if (NULL == file)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    self->stats.writes++;
+
+    size_t end = (size_t) offset + len;
+
+    if (end > file->capacity)
+    {
+        size_t capacity = (file->capacity > 0) ? file->capacity : 64;
+
+        while (capacity < end)
+        {
+            capacity *= 2;
+        }
+
+        uint8_t* data = realloc(file->data, capacity);
+        if (NULL == data)
+        {
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+
+        file->data     = data;
+        file->capacity = capacity;
+    }
+
+    if ((size_t) offset > file->size)
+    {
+        memset(file->data + file->size, 0, (size_t) offset - file->size);
+    }
+
+    memcpy(file->data + offset, buffer, len);
+    if (end > file->size)
+    {
+        file->size = end;
+    }
+    self->stats.bytesWritten += len;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+deleteFile(
+    OS_FileSystem_t*    self,
+    const char*         name)
+{
+    self->stats.deletes++;
+
+    FakeFile_t** link = findLink(self, name, hashName(name));
+    FakeFile_t* file = *link;
+
+    if (NULL == file)
+    {
+        return OS_ERROR_FS_FILE_NOT_FOUND;
+    }
+
+    for (int fd = 0; fd < MAX_OPEN_FILES; fd++)
+    {
+        if (self->open[fd] == file)
+        {
+            return OS_ERROR_INVALID_STATE;
+        }
+    }
+
+    *link = file->next;
+    freeFile(file);
+    self->numFiles--;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+getFileSize(
+    OS_FileSystem_t*    self,
+    const char*         name,
+    off_t*              sz)
+{
+    self->stats.getSizes++;
+
+    FakeFile_t* file = *findLink(self, name, hashName(name));
+
+    if (NULL == file)
+    {
+        return OS_ERROR_FS_FILE_NOT_FOUND;
+    }
+
+    *sz = (off_t) file->size;
+
+    return OS_SUCCESS;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+void
+FakeFileSystem_spin(
+    uint64_t    ns)
+{
+    struct timespec start;
+    struct timespec now;
+
+    if (0 == ns)
+    {
+        return;
+    }
+
+    if (sleeping)
+    {
+        struct timespec t = {
+            .tv_sec  = (time_t) (ns / 1000000000u),
+            .tv_nsec = (long) (ns % 1000000000u)
+        };
+
+        nanosleep(&t, NULL);
+        return;
+    }
+
+    // Busy waiting is much more precise than sleeping for the microsecond
+    // range the latencies are usually in.
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+    while ((uint64_t) (now.tv_sec - start.tv_sec) * 1000000000u
+           + (uint64_t) now.tv_nsec - (uint64_t) start.tv_nsec < ns);
+}
+
+void
+FakeFileSystem_setSleeping(
+    bool    isSleeping)
+{
+    sleeping = isSleeping;
+}
+
+OS_Error_t
+FakeFileSystem_init(
+    OS_FileSystem_Handle_t* pHandle,
+    uint64_t                latencyNs)
+{
+    if (NULL == pHandle)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_FileSystem_t* self = calloc(1, sizeof(*self));
+    if (NULL == self)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    self->buckets = calloc(MIN_BUCKETS, sizeof(*self->buckets));
+    if (NULL == self->buckets)
+    {
+        free(self);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    if (pthread_mutex_init(&self->mutex, NULL) != 0)
+    {
+        free(self->buckets);
+        free(self);
+        return OS_ERROR_GENERIC;
+    }
+
+    self->numBuckets = MIN_BUCKETS;
+    self->latencyNs  = latencyNs;
+
+    *pHandle = self;
+
+    return OS_SUCCESS;
+}
+
+void
+FakeFileSystem_free(
+    OS_FileSystem_Handle_t  hFs)
+{
+    if (NULL == hFs)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < hFs->numBuckets; i++)
+    {
+        FakeFile_t* file = hFs->buckets[i];
+
+        while (NULL != file)
+        {
+            FakeFile_t* next = file->next;
+            freeFile(file);
+            file = next;
+        }
+    }
+
+    pthread_mutex_destroy(&hFs->mutex);
+    free(hFs->buckets);
+    free(hFs);
+}
+
+void
+FakeFileSystem_getStats(
+    OS_FileSystem_Handle_t  hFs,
+    FakeFileSystem_Stats_t* stats)
+{
+    pthread_mutex_lock(&hFs->mutex);
+    *stats = hFs->stats;
+    pthread_mutex_unlock(&hFs->mutex);
+}
+
+size_t
+FakeFileSystem_getNumFiles(
+    OS_FileSystem_Handle_t  hFs)
+{
+    return hFs->numFiles;
+}
+
+
+// OS_FileSystem API -----------------------------------------------------------
+
+OS_Error_t
+OS_FileSystemFile_open(
+    OS_FileSystem_Handle_t          hFs,
+    OS_FileSystemFile_Handle_t*     hFile,
+    const char*                     name,
+    const OS_FileSystem_OpenMode_t  mode,
+    const OS_FileSystem_OpenFlags_t flags)
+{
+    // All files are opened for reading and writing.
+    (void) mode;
+
+    if ((NULL == hFs) || (NULL == hFile) || (NULL == name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = openFile(hFs, hFile, name, flags);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
+
+OS_Error_t
+OS_FileSystemFile_close(
+    OS_FileSystem_Handle_t              hFs,
+    const OS_FileSystemFile_Handle_t    hFile)
+{
+    if (NULL == hFs)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = closeFile(hFs, hFile);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
+
+OS_Error_t
+OS_FileSystemFile_read(
+    OS_FileSystem_Handle_t              hFs,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    void*                               buffer)
+{
+    if ((NULL == hFs) || (NULL == buffer) || (offset < 0))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = readFile(hFs, hFile, offset, len, buffer);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
+
+OS_Error_t
+OS_FileSystemFile_write(
+    OS_FileSystem_Handle_t              hFs,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    const void*                         buffer)
+{
+    if ((NULL == hFs) || (NULL == buffer) || (offset < 0))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = writeFile(hFs, hFile, offset, len, buffer);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
+
+OS_Error_t
+OS_FileSystemFile_delete(
+    OS_FileSystem_Handle_t  hFs,
+    const char*             name)
+{
+    if ((NULL == hFs) || (NULL == name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = deleteFile(hFs, name);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
+
+OS_Error_t
+OS_FileSystemFile_getSize(
+    OS_FileSystem_Handle_t  hFs,
+    const char*             name,
+    off_t*                  sz)
+{
+    if ((NULL == hFs) || (NULL == name) || (NULL == sz))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    FakeFileSystem_spin(hFs->latencyNs);
+    pthread_mutex_lock(&hFs->mutex);
+    OS_Error_t err = getFileSize(hFs, name, sz);
+    pthread_mutex_unlock(&hFs->mutex);
+
+    return err;
+}
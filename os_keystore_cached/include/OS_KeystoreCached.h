@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2021-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * OS_KeystoreCached is an implementation of the OS_Keystore API that keeps a
+ * bounded RAM copy of recently loaded keys in front of another ("inner")
+ * OS_Keystore instance, e.g. an OS_KeystoreFile or an OS_KeystoreRamFV.
+ *
+ * A load of a cached key is served from RAM without calling the inner
+ * keystore. All other operations are passed to the inner keystore right away
+ * (write-through), so the inner keystore always holds the complete state.
+ *
+ * The amount of cached key data is limited by a byte budget and the number of
+ * cached keys by OS_KeystoreCached_MAX_ENTRIES. When space is needed, a key is
+ * evicted using the CLOCK algorithm. Keys with names longer than
+ * OS_KeystoreCached_MAX_NAME_LEN or data larger than the budget are never
+ * cached, but still handled by the inner keystore.
+ *
+ * The key data held by the cache is zeroized when a key is evicted, deleted,
+ * when the keystore is wiped and when the instance is freed.
+ *
+ * NOTE: The inner keystore must only be modified through the OS_KeystoreCached
+ * instance while the instance exists, otherwise the cache may return stale key
+ * data.
+ *
+ * NOTE: The inner keystore is called through its vtable, so calls are neither
+ * serialized by its lock nor counted in its statistics or traced, see
+ * OS_Keystore_setLock(). The lock of the OS_KeystoreCached instance covers
+ * both.
+ *
+ * NOTE: Loads run in parallel if the inner keystore supports parallel reads,
+ * e.g. an OS_KeystoreFile or an OS_KeystoreRamFV. Otherwise, the lock of the
+ * OS_KeystoreCached instance serializes them like all other operations.
+ *
+ * NOTE: Freeing the OS_KeystoreCached instance does not free the inner
+ * keystore, it remains owned by the caller.
+ */
+
+#pragma once
+
+#include "OS_Keystore.int.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//! Maximum length of a key name that can be cached.
+#define OS_KeystoreCached_MAX_NAME_LEN      15
+
+//! Maximum number of keys held by the cache at the same time.
+#define OS_KeystoreCached_MAX_ENTRIES       32
+
+//! Maximum size of a key that can be cached, matches the maximum key size of
+//! the TRENTOS keystore implementations.
+#define OS_KeystoreCached_MAX_KEY_SIZE      2080
+
+//! Macro to get the pointer to the parent struct OS_Keystore_t.
+#define OS_KeystoreCached_TO_OS_KEYSTORE(self)  (&((self)->parent))
+
+
+/**
+ * Counters of the cache, see OS_KeystoreCached_getStats().
+ */
+typedef struct
+{
+    //! Number of loads served from the cache.
+    uint64_t    hits;
+    //! Number of loads passed to the inner keystore.
+    uint64_t    misses;
+    //! Number of keys removed from the cache to make room for others.
+    uint64_t    evictions;
+    //! Amount of key data currently held in the cache in bytes.
+    size_t      usedBytes;
+}
+OS_KeystoreCached_Stats_t;
+
+typedef struct
+{
+    bool        isUsed;
+    //! Set on every hit, cleared when the clock hand passes the entry.
+    bool        isReferenced;
+    uint32_t    hash;
+    // null terminated string
+    char        name[OS_KeystoreCached_MAX_NAME_LEN + 1];
+    size_t      size;
+    uint8_t*    data;
+}
+OS_KeystoreCached_Entry;
+
+/**
+ * OS_KeystoreCached context.
+ */
+typedef struct
+{
+    //! Parent struct which holds the vTable implemented by this module.
+    OS_Keystore_t               parent;
+    //! Keystore that holds the keys.
+    OS_Keystore_t*              inner;
+    OS_KeystoreCached_Entry     entries[OS_KeystoreCached_MAX_ENTRIES];
+    //! Maximum amount of cached key data in bytes.
+    size_t                      budget;
+    //! Position of the clock hand in entries[].
+    unsigned int                hand;
+    OS_KeystoreCached_Stats_t   stats;
+    //! Taken by loads while they use the cache, see OS_Keystore_spinLock().
+    atomic_flag                 cacheLock;
+    //! Temporary buffer used by copyKey().
+    unsigned char               buffer[OS_KeystoreCached_MAX_KEY_SIZE];
+}
+OS_KeystoreCached_t;
+
+
+/**
+ * Allocates space for a new OS_KeystoreCached_t context and initialises it.
+ *
+ * It returns an OS_Keystore_Handle_t to be used with the OS Keystore API.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
+ *                                      OS_KeystoreCached_t context.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason.
+ *
+ * @param[out] pHandle      Pointer to the variable of the caller supposed to
+ *                          hold the OS_Keystore_Handle_t return value.
+ * @param[in]  hInner       Handle of the keystore that holds the keys. It must
+ *                          outlive the created context.
+ * @param[in]  cacheSize    Maximum amount of key data in bytes that is kept in
+ *                          RAM.
+ */
+OS_Error_t
+OS_KeystoreCached_init(
+    OS_Keystore_Handle_t*   pHandle,
+    OS_Keystore_Handle_t    hInner,
+    size_t                  cacheSize);
+
+/**
+ * Returns the counters of the cache, which allow to check whether the
+ * configured cache size fits the workload.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle does not refer to an
+ *                                      OS_KeystoreCached instance.
+ * @retval OS_ERROR_INVALID_PARAMETER   stats is NULL.
+ *
+ * @param[in]  hKeystore    Handle of the OS_KeystoreCached instance.
+ * @param[out] stats        Receives the counters.
+ */
+OS_Error_t
+OS_KeystoreCached_getStats(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_KeystoreCached_Stats_t*  stats);
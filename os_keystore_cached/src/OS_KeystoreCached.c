@@ -0,0 +1,840 @@
+/*
+ * Copyright (C) 2021-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreCached.h"
+
+#include "lib_debug/Debug.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+// Vtable definition -----------------------------------------------------------
+
+static OS_Error_t
+OS_KeystoreCached_free(
+    OS_Keystore_t* ptr);
+
+static OS_Error_t
+OS_KeystoreCached_storeKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void const*     keyData,
+    size_t          keySize);
+
+static OS_Error_t
+OS_KeystoreCached_loadKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void*           keyData,
+    size_t*         keySize);
+
+static OS_Error_t
+OS_KeystoreCached_deleteKey(
+    OS_Keystore_t*  ptr,
+    const char*     name);
+
+static OS_Error_t
+OS_KeystoreCached_copyKey(
+    OS_Keystore_t*  srcPtr,
+    const char*     name,
+    OS_Keystore_t*  dstPtr);
+
+static OS_Error_t
+OS_KeystoreCached_wipeKeystore(
+    OS_Keystore_t*  ptr);
+
+static OS_Error_t
+OS_KeystoreCached_storeKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+static OS_Error_t
+OS_KeystoreCached_deleteKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+static OS_Error_t
+OS_KeystoreCached_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize);
+
+static OS_Error_t
+OS_KeystoreCached_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize);
+
+static OS_Error_t
+OS_KeystoreCached_getKeystoreStats(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stats_t*    stats);
+
+static OS_Error_t
+OS_KeystoreCached_beginStoreKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreCached_writeKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len);
+
+static OS_Error_t
+OS_KeystoreCached_commitKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreCached_beginLoadKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreCached_readKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len);
+
+static OS_Error_t
+OS_KeystoreCached_closeStream(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream);
+
+static const OS_Keystore_Vtable_t OS_KeystoreCached_vtable =
+{
+    .free           = OS_KeystoreCached_free,
+    .storeKey       = OS_KeystoreCached_storeKey,
+    .loadKey        = OS_KeystoreCached_loadKey,
+    .deleteKey      = OS_KeystoreCached_deleteKey,
+    .copyKey        = OS_KeystoreCached_copyKey,
+    .moveKey        = OS_Keystore_moveKeyImpl,
+    .wipeKeystore   = OS_KeystoreCached_wipeKeystore,
+    .storeKeys      = OS_KeystoreCached_storeKeys,
+    .loadKeys       = OS_Keystore_loadKeysImpl,
+    .deleteKeys     = OS_KeystoreCached_deleteKeys,
+    .listKeys       = OS_KeystoreCached_listKeys,
+    .getKeyInfo     = OS_KeystoreCached_getKeyInfo,
+    .getStats       = OS_KeystoreCached_getKeystoreStats,
+    .beginStoreKey  = OS_KeystoreCached_beginStoreKey,
+    .writeKeyChunk  = OS_KeystoreCached_writeKeyChunk,
+    .commitKey      = OS_KeystoreCached_commitKey,
+    .beginLoadKey   = OS_KeystoreCached_beginLoadKey,
+    .readKeyChunk   = OS_KeystoreCached_readKeyChunk,
+    .closeStream    = OS_KeystoreCached_closeStream
+};
+
+// Used instead of OS_KeystoreCached_vtable if the inner keystore can run its
+// reads in parallel, then loads of this instance can do so as well. Loads
+// serialize on the spin lock of the cache only, see loadKey().
+static const OS_Keystore_Vtable_t OS_KeystoreCached_concurrentVtable =
+{
+    .free           = OS_KeystoreCached_free,
+    .storeKey       = OS_KeystoreCached_storeKey,
+    .loadKey        = OS_KeystoreCached_loadKey,
+    .deleteKey      = OS_KeystoreCached_deleteKey,
+    .copyKey        = OS_KeystoreCached_copyKey,
+    .moveKey        = OS_Keystore_moveKeyImpl,
+    .wipeKeystore   = OS_KeystoreCached_wipeKeystore,
+    .storeKeys      = OS_KeystoreCached_storeKeys,
+    .loadKeys       = OS_Keystore_loadKeysImpl,
+    .deleteKeys     = OS_KeystoreCached_deleteKeys,
+    .listKeys       = OS_KeystoreCached_listKeys,
+    .getKeyInfo     = OS_KeystoreCached_getKeyInfo,
+    .getStats       = OS_KeystoreCached_getKeystoreStats,
+    .beginStoreKey  = OS_KeystoreCached_beginStoreKey,
+    .writeKeyChunk  = OS_KeystoreCached_writeKeyChunk,
+    .commitKey      = OS_KeystoreCached_commitKey,
+    .beginLoadKey   = OS_KeystoreCached_beginLoadKey,
+    .readKeyChunk   = OS_KeystoreCached_readKeyChunk,
+    .closeStream    = OS_KeystoreCached_closeStream,
+    .hasConcurrentReads = true
+};
+
+
+// Private functions -----------------------------------------------------------
+
+static inline bool
+isCachedKeystore(
+    OS_Keystore_t const*    ptr)
+{
+    return (ptr->vtable == &OS_KeystoreCached_vtable)
+           || (ptr->vtable == &OS_KeystoreCached_concurrentVtable);
+}
+
+static inline uint32_t
+getNameHash(
+    const char* name)
+{
+    return OS_Keystore_hashName(name, strlen(name));
+}
+
+static inline bool
+isCacheable(
+    OS_KeystoreCached_t*    self,
+    const char*             name)
+{
+    return (self->budget > 0)
+           && (strlen(name) <= OS_KeystoreCached_MAX_NAME_LEN);
+}
+
+static int
+cache_find(
+    OS_KeystoreCached_t*    self,
+    const char*             name,
+    uint32_t                hash)
+{
+    for (int i = 0; i < OS_KeystoreCached_MAX_ENTRIES; i++)
+    {
+        OS_KeystoreCached_Entry const* entry = &self->entries[i];
+
+        if (entry->isUsed && (entry->hash == hash)
+            && (strcmp(entry->name, name) == 0))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void
+cache_removeEntry(
+    OS_KeystoreCached_t*        self,
+    OS_KeystoreCached_Entry*    entry)
+{
+    OS_Keystore_zeroize(entry->data, entry->size);
+    free(entry->data);
+
+    self->stats.usedBytes -= entry->size;
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void
+cache_remove(
+    OS_KeystoreCached_t*    self,
+    const char*             name)
+{
+    if (!isCacheable(self, name))
+    {
+        return;
+    }
+
+    int i = cache_find(self, name, getNameHash(name));
+
+    if (i >= 0)
+    {
+        cache_removeEntry(self, &self->entries[i]);
+    }
+}
+
+static void
+cache_clear(
+    OS_KeystoreCached_t*    self)
+{
+    for (int i = 0; i < OS_KeystoreCached_MAX_ENTRIES; i++)
+    {
+        if (self->entries[i].isUsed)
+        {
+            cache_removeEntry(self, &self->entries[i]);
+        }
+    }
+}
+
+static OS_KeystoreCached_Entry*
+cache_makeRoom(
+    OS_KeystoreCached_t*    self,
+    size_t                  size)
+{
+    OS_KeystoreCached_Entry* freeEntry = NULL;
+
+    for (;;)
+    {
+        if (NULL == freeEntry)
+        {
+            for (int i = 0; i < OS_KeystoreCached_MAX_ENTRIES; i++)
+            {
+                if (!self->entries[i].isUsed)
+                {
+                    freeEntry = &self->entries[i];
+                    break;
+                }
+            }
+        }
+
+        if ((NULL != freeEntry)
+            && (self->stats.usedBytes + size <= self->budget))
+        {
+            return freeEntry;
+        }
+
+        // Advance the clock hand until it finds an entry that has not been hit
+        // since it was passed the last time. This terminates after at most two
+        // rounds, as every entry passed loses its reference bit.
+        OS_KeystoreCached_Entry* entry = &self->entries[self->hand];
+        self->hand = (self->hand + 1) % OS_KeystoreCached_MAX_ENTRIES;
+
+        if (!entry->isUsed)
+        {
+            continue;
+        }
+
+        if (entry->isReferenced)
+        {
+            entry->isReferenced = false;
+            continue;
+        }
+
+        cache_removeEntry(self, entry);
+        self->stats.evictions++;
+
+        if (NULL == freeEntry)
+        {
+            freeEntry = entry;
+        }
+    }
+}
+
+static void
+cache_put(
+    OS_KeystoreCached_t*    self,
+    const char*             name,
+    uint32_t                hash,
+    void const*             keyData,
+    size_t                  keySize)
+{
+    if ((keySize == 0) || (keySize > self->budget)
+        || (keySize > OS_KeystoreCached_MAX_KEY_SIZE))
+    {
+        return;
+    }
+
+    // Failing to allocate is not an error, the key is just not cached then.
+    uint8_t* data = malloc(keySize);
+
+    if (NULL == data)
+    {
+        return;
+    }
+
+    memcpy(data, keyData, keySize);
+
+    OS_Keystore_spinLock(OS_KeystoreCached_TO_OS_KEYSTORE(self),
+                         &self->cacheLock);
+
+    // Another load of the same key may have been faster.
+    if (cache_find(self, name, hash) >= 0)
+    {
+        OS_Keystore_spinUnlock(&self->cacheLock);
+        OS_Keystore_zeroize(data, keySize);
+        free(data);
+        return;
+    }
+
+    OS_KeystoreCached_Entry* entry = cache_makeRoom(self, keySize);
+
+    entry->isUsed       = true;
+    entry->isReferenced = false;
+    entry->hash         = hash;
+    entry->size         = keySize;
+    entry->data         = data;
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+
+    self->stats.usedBytes += keySize;
+
+    OS_Keystore_spinUnlock(&self->cacheLock);
+}
+
+static OS_Error_t
+ctor(
+    OS_KeystoreCached_t*    self,
+    OS_Keystore_t*          inner,
+    size_t                  cacheSize)
+{
+    if (NULL == self || NULL == inner)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(self, 0, sizeof(OS_KeystoreCached_t));
+
+    atomic_flag_clear(&self->cacheLock);
+
+    self->inner  = inner;
+    self->budget = cacheSize;
+
+    OS_KeystoreCached_TO_OS_KEYSTORE(self)->vtable =
+        (inner->vtable->hasConcurrentReads || inner->vtable->hasLockFreeReads) ?
+        &OS_KeystoreCached_concurrentVtable : &OS_KeystoreCached_vtable;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+dtor(
+    OS_KeystoreCached_t* self)
+{
+    if (self == NULL)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    cache_clear(self);
+    OS_Keystore_zeroize(self->buffer, sizeof(self->buffer));
+
+    return OS_SUCCESS;
+}
+
+
+// Exported via Vtable ---------------------------------------------------------
+
+static OS_Error_t
+OS_KeystoreCached_free(
+    OS_Keystore_t* ptr)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    OS_Error_t err = dtor(self);
+    if (OS_SUCCESS == err)
+    {
+        free(self);
+    }
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreCached_storeKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void const*     keyData,
+    size_t          keySize)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Keys are only cached when they are loaded, which avoids filling the
+    // cache with keys that are stored but never used.
+    return self->inner->vtable->storeKey(self->inner, name, keyData, keySize);
+}
+
+static OS_Error_t
+OS_KeystoreCached_loadKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void*           keyData,
+    size_t*         keySize)
+{
+    OS_Error_t err;
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self || NULL == name || NULL == keyData || NULL == keySize)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!isCacheable(self, name))
+    {
+        return self->inner->vtable->loadKey(self->inner, name, keyData,
+                                            keySize);
+    }
+
+    uint32_t hash = getNameHash(name);
+
+    // Loads may run in parallel, see OS_KeystoreCached_concurrentVtable. The
+    // writers hold the lock of the keystore, they do not need the spin lock.
+    OS_Keystore_spinLock(OS_KeystoreCached_TO_OS_KEYSTORE(self),
+                         &self->cacheLock);
+
+    int i = cache_find(self, name, hash);
+
+    if (i >= 0)
+    {
+        OS_KeystoreCached_Entry* entry = &self->entries[i];
+
+        if (entry->size > *keySize)
+        {
+            OS_Keystore_spinUnlock(&self->cacheLock);
+            Debug_LOG_ERROR("%s: The actual amount of key data (%zu bytes) is bigger "
+                            "than the expected size (%zu bytes)",
+                            __func__, entry->size, *keySize);
+            return OS_ERROR_BUFFER_TOO_SMALL;
+        }
+
+        memcpy(keyData, entry->data, entry->size);
+        *keySize = entry->size;
+
+        entry->isReferenced = true;
+        self->stats.hits++;
+
+        OS_Keystore_spinUnlock(&self->cacheLock);
+
+        return OS_SUCCESS;
+    }
+
+    self->stats.misses++;
+
+    OS_Keystore_spinUnlock(&self->cacheLock);
+
+    err = self->inner->vtable->loadKey(self->inner, name, keyData, keySize);
+
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    cache_put(self, name, hash, keyData, *keySize);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreCached_deleteKey(
+    OS_Keystore_t*  ptr,
+    const char*     name)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Drop the cached copy first, so it does not survive even if the inner
+    // keystore fails to delete the key.
+    cache_remove(self, name);
+
+    return self->inner->vtable->deleteKey(self->inner, name);
+}
+
+static OS_Error_t
+OS_KeystoreCached_copyKey(
+    OS_Keystore_t*  srcPtr,
+    const char*     name,
+    OS_Keystore_t*  dstPtr)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) srcPtr;
+
+    // Loading through this instance lets the copy benefit from the cache.
+    OS_Error_t err = OS_Keystore_copyKeyImpl(
+                         srcPtr,
+                         name,
+                         dstPtr,
+                         self->buffer,
+                         sizeof(self->buffer));
+
+    OS_Keystore_zeroize(self->buffer, sizeof(self->buffer));
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreCached_wipeKeystore(
+    OS_Keystore_t*  ptr)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    cache_clear(self);
+
+    return self->inner->vtable->wipeKeystore(self->inner);
+}
+
+
+static OS_Error_t
+OS_KeystoreCached_storeKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Let the inner keystore handle the whole batch, it may do so more
+    // efficiently than key by key.
+    return (NULL == self->inner->vtable->storeKeys) ?
+           OS_Keystore_storeKeysImpl(self->inner, items, numItems) :
+           self->inner->vtable->storeKeys(self->inner, items, numItems);
+}
+
+static OS_Error_t
+OS_KeystoreCached_deleteKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self || NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        if (NULL != items[i].name)
+        {
+            cache_remove(self, items[i].name);
+        }
+    }
+
+    return (NULL == self->inner->vtable->deleteKeys) ?
+           OS_Keystore_deleteKeysImpl(self->inner, items, numItems) :
+           self->inner->vtable->deleteKeys(self->inner, items, numItems);
+}
+
+static OS_Error_t
+OS_KeystoreCached_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (NULL == self->inner->vtable->listKeys)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    return self->inner->vtable->listKeys(self->inner, cursor, name, nameSize,
+                                         keySize);
+}
+
+static OS_Error_t
+OS_KeystoreCached_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (NULL == self->inner->vtable->getKeyInfo)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    return self->inner->vtable->getKeyInfo(self->inner, name, keySize);
+}
+
+static OS_Error_t
+OS_KeystoreCached_getKeystoreStats(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stats_t*    stats)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    stats->cacheHits      = self->stats.hits;
+    stats->cacheMisses    = self->stats.misses;
+    stats->cacheEvictions = self->stats.evictions;
+
+    return OS_SUCCESS;
+}
+
+// Streams are passed to the inner keystore, every stream of this instance
+// wraps one of the inner keystore. Streamed keys are not cached. Like all
+// other calls on the inner keystore, they use its vtable, the lock of this
+// instance covers the inner keystore.
+static OS_Error_t
+OS_KeystoreCached_beginStoreKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    OS_Keystore_Stream_t* inner = malloc(sizeof(*inner));
+    if (NULL == inner)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    OS_Error_t err = OS_Keystore_beginStoreKeyImpl(self->inner, name,
+                                                   stream->keySize, inner);
+    if (err != OS_SUCCESS)
+    {
+        free(inner);
+        return err;
+    }
+
+    stream->ctx = inner;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreCached_writeKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    return OS_Keystore_writeKeyChunkImpl(self->inner, stream->ctx, data, len);
+}
+
+static OS_Error_t
+OS_KeystoreCached_commitKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    OS_Error_t err = OS_Keystore_commitKeyImpl(self->inner, stream->ctx);
+    free(stream->ctx);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreCached_beginLoadKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    OS_Keystore_Stream_t* inner = malloc(sizeof(*inner));
+    if (NULL == inner)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    OS_Error_t err = OS_Keystore_beginLoadKeyImpl(self->inner, name, inner);
+    if (err != OS_SUCCESS)
+    {
+        free(inner);
+        return err;
+    }
+
+    stream->keySize = inner->keySize;
+    stream->ctx     = inner;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreCached_readKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+    size_t read;
+
+    // Both streams are at the same position, so the inner one returns all of
+    // the requested data.
+    return OS_Keystore_readKeyChunkImpl(self->inner, stream->ctx, buffer, len,
+                                        &read);
+}
+
+static OS_Error_t
+OS_KeystoreCached_closeStream(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_KeystoreCached_t* self = (OS_KeystoreCached_t*) ptr;
+
+    OS_Error_t err = OS_Keystore_closeStreamImpl(self->inner, stream->ctx);
+    free(stream->ctx);
+
+    return err;
+}
+
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+OS_KeystoreCached_init(
+    OS_Keystore_Handle_t*   pHandle,
+    OS_Keystore_Handle_t    hInner,
+    size_t                  cacheSize)
+{
+    OS_Error_t err = OS_ERROR_GENERIC;
+
+    if (NULL == pHandle)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreCached_t* self = malloc(sizeof(OS_KeystoreCached_t));
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    err = ctor(self, hInner, cacheSize);
+
+    if (err != OS_SUCCESS)
+    {
+        free(self);
+    }
+    else
+    {
+        *pHandle = OS_KeystoreCached_TO_OS_KEYSTORE(self);
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_KeystoreCached_getStats(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_KeystoreCached_Stats_t*  stats)
+{
+    if ((NULL == hKeystore) || !isCachedKeystore(hKeystore))
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == stats)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Keystore_lock(hKeystore);
+    *stats = ((OS_KeystoreCached_t*) hKeystore)->stats;
+    OS_Keystore_unlock(hKeystore);
+
+    return OS_SUCCESS;
+}
@@ -23,6 +23,20 @@
 #pragma once
 
 #include "OS_Keystore.h"
+#include "OS_KeystoreExt.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Set if trace events are emitted, see OS_Keystore_setTraceHook().
+#if defined(OS_KEYSTORE_TRACE) || defined(OS_KEYSTORE_TRACE_HOOK)
+#define OS_KEYSTORE_HAS_TRACE
+#endif
+
+// Set if the clock of OS_Keystore_setClock() is used.
+#if defined(OS_KEYSTORE_STATS) || defined(OS_KEYSTORE_HAS_TRACE)
+#define OS_KEYSTORE_HAS_CLOCK
+#endif
 
 typedef OS_Error_t
 (*OS_Keystore_Vtable_Free)(
@@ -63,6 +77,90 @@ typedef OS_Error_t
 (*OS_Keystore_Vtable_WipeKeystore)(
     OS_Keystore_t*  self);
 
+typedef OS_Error_t
+(*OS_Keystore_Vtable_StoreKeys)(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_LoadKeys)(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_DeleteKeys)(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_ListKeys)(
+    OS_Keystore_t*              self,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_GetKeyInfo)(
+    OS_Keystore_t*  self,
+    const char*     name,
+    size_t*         keySize);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_BorrowKey)(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Lease_t*    lease);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_ReleaseKey)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Lease_t*    lease);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_BeginStoreKey)(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_WriteKeyChunk)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_CommitKey)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_BeginLoadKey)(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_ReadKeyChunk)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_CloseStream)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream);
+
+typedef OS_Error_t
+(*OS_Keystore_Vtable_GetStats)(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stats_t*    stats);
+
 typedef struct
 {
     OS_Keystore_Vtable_Free           free;
@@ -72,21 +170,247 @@ typedef struct
     OS_Keystore_Vtable_CopyKey        copyKey;
     OS_Keystore_Vtable_MoveKey        moveKey;
     OS_Keystore_Vtable_WipeKeystore   wipeKeystore;
+    // Optional, the default implementations are used if these are NULL
+    OS_Keystore_Vtable_StoreKeys      storeKeys;
+    OS_Keystore_Vtable_LoadKeys       loadKeys;
+    OS_Keystore_Vtable_DeleteKeys     deleteKeys;
+    // Optional, OS_ERROR_NOT_SUPPORTED is returned if these are NULL
+    OS_Keystore_Vtable_ListKeys       listKeys;
+    OS_Keystore_Vtable_GetKeyInfo     getKeyInfo;
+    // Optional, keys are copied if borrowKey is NULL or returns
+    // OS_ERROR_NOT_SUPPORTED for a key. releaseKey is called for every key
+    // borrowKey lent.
+    OS_Keystore_Vtable_BorrowKey      borrowKey;
+    OS_Keystore_Vtable_ReleaseKey     releaseKey;
+    // Optional, the key is buffered in RAM and passed to storeKey() resp.
+    // loaded with loadKey() if these are NULL. The API keeps keySize and pos
+    // of the stream: beginStoreKey() gets keySize set, beginLoadKey() has to
+    // set it. writeKeyChunk() and readKeyChunk() get pos before the chunk,
+    // which never exceeds the key. commitKey() is only called when all data
+    // has been written, the stream is ended afterwards in any case.
+    OS_Keystore_Vtable_BeginStoreKey  beginStoreKey;
+    OS_Keystore_Vtable_WriteKeyChunk  writeKeyChunk;
+    OS_Keystore_Vtable_CommitKey      commitKey;
+    OS_Keystore_Vtable_BeginLoadKey   beginLoadKey;
+    OS_Keystore_Vtable_ReadKeyChunk   readKeyChunk;
+    OS_Keystore_Vtable_CloseStream    closeStream;
+    // Optional, adds the counters the implementation keeps on its own (e.g.
+    // of a cache) to the statistics filled by the API
+    OS_Keystore_Vtable_GetStats       getStats;
+    // Set if loadKey(), loadKeys(), listKeys(), getKeyInfo(), borrowKey(),
+    // releaseKey() and the functions of a load stream can run in parallel,
+    // i.e. they do not modify the context.
+    bool                              hasConcurrentReads;
+    // Set if these functions synchronize with the writers on their own, the
+    // API then calls them without taking the lock.
+    bool                              hasLockFreeReads;
 }
 OS_Keystore_Vtable_t;
 
+/**
+ * Kinds of I/O an implementation accounts to the running operation, see
+ * OS_Keystore_STATS_COUNT_IO().
+ */
+typedef enum
+{
+    OS_Keystore_IO_FS_OPEN,
+    OS_Keystore_IO_FS_CLOSE,
+    OS_Keystore_IO_FS_READ,
+    OS_Keystore_IO_FS_WRITE,
+    OS_Keystore_IO_FS_DELETE,
+    OS_Keystore_IO_FS_GET_SIZE,
+    OS_Keystore_IO_DIGEST,
+    OS_Keystore_IO_NUM
+}
+OS_Keystore_Io_t;
+
+#if defined(OS_KEYSTORE_STATS)
+
+typedef struct
+{
+    atomic_uint_least64_t   calls;
+    atomic_uint_least64_t   notFound;
+    atomic_uint_least64_t   errors;
+    atomic_uint_least64_t   latency[OS_Keystore_Stats_LATENCY_BUCKETS];
+    atomic_uint_least64_t   io[OS_Keystore_IO_NUM];
+    atomic_uint_least64_t   bytesRead;
+    atomic_uint_least64_t   bytesWritten;
+}
+OS_Keystore_OpCounters_t;
+
+typedef struct
+{
+    OS_Keystore_OpCounters_t    ops[OS_Keystore_OP_NUM];
+    atomic_uint_least64_t       hashMismatches;
+    /**
+     * Operation the I/O is accounted to, set by the API while it holds the
+     * lock as writer. OS_Keystore_OP_OTHER is 0, so it is the initial value.
+     * With concurrent reads, the I/O of a read may be accounted to
+     * OS_Keystore_OP_OTHER.
+     */
+    atomic_int                  op;
+}
+OS_Keystore_Counters_t;
+
+//! Accounts an I/O of the implementation to the running operation.
+#define OS_Keystore_STATS_COUNT_IO(self, io, bytes) \
+    OS_Keystore_countIo((self), (io), (bytes))
+
+//! Counts a key whose data did not match its hash.
+#define OS_Keystore_STATS_COUNT_HASH_MISMATCH(self) \
+    OS_Keystore_countHashMismatch(self)
+
+#else /* OS_KEYSTORE_STATS */
+
+#define OS_Keystore_STATS_COUNT_IO(self, io, bytes) \
+    do { (void) (self); } while (0)
+
+#define OS_Keystore_STATS_COUNT_HASH_MISMATCH(self) \
+    do { (void) (self); } while (0)
+
+#endif /* OS_KEYSTORE_STATS */
+
 struct OS_Keystore
 {
     const OS_Keystore_Vtable_t* vtable;
+    //! Set by OS_Keystore_setLock(), unused if the callbacks are NULL. The
+    //! implementations zero it when they are created.
+    OS_Keystore_RwLock_t        lock;
+#if defined(OS_KEYSTORE_STATS)
+    //! See OS_Keystore_getStats(), zeroed together with the lock.
+    OS_Keystore_Counters_t      stats;
+#endif
+#if defined(OS_KEYSTORE_HAS_CLOCK)
+    //! Set by OS_Keystore_setClock(), unused if the callback is NULL.
+    OS_Keystore_Clock_t         clock;
+#endif
+#if defined(OS_KEYSTORE_TRACE)
+    //! Set by OS_Keystore_setTraceHook(), unused if the callback is NULL.
+    OS_Keystore_TraceHook_t     traceHook;
+#endif
+#if defined(OS_KEYSTORE_HAS_TRACE)
+    //! Number of the last call, see OS_Keystore_TraceEvent_t.
+    atomic_uint_least32_t       traceCallId;
+#endif
 };
 
 
 // Non virtual functions -------------------------------------------------------
 
+/**
+ * Takes the lock of the keystore as writer, if a lock is set.
+ *
+ * The functions of the OS_Keystore API do this on their own. Implementations
+ * use it for their own functions that take a keystore handle, e.g. a
+ * maintenance function. Calls of the vtable functions while the lock is held
+ * must not go through the OS_Keystore API, as the lock is not recursive.
+ */
+void
+OS_Keystore_lock(
+    OS_Keystore_t*  self);
+
+/**
+ * Releases the lock taken with OS_Keystore_lock().
+ */
+void
+OS_Keystore_unlock(
+    OS_Keystore_t*  self);
+
+/**
+ * Takes the lock of the keystore as reader, if a lock is set. Used by
+ * implementations with hasLockFreeReads for the parts of a read that have to
+ * be protected from the writers.
+ */
+void
+OS_Keystore_lockShared(
+    OS_Keystore_t*  self);
+
+/**
+ * Releases the lock taken with OS_Keystore_lockShared().
+ */
+void
+OS_Keystore_unlockShared(
+    OS_Keystore_t*  self);
+
+/**
+ * Gives up the CPU, if the lock of the keystore has a yield callback. Used by
+ * implementations with hasLockFreeReads while a writer waits for the readers.
+ */
+void
+OS_Keystore_yield(
+    OS_Keystore_t*  self);
+
+/**
+ * Takes a spin lock of an implementation with hasConcurrentReads, which guards
+ * the state that reads running in parallel modify, e.g. a cache. It must only
+ * be held for a short time. A thread that does not get it after a few tries
+ * gives up the CPU with OS_Keystore_yield().
+ */
+void
+OS_Keystore_spinLock(
+    OS_Keystore_t*  self,
+    atomic_flag*    flag);
+
+/**
+ * Releases the spin lock taken with OS_Keystore_spinLock().
+ */
+void
+OS_Keystore_spinUnlock(
+    atomic_flag*    flag);
+
+/**
+ * Returns the FNV-1a hash of len bytes of a key name. It is meant for hash
+ * tables and to tell names apart in traces, not for security. The index file
+ * of OS_KeystoreFile also uses it as the checksum of its entries.
+ */
+uint32_t
+OS_Keystore_hashName(
+    void const* name,
+    size_t      len);
+
+/**
+ * Clears key data, also if the memory is about to be freed or goes out of
+ * scope, where the compiler may drop a plain memset().
+ */
+void
+OS_Keystore_zeroize(
+    void*   buf,
+    size_t  size);
+
+#if defined(OS_KEYSTORE_STATS)
+
+/**
+ * Accounts an I/O of the implementation to the operation that is running on
+ * the keystore. Use OS_Keystore_STATS_COUNT_IO(), which compiles out without
+ * OS_KEYSTORE_STATS.
+ *
+ * @param[in] self  The keystore.
+ * @param[in] io    Kind of the I/O.
+ * @param[in] bytes Number of bytes read or written, 0 for other kinds.
+ */
+void
+OS_Keystore_countIo(
+    OS_Keystore_t*      self,
+    OS_Keystore_Io_t    io,
+    size_t              bytes);
+
+/**
+ * Counts a key whose data did not match its hash. Use
+ * OS_Keystore_STATS_COUNT_HASH_MISMATCH(), which compiles out without
+ * OS_KEYSTORE_STATS.
+ */
+void
+OS_Keystore_countHashMismatch(
+    OS_Keystore_t*  self);
+
+#endif /* OS_KEYSTORE_STATS */
+
 /**
  * An implementation of the OS_Keystore_copyKey() function provided as a
- * standard implementation that performs OS_Keystore_loadKey() and then
- * OS_Keystore_storeKey().
+ * standard implementation that performs loadKey() and then storeKey() of the
+ * respective vtables. Keys that do not fit into the buffer are passed through
+ * it piece by piece, with a load stream of the source and a store stream of
+ * the destination.
  *
  * A designer of an implementation of OS_Keystore may decide or not to use it
  * (putting it in its Vtable).
@@ -103,8 +427,8 @@ OS_Keystore_copyKeyImpl(
 
 /**
  * An implementation of the OS_Keystore_moveKey() function provided as a
- * standard implementation that performs the OS_Keystore_copyKey() and then
- * OS_Keystore_deleteKey().
+ * standard implementation that performs copyKey() and then deleteKey() of the
+ * source vtable.
  *
  * A designer of an implementation of OS_Keystore may decide or not to use it
  * (putting it in its Vtable).
@@ -116,3 +440,95 @@ OS_Keystore_moveKeyImpl(
     OS_Keystore_t*  srcPtr,
     const char*     name,
     OS_Keystore_t*  dstPtr);
+
+/**
+ * An implementation of the OS_Keystore_storeKeys() function provided as a
+ * standard implementation that performs OS_Keystore_storeKey() for every key.
+ *
+ * It is used when an implementation of OS_Keystore does not provide its own.
+ *
+ * See OS_Keystore_storeKeys().
+ */
+OS_Error_t
+OS_Keystore_storeKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * An implementation of the OS_Keystore_loadKeys() function provided as a
+ * standard implementation that performs OS_Keystore_loadKey() for every key.
+ *
+ * It is used when an implementation of OS_Keystore does not provide its own.
+ *
+ * See OS_Keystore_loadKeys().
+ */
+OS_Error_t
+OS_Keystore_loadKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * An implementation of the OS_Keystore_deleteKeys() function provided as a
+ * standard implementation that performs OS_Keystore_deleteKey() for every key.
+ *
+ * It is used when an implementation of OS_Keystore does not provide its own.
+ *
+ * See OS_Keystore_deleteKeys().
+ */
+OS_Error_t
+OS_Keystore_deleteKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * Implementations of the stream functions, e.g. OS_Keystore_beginStoreKey(),
+ * which keep the position of the stream and call the respective vtable
+ * function. If the vtable has no stream functions, the whole key is held in
+ * RAM and passed to storeKey() or taken from loadKey() of the vtable.
+ *
+ * They are used by the OS_Keystore API and allow an implementation of
+ * OS_Keystore to use the streams of another one without going through the
+ * API, which takes the lock again. The parameters are not checked.
+ *
+ * See OS_Keystore_beginStoreKey().
+ */
+OS_Error_t
+OS_Keystore_beginStoreKeyImpl(
+    OS_Keystore_t*          self,
+    const char*             name,
+    size_t                  keySize,
+    OS_Keystore_Stream_t*   stream);
+
+OS_Error_t
+OS_Keystore_writeKeyChunkImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len);
+
+OS_Error_t
+OS_Keystore_commitKeyImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream);
+
+OS_Error_t
+OS_Keystore_beginLoadKeyImpl(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+OS_Error_t
+OS_Keystore_readKeyChunkImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len,
+    size_t*                 read);
+
+OS_Error_t
+OS_Keystore_closeStreamImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream);
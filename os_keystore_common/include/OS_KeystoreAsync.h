@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Asynchronous front end of the OS_Keystore API.
+ *
+ * An OS_KeystoreAsync instance queues store, load and delete requests for a
+ * keystore, the submitting thread does not wait for them. The requests are
+ * executed by a worker, i.e. a thread of the component that calls
+ * OS_KeystoreAsync_process() whenever it is notified about new requests. The
+ * completion of a request is signaled by a callback and can also be polled
+ * with OS_KeystoreAsync_isDone().
+ *
+ * Any number of requests may be outstanding at the same time. The worker
+ * passes consecutive requests of the same kind to the keystore as one batch
+ * (see OS_Keystore_storeKeys()), so implementations like OS_KeystoreFile
+ * combine the storage I/O of several keys, e.g. update their index once for
+ * the whole batch.
+ *
+ * The requests are executed in the order they were submitted as long as there
+ * is a single worker. With several workers, which requires the keystore to
+ * have a lock (see OS_Keystore_setLock()), requests may complete in any order,
+ * so requests for the same key must not be outstanding at the same time.
+ *
+ * The requests are provided by the caller, the instance does not allocate
+ * memory per request. A request and the buffers it refers to must not be
+ * modified or reused until it is done.
+ */
+
+#pragma once
+
+#include "OS_Keystore.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+//! Maximum number of requests the worker passes to the keystore at once.
+#define OS_KeystoreAsync_MAX_BATCH      16
+
+typedef struct OS_KeystoreAsync OS_KeystoreAsync_t;
+typedef OS_KeystoreAsync_t* OS_KeystoreAsync_Handle_t;
+
+typedef struct OS_KeystoreAsync_Request OS_KeystoreAsync_Request_t;
+
+/**
+ * Completion callback of a request. It is called by the worker that executed
+ * the request, before the request is reported as done by
+ * OS_KeystoreAsync_isDone().
+ */
+typedef void
+(*OS_KeystoreAsync_Callback_t)(
+    OS_KeystoreAsync_Request_t* request,
+    void*                       ctx);
+
+typedef enum
+{
+    OS_KeystoreAsync_OP_STORE_KEY,
+    OS_KeystoreAsync_OP_LOAD_KEY,
+    OS_KeystoreAsync_OP_DELETE_KEY,
+}
+OS_KeystoreAsync_Op_t;
+
+/**
+ * A request, it is set up by the submit functions. The caller may only read
+ * the fields once the request is done.
+ */
+struct OS_KeystoreAsync_Request
+{
+    OS_KeystoreAsync_Op_t       op;
+    const char*                 name;
+    void*                       keyData;
+    /**
+     * Size of the key data. For a load this is the size of the buffer when
+     * submitted and the size of the loaded key when done.
+     */
+    size_t                      keySize;
+    //! Result of the operation, see the functions of OS_Keystore.h.
+    OS_Error_t                  result;
+    OS_KeystoreAsync_Callback_t onDone;
+    void*                       ctx;
+    atomic_bool                 isDone;
+    //! Link of the queue, do not modify.
+    OS_KeystoreAsync_Request_t* next;
+};
+
+/**
+ * Synchronization of the request queue, provided by the caller, e.g. on top
+ * of the mutexes and semaphores of the component. All callbacks may be NULL
+ * if requests are submitted and processed by the same thread.
+ */
+typedef struct
+{
+    //! Locks the queue, the lock does not need to be recursive.
+    void    (*lock)(void* ctx);
+    void    (*unlock)(void* ctx);
+    //! Called after a request was queued, wakes up a worker.
+    void    (*notify)(void* ctx);
+    //! Passed to the callbacks.
+    void*   ctx;
+}
+OS_KeystoreAsync_Sync_t;
+
+
+/**
+ * Allocates space for a new OS_KeystoreAsync_t context and initialises it.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
+ *                                      OS_KeystoreAsync_t context.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason.
+ *
+ * @param[out] pHandle      Pointer to the variable of the caller supposed to
+ *                          hold the OS_KeystoreAsync_Handle_t return value.
+ * @param[in]  hKeystore    Handle of the keystore that executes the requests.
+ *                          It must outlive the created context.
+ * @param[in]  sync         Synchronization of the queue, it is copied. May be
+ *                          NULL if no synchronization is needed.
+ */
+OS_Error_t
+OS_KeystoreAsync_init(
+    OS_KeystoreAsync_Handle_t*      pHandle,
+    OS_Keystore_Handle_t            hKeystore,
+    OS_KeystoreAsync_Sync_t const*  sync);
+
+/**
+ * Frees the context. The keystore remains owned by the caller.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_STATE       There are requests that are not done
+ *                                      yet.
+ *
+ * @param[in] hAsync    Handle of the context.
+ */
+OS_Error_t
+OS_KeystoreAsync_free(
+    OS_KeystoreAsync_Handle_t   hAsync);
+
+/**
+ * Queues a request to store a key, see OS_Keystore_storeKey().
+ *
+ * @retval OS_SUCCESS                   The request was queued.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   request or name is NULL.
+ *
+ * @param[in] hAsync    Handle of the context.
+ * @param[in] request   Request to be set up and queued.
+ * @param[in] name      Name of the key.
+ * @param[in] keyData   Key data, it is read when the request is executed.
+ * @param[in] keySize   Size of the key data.
+ * @param[in] onDone    Completion callback, may be NULL.
+ * @param[in] ctx       Passed to the callback.
+ */
+OS_Error_t
+OS_KeystoreAsync_storeKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    void const*                 keyData,
+    size_t                      keySize,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx);
+
+/**
+ * Queues a request to load a key, see OS_Keystore_loadKey(). The size of the
+ * loaded key is put into the keySize field of the request.
+ *
+ * @retval OS_SUCCESS                   The request was queued.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   request or name is NULL.
+ *
+ * @param[in] hAsync    Handle of the context.
+ * @param[in] request   Request to be set up and queued.
+ * @param[in] name      Name of the key.
+ * @param[in] keyData   Buffer that receives the key data.
+ * @param[in] keySize   Size of the buffer.
+ * @param[in] onDone    Completion callback, may be NULL.
+ * @param[in] ctx       Passed to the callback.
+ */
+OS_Error_t
+OS_KeystoreAsync_loadKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    void*                       keyData,
+    size_t                      keySize,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx);
+
+/**
+ * Queues a request to delete a key, see OS_Keystore_deleteKey().
+ *
+ * @retval OS_SUCCESS                   The request was queued.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   request or name is NULL.
+ *
+ * @param[in] hAsync    Handle of the context.
+ * @param[in] request   Request to be set up and queued.
+ * @param[in] name      Name of the key.
+ * @param[in] onDone    Completion callback, may be NULL.
+ * @param[in] ctx       Passed to the callback.
+ */
+OS_Error_t
+OS_KeystoreAsync_deleteKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx);
+
+/**
+ * Returns whether a request is done, i.e. its result is available and its
+ * completion callback has returned. The request may be reused right away.
+ *
+ * @param[in] request   A request that has been queued.
+ */
+bool
+OS_KeystoreAsync_isDone(
+    OS_KeystoreAsync_Request_t const*   request);
+
+/**
+ * Executes queued requests, to be called by the worker. The completion
+ * callbacks are called from here.
+ *
+ * Several workers may call this function at the same time if the keystore has
+ * a lock, see OS_Keystore_setLock().
+ *
+ * @retval OS_SUCCESS                   Operation was successful, the results
+ *                                      of the requests are reported in the
+ *                                      requests.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ *
+ * @param[in]  hAsync           Handle of the context.
+ * @param[in]  maxRequests      Maximum number of requests to execute, 0 to
+ *                              execute requests until the queue is empty.
+ * @param[out] numProcessed     Receives the number of executed requests, may
+ *                              be NULL.
+ */
+OS_Error_t
+OS_KeystoreAsync_process(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    size_t                      maxRequests,
+    size_t*                     numProcessed);
@@ -0,0 +1,723 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Extensions of the OS_Keystore API.
+ *
+ * The functions declared here complement the ones of OS_Keystore.h and are
+ * available for every OS_Keystore implementation. Implementations that do not
+ * provide a specialized version get a default one which is built on top of
+ * the basic functions.
+ */
+
+#pragma once
+
+#include "OS_Keystore.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Describes one key of a batch operation.
+ */
+typedef struct
+{
+    //! Name of the key.
+    const char* name;
+    /**
+     * Key data. The data is read by OS_Keystore_storeKeys() and written by
+     * OS_Keystore_loadKeys(), it is not used by OS_Keystore_deleteKeys().
+     */
+    void*       keyData;
+    /**
+     * Size of the key data. For OS_Keystore_loadKeys() this is the size of
+     * the buffer on input and the size of the loaded key on output.
+     */
+    size_t      keySize;
+    //! Result of the operation for this key.
+    OS_Error_t  result;
+}
+OS_Keystore_KeyItem_t;
+
+/**
+ * Position of an enumeration with OS_Keystore_listKeys(). A cursor has to be
+ * initialized with OS_Keystore_ListCursor_INIT before the first call.
+ */
+typedef struct
+{
+    //! Implementation specific position, do not modify.
+    size_t  pos;
+}
+OS_Keystore_ListCursor_t;
+
+//! Initializer of an OS_Keystore_ListCursor_t that starts at the first key.
+#define OS_Keystore_ListCursor_INIT     { .pos = 0 }
+
+/**
+ * Key borrowed with OS_Keystore_borrowKey(), to be returned with
+ * OS_Keystore_releaseKey().
+ */
+typedef struct
+{
+    //! Key data, must not be modified. Valid until the key is released.
+    void const* keyData;
+    //! Size of the key data.
+    size_t      keySize;
+    /**
+     * Set if keyData points into the memory of the keystore, otherwise the
+     * key was copied into the buffer of the caller.
+     */
+    bool        isLent;
+    //! Implementation specific, do not modify.
+    void*       ref;
+}
+OS_Keystore_Lease_t;
+
+/**
+ * Key stored or loaded piece by piece, see OS_Keystore_beginStoreKey() and
+ * OS_Keystore_beginLoadKey().
+ */
+typedef struct
+{
+    //! Size of the key data.
+    size_t  keySize;
+    //! Number of bytes written or read so far.
+    size_t  pos;
+    //! Set for a store, cleared for a load.
+    bool    isStore;
+    //! Implementation specific, do not modify.
+    void*   ctx;
+}
+OS_Keystore_Stream_t;
+
+/**
+ * Reader/writer lock used to share a keystore handle between threads, see
+ * OS_Keystore_setLock(). The callbacks are provided by the caller, e.g. on top
+ * of the mutexes or semaphores of the component.
+ *
+ * Several readers may hold the lock at the same time, a writer holds it
+ * exclusively. The lock does not need to be recursive.
+ *
+ * Implementations with lock-free reads may have a writer wait for the readers
+ * without taking the lock. After a short spin, the writer calls yield to let
+ * a preempted reader finish. Readers that run in parallel call it the same way
+ * while they wait for each other on a spin lock of the implementation. With
+ * fixed-priority scheduling, yield must let a thread of lower priority run,
+ * e.g. by a short sleep, otherwise the waiting thread may wait forever.
+ */
+typedef struct
+{
+    void    (*lockRead)(void* ctx);
+    void    (*unlockRead)(void* ctx);
+    void    (*lockWrite)(void* ctx);
+    void    (*unlockWrite)(void* ctx);
+    //! Passed to the callbacks.
+    void*   ctx;
+    //! Optional, gives up the CPU while a thread waits for others.
+    void    (*yield)(void* ctx);
+}
+OS_Keystore_RwLock_t;
+
+/**
+ * Operations the statistics are kept for, see OS_Keystore_getStats().
+ */
+typedef enum
+{
+    /**
+     * Work done outside of the functions below, e.g. when the keystore is
+     * created or by maintenance functions of an implementation. Only the I/O
+     * counters are used.
+     */
+    OS_Keystore_OP_OTHER,
+    OS_Keystore_OP_STORE_KEY,
+    OS_Keystore_OP_LOAD_KEY,
+    OS_Keystore_OP_DELETE_KEY,
+    OS_Keystore_OP_COPY_KEY,
+    OS_Keystore_OP_MOVE_KEY,
+    OS_Keystore_OP_WIPE_KEYSTORE,
+    OS_Keystore_OP_STORE_KEYS,
+    OS_Keystore_OP_LOAD_KEYS,
+    OS_Keystore_OP_DELETE_KEYS,
+    OS_Keystore_OP_LIST_KEYS,
+    OS_Keystore_OP_GET_KEY_INFO,
+    OS_Keystore_OP_BORROW_KEY,
+    //! Every call on a stream of OS_Keystore_beginStoreKey().
+    OS_Keystore_OP_STORE_STREAM,
+    //! Every call on a stream of OS_Keystore_beginLoadKey().
+    OS_Keystore_OP_LOAD_STREAM,
+    OS_Keystore_OP_NUM
+}
+OS_Keystore_Op_t;
+
+/**
+ * Number of buckets of the latency histograms. Bucket 0 counts the operations
+ * that took less than 1 microsecond, bucket i > 0 the ones that took at least
+ * 2^(i-1) and less than 2^i microseconds. The last bucket also counts all
+ * longer operations.
+ */
+#define OS_Keystore_Stats_LATENCY_BUCKETS   24
+
+/**
+ * Statistics of one operation.
+ */
+typedef struct
+{
+    //! Number of calls.
+    uint64_t    calls;
+    //! Number of calls that returned OS_ERROR_NOT_FOUND.
+    uint64_t    notFound;
+    //! Number of calls that failed with any other error.
+    uint64_t    errors;
+    //! Latency histogram, only filled if a clock is set.
+    uint64_t    latency[OS_Keystore_Stats_LATENCY_BUCKETS];
+    // FileSystem and Crypto calls of the implementation for the operation.
+    uint64_t    fsOpens;
+    uint64_t    fsCloses;
+    uint64_t    fsReads;
+    uint64_t    fsWrites;
+    uint64_t    fsDeletes;
+    uint64_t    fsGetSizes;
+    uint64_t    fsBytesRead;
+    uint64_t    fsBytesWritten;
+    uint64_t    digestCalls;
+}
+OS_Keystore_OpStats_t;
+
+/**
+ * Statistics of a keystore, see OS_Keystore_getStats().
+ */
+typedef struct
+{
+    OS_Keystore_OpStats_t   ops[OS_Keystore_OP_NUM];
+    //! Number of keys whose data did not match their hash when read.
+    uint64_t                hashMismatches;
+    //! Counters of a RAM cache of the key data, if the implementation has one.
+    uint64_t                cacheHits;
+    uint64_t                cacheMisses;
+    uint64_t                cacheEvictions;
+}
+OS_Keystore_Stats_t;
+
+/**
+ * Clock used to measure the latency of the operations, see
+ * OS_Keystore_setClock().
+ */
+typedef struct
+{
+    //! Returns a monotonic time in nanoseconds.
+    uint64_t    (*getTimeNs)(void* ctx);
+    //! Passed to the callback.
+    void*       ctx;
+}
+OS_Keystore_Clock_t;
+
+/**
+ * Phase of a call a trace event is emitted for, see OS_Keystore_setTraceHook().
+ */
+typedef enum
+{
+    OS_Keystore_TRACE_BEGIN,
+    OS_Keystore_TRACE_END
+}
+OS_Keystore_TracePhase_t;
+
+/**
+ * Trace event emitted at the begin and at the end of every call of the API.
+ * The layout does not depend on the platform, so buffers of events can be
+ * exported on another machine.
+ */
+typedef struct
+{
+    //! Time of the clock set with OS_Keystore_setClock(), 0 without a clock.
+    uint64_t    timestampNs;
+    //! Address of the keystore, identifies it within the trace.
+    uint64_t    keystore;
+    //! Number of the call on the keystore, the same for begin and end.
+    uint32_t    callId;
+    //! FNV-1a hash of the key name, 0 for calls without a name.
+    uint32_t    nameHash;
+    /**
+     * Key size for storeKey(), the size of the loaded key at the end of
+     * loadKey(), the number of items for the batch functions, the key size
+     * for the begin of a stream and the chunk size for its chunks, 0
+     * otherwise.
+     */
+    uint32_t    size;
+    //! Result of the call, OS_SUCCESS at the begin.
+    int32_t     result;
+    //! An OS_Keystore_Op_t.
+    uint8_t     op;
+    //! An OS_Keystore_TracePhase_t.
+    uint8_t     phase;
+    uint8_t     reserved[6];
+}
+OS_Keystore_TraceEvent_t;
+
+/**
+ * Hook receiving the trace events of a keystore, see
+ * OS_Keystore_setTraceHook().
+ */
+typedef struct
+{
+    /**
+     * Called for every event, without holding the lock of the keystore. It
+     * may be called by several threads at the same time if the handle is
+     * shared.
+     */
+    void    (*onEvent)(void* ctx, OS_Keystore_TraceEvent_t const* event);
+    //! Passed to the callback.
+    void*   ctx;
+}
+OS_Keystore_TraceHook_t;
+
+
+/**
+ * Stores several keys, see OS_Keystore_storeKey().
+ *
+ * Every key is handled on its own, i.e. a key that cannot be stored does not
+ * prevent the others from being stored. The result of each key is put into
+ * its item.
+ *
+ * @retval OS_SUCCESS                   All keys were stored.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   items is NULL.
+ * @retval other                        The result of the first key that failed.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] items     Keys to be stored.
+ * @param[in]     numItems  Number of elements in items.
+ */
+OS_Error_t
+OS_Keystore_storeKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * Loads several keys, see OS_Keystore_loadKey().
+ *
+ * Every key is handled on its own, the result of each key is put into its
+ * item.
+ *
+ * @retval OS_SUCCESS                   All keys were loaded.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   items is NULL.
+ * @retval other                        The result of the first key that failed.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] items     Keys to be loaded.
+ * @param[in]     numItems  Number of elements in items.
+ */
+OS_Error_t
+OS_Keystore_loadKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * Deletes several keys, see OS_Keystore_deleteKey().
+ *
+ * Every key is handled on its own, the result of each key is put into its
+ * item.
+ *
+ * @retval OS_SUCCESS                   All keys were deleted.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   items is NULL.
+ * @retval other                        The result of the first key that failed.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] items     Keys to be deleted, only the names are used.
+ * @param[in]     numItems  Number of elements in items.
+ */
+OS_Error_t
+OS_Keystore_deleteKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+/**
+ * Returns the name and size of the next key of an enumeration without copying
+ * the key data.
+ *
+ * The keys are returned in no particular order. If keys are stored or deleted
+ * during an enumeration, keys may be skipped or returned twice.
+ *
+ * @retval OS_SUCCESS                   The next key was returned.
+ * @retval OS_ERROR_NOT_FOUND           There are no more keys.
+ * @retval OS_ERROR_BUFFER_TOO_SMALL    The name does not fit into the buffer,
+ *                                      the cursor is not advanced.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the parameters are NULL.
+ * @retval OS_ERROR_NOT_SUPPORTED       The keystore cannot enumerate keys.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] cursor    Position of the enumeration.
+ * @param[out]    name      Receives the null terminated name of the key.
+ * @param[in]     nameSize  Size of the name buffer.
+ * @param[out]    keySize   Receives the size of the key data, may be NULL.
+ */
+OS_Error_t
+OS_Keystore_listKeys(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize);
+
+/**
+ * Checks whether a key exists and returns its size without copying the key
+ * data.
+ *
+ * @retval OS_SUCCESS                   The key exists.
+ * @retval OS_ERROR_NOT_FOUND           The key does not exist.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The name is NULL or invalid.
+ * @retval OS_ERROR_NOT_SUPPORTED       The keystore cannot provide the
+ *                                      information.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  name         Name of the key.
+ * @param[out] keySize      Receives the size of the key data, may be NULL.
+ */
+OS_Error_t
+OS_Keystore_getKeyInfo(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    size_t*                 keySize);
+
+/**
+ * Gives access to the data of a key without copying it, if the keystore holds
+ * the key in RAM, e.g. OS_KeystoreRamFV for keys held in a slab.
+ *
+ * The key is lent to the caller until it is returned with
+ * OS_Keystore_releaseKey(). While a key is lent, OS_Keystore_deleteKey() and
+ * OS_Keystore_moveKey() of the key as well as OS_Keystore_wipeKeystore() and
+ * OS_Keystore_free() fail with OS_ERROR_OPERATION_DENIED, so the data cannot
+ * change or go away. A key can be lent several times at the same time.
+ *
+ * If the keystore cannot lend the key, it is loaded into the buffer of the
+ * caller instead and lease->isLent is cleared. The key has to be released
+ * then as well, which zeroizes the buffer.
+ *
+ * @retval OS_SUCCESS                   The key was lent or copied.
+ * @retval OS_ERROR_NOT_FOUND           The key does not exist.
+ * @retval OS_ERROR_BUFFER_TOO_SMALL    The key has to be copied but does not
+ *                                      fit into the buffer.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The name is NULL or invalid or lease is
+ *                                      NULL.
+ * @retval OS_ERROR_NOT_SUPPORTED       The key has to be copied but buffer is
+ *                                      NULL.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  name         Name of the key.
+ * @param[out] buffer       Receives the key if it cannot be lent, may be NULL.
+ * @param[in]  bufferSize   Size of buffer.
+ * @param[out] lease        Receives the key.
+ */
+OS_Error_t
+OS_Keystore_borrowKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    void*                   buffer,
+    size_t                  bufferSize,
+    OS_Keystore_Lease_t*    lease);
+
+/**
+ * Returns a key borrowed with OS_Keystore_borrowKey(). The key data must not
+ * be used anymore afterwards; if it was copied, the buffer is zeroized.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   lease is NULL or holds no key.
+ *
+ * @param[in]     hKeystore Handle of the keystore the key was borrowed from.
+ * @param[in,out] lease     The key, it is cleared.
+ */
+OS_Error_t
+OS_Keystore_releaseKey(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Lease_t*    lease);
+
+/**
+ * Starts to store a key whose data is passed piece by piece with
+ * OS_Keystore_writeKeyChunk(), so a large key does not have to be held in a
+ * single buffer. The key becomes part of the keystore with
+ * OS_Keystore_commitKey(), OS_Keystore_closeStream() drops it. The integrity
+ * hash of the key is computed incrementally as the data is written.
+ *
+ * Keystores that cannot store a key piece by piece collect the data in RAM and
+ * store it with OS_Keystore_storeKey() when it is committed, so their limits
+ * for the key size still apply.
+ *
+ * The lock of the keystore, see OS_Keystore_setLock(), is taken by every call
+ * on the stream but not held in between.
+ *
+ * @retval OS_SUCCESS                   The stream was started.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The name is NULL or invalid, a key with
+ *                                      the name exists, keySize is 0 or too
+ *                                      large, or stream is NULL.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate the state of the
+ *                                      stream.
+ * @retval other                        Error of the underlying storage.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  name         Name of the key.
+ * @param[in]  keySize      Size of the key data.
+ * @param[out] stream       Receives the state of the stream.
+ */
+OS_Error_t
+OS_Keystore_beginStoreKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    size_t                  keySize,
+    OS_Keystore_Stream_t*   stream);
+
+/**
+ * Appends data to a key started with OS_Keystore_beginStoreKey().
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The stream is not a store or data is
+ *                                      NULL.
+ * @retval OS_ERROR_OUT_OF_BOUNDS       The data exceeds the size of the key.
+ * @retval other                        Error of the underlying storage, the
+ *                                      stream has to be closed.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] stream    The stream.
+ * @param[in]     data      Next piece of the key data.
+ * @param[in]     len       Size of data.
+ */
+OS_Error_t
+OS_Keystore_writeKeyChunk(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len);
+
+/**
+ * Adds a key whose data has been written completely to the keystore and ends
+ * the stream. The stream is ended even if the key cannot be added.
+ *
+ * @retval OS_SUCCESS                   The key was stored.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The stream is not a store.
+ * @retval OS_ERROR_INVALID_STATE       Not all data of the key was written,
+ *                                      the key is dropped.
+ * @retval other                        Error of the underlying storage.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] stream    The stream, it is cleared.
+ */
+OS_Error_t
+OS_Keystore_commitKey(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream);
+
+/**
+ * Starts to load a key piece by piece with OS_Keystore_readKeyChunk(), so a
+ * large key does not have to be held in a single buffer. The stream has to be
+ * ended with OS_Keystore_closeStream().
+ *
+ * Keystores that cannot load a key piece by piece load it into RAM at once.
+ *
+ * @retval OS_SUCCESS                   The stream was started, the size of
+ *                                      the key is in stream->keySize.
+ * @retval OS_ERROR_NOT_FOUND           The key does not exist.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The name is NULL or invalid or stream
+ *                                      is NULL.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate the state of the
+ *                                      stream.
+ * @retval other                        Error of the underlying storage.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  name         Name of the key.
+ * @param[out] stream       Receives the state of the stream.
+ */
+OS_Error_t
+OS_Keystore_beginLoadKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+/**
+ * Reads the next piece of a key started with OS_Keystore_beginLoadKey().
+ *
+ * The integrity hash of the key is computed as the data is read and checked
+ * with the last piece. The data must therefore not be used before the call
+ * that returns the last piece has succeeded.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_GENERIC             The key data does not match its hash.
+ * @retval OS_ERROR_NOT_FOUND           The key was deleted or replaced in the
+ *                                      meantime.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The stream is not a load or some of the
+ *                                      parameters are NULL.
+ * @retval other                        Error of the underlying storage, the
+ *                                      stream has to be closed.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] stream    The stream.
+ * @param[out]    buffer    Receives the data.
+ * @param[in]     len       Size of buffer.
+ * @param[out]    read      Receives the number of bytes read, 0 once all of
+ *                          the key has been read.
+ */
+OS_Error_t
+OS_Keystore_readKeyChunk(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len,
+    size_t*                 read);
+
+/**
+ * Ends a stream. A key that is stored and has not been committed is dropped.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   stream is NULL or not open.
+ *
+ * @param[in]     hKeystore Handle of the keystore.
+ * @param[in,out] stream    The stream, it is cleared.
+ */
+OS_Error_t
+OS_Keystore_closeStream(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream);
+
+/**
+ * Sets the lock that serializes the access to a keystore, so the handle can be
+ * used from several threads at the same time.
+ *
+ * Every function of the OS_Keystore API then holds the lock while it runs.
+ * OS_Keystore_loadKey(), OS_Keystore_loadKeys(), OS_Keystore_listKeys(),
+ * OS_Keystore_getKeyInfo(), OS_Keystore_borrowKey(),
+ * OS_Keystore_releaseKey() and the calls on a stream of
+ * OS_Keystore_beginLoadKey() take it as readers if the implementation supports
+ * concurrent reads, otherwise every function takes it as writer. Some
+ * implementations synchronize their reads with the writers on their own, they
+ * take the lock only where needed.
+ * OS_Keystore_copyKey() and OS_Keystore_moveKey() take the locks of both
+ * keystores as writer.
+ *
+ * The lock must be set before the handle is shared and must not be changed
+ * while it is in use. OS_Keystore_free() does not take the lock, the caller
+ * has to make sure no other thread uses the handle anymore.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the callbacks are NULL, only
+ *                                      yield is optional.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  lock         Lock to be used, it is copied. NULL removes the
+ *                          lock.
+ */
+OS_Error_t
+OS_Keystore_setLock(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_Keystore_RwLock_t const*     lock);
+
+/**
+ * Returns the statistics of a keystore, which allow to tell where the time of
+ * slow key accesses goes.
+ *
+ * The statistics are only kept if the keystore is built with OS_KEYSTORE_STATS
+ * defined, otherwise the counters are compiled out. They are updated with
+ * relaxed atomic operations, so counters read while other threads use the
+ * keystore may be slightly inconsistent with each other.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   stats is NULL.
+ * @retval OS_ERROR_NOT_SUPPORTED       The statistics are not compiled in.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[out] stats        Receives the statistics.
+ */
+OS_Error_t
+OS_Keystore_getStats(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stats_t*    stats);
+
+/**
+ * Sets all counters of OS_Keystore_getStats() to zero, except the ones of a
+ * cache of the implementation.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_NOT_SUPPORTED       The statistics are not compiled in.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ */
+OS_Error_t
+OS_Keystore_resetStats(
+    OS_Keystore_Handle_t    hKeystore);
+
+/**
+ * Sets the clock used for the latency histograms of OS_Keystore_getStats()
+ * and the timestamps of the trace events. Without a clock, the latencies are
+ * not measured and the timestamps are 0.
+ *
+ * The clock must be set before the handle is shared, like the lock.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The callback is NULL.
+ * @retval OS_ERROR_NOT_SUPPORTED       Neither the statistics nor the trace
+ *                                      hook are compiled in.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  clock        Clock to be used, it is copied. NULL removes the
+ *                          clock.
+ */
+OS_Error_t
+OS_Keystore_setClock(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_Keystore_Clock_t const*  clock);
+
+/**
+ * Sets a hook that receives a trace event at the begin and at the end of
+ * every call of the API on the keystore, e.g. OS_KeystoreTrace_getHook(). The
+ * events of a call carry the same callId; the begin is emitted before the
+ * lock of the keystore is taken, so the time spent waiting for it is part of
+ * the call.
+ *
+ * The hook is only available if the keystore is built with OS_KEYSTORE_TRACE
+ * defined. In addition, OS_KEYSTORE_TRACE_HOOK can be defined to the name of
+ * a function
+ *
+ *     void hook(OS_Keystore_TraceEvent_t const* event);
+ *
+ * that receives the events of all keystores without being registered. Without
+ * both, the events are compiled out.
+ *
+ * The hook must be set before the handle is shared, like the lock.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The keystore handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   The callback is NULL.
+ * @retval OS_ERROR_NOT_SUPPORTED       The trace hook is not compiled in.
+ *
+ * @param[in]  hKeystore    Handle of the keystore.
+ * @param[in]  hook         Hook to be used, it is copied. NULL removes the
+ *                          hook.
+ */
+OS_Error_t
+OS_Keystore_setTraceHook(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_Keystore_TraceHook_t const*  hook);
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Ring buffer for the trace events of keystores and its export.
+ *
+ * An OS_KeystoreTrace instance keeps the last events passed to it, see
+ * OS_Keystore_setTraceHook(). Writing an event takes no lock, so it can be
+ * done by any number of threads and does not serialize the keystores that
+ * share the buffer. When the buffer is full, the oldest events are
+ * overwritten. A writer that is overtaken by another one while it writes an
+ * event, i.e. if more events are written meanwhile than the buffer holds,
+ * loses its event, as does the writer that finds the slot still in use. Such
+ * events are counted as lost by the readers.
+ *
+ * The events can be drained with OS_KeystoreTrace_read() or written as a
+ * trace in the JSON format of the Chrome trace viewer, which is also read by
+ * Perfetto, to line them up with the traces of the rest of the system.
+ */
+
+#pragma once
+
+#include "OS_Keystore.h"
+#include "OS_KeystoreExt.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct OS_KeystoreTrace OS_KeystoreTrace_t;
+typedef OS_KeystoreTrace_t* OS_KeystoreTrace_Handle_t;
+
+/**
+ * Receives the output of OS_KeystoreTrace_exportChrome() piece by piece,
+ * e.g. to write it to a file or to send it to a host.
+ */
+typedef struct
+{
+    //! Writes len bytes of data, the export stops if it fails.
+    OS_Error_t  (*write)(void* ctx, const char* data, size_t len);
+    //! Passed to the callback.
+    void*       ctx;
+}
+OS_KeystoreTrace_Writer_t;
+
+
+/**
+ * Allocates space for a new OS_KeystoreTrace_t context and initialises it.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
+ *                                      OS_KeystoreTrace_t context.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason.
+ *
+ * @param[out] pHandle      Pointer to the variable of the caller supposed to
+ *                          hold the OS_KeystoreTrace_Handle_t return value.
+ * @param[in]  numEvents    Number of events the buffer holds, a power of two
+ *                          of at least 2.
+ */
+OS_Error_t
+OS_KeystoreTrace_init(
+    OS_KeystoreTrace_Handle_t*  pHandle,
+    size_t                      numEvents);
+
+/**
+ * Frees the context. The hooks of the keystores referring to it must have
+ * been removed.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ *
+ * @param[in] hTrace    Handle of the context.
+ */
+OS_Error_t
+OS_KeystoreTrace_free(
+    OS_KeystoreTrace_Handle_t   hTrace);
+
+/**
+ * Returns the hook that writes the events of a keystore into the buffer, to
+ * be passed to OS_Keystore_setTraceHook().
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   hook is NULL.
+ *
+ * @param[in]  hTrace   Handle of the context.
+ * @param[out] hook     Receives the hook.
+ */
+OS_Error_t
+OS_KeystoreTrace_getHook(
+    OS_KeystoreTrace_Handle_t   hTrace,
+    OS_Keystore_TraceHook_t*    hook);
+
+/**
+ * Writes an event into the buffer, overwriting the oldest one if it is full.
+ * This is what the hook of OS_KeystoreTrace_getHook() does; it can also be
+ * called by the function OS_KEYSTORE_TRACE_HOOK is defined to.
+ *
+ * @param[in] hTrace    Handle of the context.
+ * @param[in] event     The event.
+ */
+void
+OS_KeystoreTrace_put(
+    OS_KeystoreTrace_Handle_t       hTrace,
+    OS_Keystore_TraceEvent_t const* event);
+
+/**
+ * Reads the events following a position of the buffer, in the order they were
+ * written. A cursor of 0 starts with the oldest event the buffer still holds.
+ * Events that were overwritten before they could be read are counted as lost.
+ *
+ * Only one thread may read with the same cursor at a time. Reading does not
+ * remove the events, so several readers can use their own cursors.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason.
+ *
+ * @param[in]     hTrace    Handle of the context.
+ * @param[in,out] cursor    Position to start at, set to the position after
+ *                          the last returned event.
+ * @param[out]    events    Receives the events.
+ * @param[in]     maxEvents Capacity of events.
+ * @param[out]    numEvents Receives the number of returned events, 0 if
+ *                          there are no new events.
+ * @param[out]    numLost   Receives the number of skipped events, may be
+ *                          NULL.
+ */
+OS_Error_t
+OS_KeystoreTrace_read(
+    OS_KeystoreTrace_Handle_t   hTrace,
+    uint64_t*                   cursor,
+    OS_Keystore_TraceEvent_t*   events,
+    size_t                      maxEvents,
+    size_t*                     numEvents,
+    uint64_t*                   numLost);
+
+/**
+ * Writes the events the buffer holds as a trace in the JSON format of the
+ * Chrome trace viewer. Every call of the API becomes an asynchronous slice
+ * named after the function, its arguments are the keystore, the hash of the
+ * key name, the size and the result. The timestamps are those of the clock of
+ * the keystores, see OS_Keystore_setClock().
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle is invalid.
+ * @retval OS_ERROR_INVALID_PARAMETER   writer is NULL or has no callback.
+ * @retval other                        The error of the writer.
+ *
+ * @param[in]  hTrace   Handle of the context.
+ * @param[in]  writer   Receives the output.
+ * @param[out] numLost  Receives the number of events that were overwritten
+ *                      during the export, may be NULL.
+ */
+OS_Error_t
+OS_KeystoreTrace_exportChrome(
+    OS_KeystoreTrace_Handle_t           hTrace,
+    OS_KeystoreTrace_Writer_t const*    writer,
+    uint64_t*                           numLost);
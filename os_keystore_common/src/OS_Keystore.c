@@ -19,84 +19,1352 @@
 #include "OS_Keystore.int.h"
 #include "lib_debug/Debug.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+// Number of times OS_Keystore_spinLock() tries to get the lock before it
+// yields.
+#define MAX_SPINS 64
+
+// Private functions -----------------------------------------------------------
+
+#if defined(OS_KEYSTORE_HAS_CLOCK)
+
+static uint64_t
+getTime(
+    OS_Keystore_t*  self)
+{
+    return (NULL == self->clock.getTimeNs) ?
+           0 : self->clock.getTimeNs(self->clock.ctx);
+}
+
+#endif /* OS_KEYSTORE_HAS_CLOCK */
+
+#if defined(OS_KEYSTORE_STATS)
+
+#define STATS_ADD(counter, n) \
+    atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+
+#define STATS_GET(counter) \
+    atomic_load_explicit(&(counter), memory_order_relaxed)
+
+#define STATS_CLEAR(counter) \
+    atomic_store_explicit(&(counter), 0, memory_order_relaxed)
+
+static void
+stats_setOp(
+    OS_Keystore_t*      self,
+    OS_Keystore_Op_t    op)
+{
+    atomic_store_explicit(&self->stats.op, (int) op, memory_order_relaxed);
+}
+
+static uint64_t
+stats_begin(
+    OS_Keystore_t*      self,
+    OS_Keystore_Op_t    op)
+{
+    stats_setOp(self, op);
+
+    return getTime(self);
+}
+
+static void
+stats_end(
+    OS_Keystore_t*      self,
+    OS_Keystore_Op_t    op,
+    uint64_t            start,
+    OS_Error_t          err)
+{
+    OS_Keystore_OpCounters_t* counters = &self->stats.ops[op];
+
+    STATS_ADD(counters->calls, 1);
+    if (OS_ERROR_NOT_FOUND == err)
+    {
+        STATS_ADD(counters->notFound, 1);
+    }
+    else if (err != OS_SUCCESS)
+    {
+        STATS_ADD(counters->errors, 1);
+    }
+
+    if (NULL != self->clock.getTimeNs)
+    {
+        uint64_t us = (getTime(self) - start) / 1000;
+        unsigned int bucket = 0;
+
+        // Bucket i > 0 holds the latencies in [2^(i-1), 2^i) microseconds.
+        while ((us > 0) && (bucket < OS_Keystore_Stats_LATENCY_BUCKETS - 1))
+        {
+            us >>= 1;
+            bucket++;
+        }
+        STATS_ADD(counters->latency[bucket], 1);
+    }
+
+    stats_setOp(self, OS_Keystore_OP_OTHER);
+}
+
+// Used by the API functions while they hold the lock of the keystore.
+#define STATS_BEGIN(self, op) \
+    uint64_t statsStart = stats_begin((self), (op))
+
+#define STATS_END(self, op, err) \
+    stats_end((self), (op), statsStart, (err))
+
+// Accounts the I/O of the destination keystore of a copy or move to it.
+#define STATS_SET_OP(self, op) \
+    stats_setOp((self), (op))
+
+#else /* OS_KEYSTORE_STATS */
+
+#define STATS_BEGIN(self, op)       do { } while (0)
+#define STATS_END(self, op, err)    do { } while (0)
+#define STATS_SET_OP(self, op)      do { } while (0)
+
+#endif /* OS_KEYSTORE_STATS */
+
+#if defined(OS_KEYSTORE_TRACE_HOOK)
+
+// Receives the events of all keystores, see OS_Keystore_setTraceHook().
+void
+OS_KEYSTORE_TRACE_HOOK(
+    OS_Keystore_TraceEvent_t const* event);
+
+#endif /* OS_KEYSTORE_TRACE_HOOK */
+
+#if defined(OS_KEYSTORE_HAS_TRACE)
+
+typedef struct
+{
+    uint32_t    callId;
+    uint32_t    nameHash;
+}
+TraceCall_t;
+
+static bool
+trace_isEnabled(
+    OS_Keystore_t*  self)
+{
+#if defined(OS_KEYSTORE_TRACE_HOOK)
+    (void) self;
+    return true;
+#else
+    return (NULL != self->traceHook.onEvent);
+#endif
+}
+
+static void
+trace_emit(
+    OS_Keystore_t*              self,
+    OS_Keystore_Op_t            op,
+    OS_Keystore_TracePhase_t    phase,
+    TraceCall_t const*          call,
+    size_t                      size,
+    OS_Error_t                  result)
+{
+    OS_Keystore_TraceEvent_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.timestampNs = getTime(self);
+    event.keystore    = (uintptr_t) self;
+    event.callId      = call->callId;
+    event.nameHash    = call->nameHash;
+    event.size        = (uint32_t) size;
+    event.result      = result;
+    event.op          = (uint8_t) op;
+    event.phase       = (uint8_t) phase;
+
+#if defined(OS_KEYSTORE_TRACE)
+    if (NULL != self->traceHook.onEvent)
+    {
+        self->traceHook.onEvent(self->traceHook.ctx, &event);
+    }
+#endif
+#if defined(OS_KEYSTORE_TRACE_HOOK)
+    OS_KEYSTORE_TRACE_HOOK(&event);
+#endif
+}
+
+static TraceCall_t
+trace_begin(
+    OS_Keystore_t*      self,
+    OS_Keystore_Op_t    op,
+    const char*         name,
+    size_t              size)
+{
+    TraceCall_t call = { 0 };
+
+    if (trace_isEnabled(self))
+    {
+        call.callId = atomic_fetch_add_explicit(&self->traceCallId, 1,
+                                                memory_order_relaxed) + 1;
+        call.nameHash = (NULL == name) ?
+                        0 : OS_Keystore_hashName(name, strlen(name));
+        trace_emit(self, op, OS_Keystore_TRACE_BEGIN, &call, size, OS_SUCCESS);
+    }
+
+    return call;
+}
+
+static void
+trace_end(
+    OS_Keystore_t*      self,
+    OS_Keystore_Op_t    op,
+    TraceCall_t const*  call,
+    size_t              size,
+    OS_Error_t          err)
+{
+    if (trace_isEnabled(self))
+    {
+        trace_emit(self, op, OS_Keystore_TRACE_END, call, size, err);
+    }
+}
+
+// Used by the API functions outside of the lock, so waiting for it is part of
+// the traced call.
+#define TRACE_BEGIN(self, op, name, size) \
+    TraceCall_t traceCall = trace_begin((self), (op), (name), (size))
+
+#define TRACE_END(self, op, size, err) \
+    trace_end((self), (op), &traceCall, (size), (err))
+
+#else /* OS_KEYSTORE_HAS_TRACE */
+
+#define TRACE_BEGIN(self, op, name, size)   do { } while (0)
+#define TRACE_END(self, op, size, err)      do { } while (0)
+
+#endif /* OS_KEYSTORE_HAS_TRACE */
+
+static void
+lockRead(
+    OS_Keystore_t*  self)
+{
+    if ((NULL == self->lock.lockWrite) || self->vtable->hasLockFreeReads)
+    {
+        return;
+    }
+
+    if (self->vtable->hasConcurrentReads)
+    {
+        self->lock.lockRead(self->lock.ctx);
+    }
+    else
+    {
+        self->lock.lockWrite(self->lock.ctx);
+    }
+}
+
+static void
+unlockRead(
+    OS_Keystore_t*  self)
+{
+    if ((NULL == self->lock.lockWrite) || self->vtable->hasLockFreeReads)
+    {
+        return;
+    }
+
+    if (self->vtable->hasConcurrentReads)
+    {
+        self->lock.unlockRead(self->lock.ctx);
+    }
+    else
+    {
+        self->lock.unlockWrite(self->lock.ctx);
+    }
+}
+
+static void
+lockPair(
+    OS_Keystore_t*  self,
+    OS_Keystore_t*  other)
+{
+    // Always lock in the same order, so two threads copying keys in opposite
+    // directions cannot deadlock.
+    if (self == other)
+    {
+        OS_Keystore_lock(self);
+    }
+    else if ((uintptr_t) self < (uintptr_t) other)
+    {
+        OS_Keystore_lock(self);
+        OS_Keystore_lock(other);
+    }
+    else
+    {
+        OS_Keystore_lock(other);
+        OS_Keystore_lock(self);
+    }
+}
+
+static void
+unlockPair(
+    OS_Keystore_t*  self,
+    OS_Keystore_t*  other)
+{
+    OS_Keystore_unlock(self);
+
+    if (self != other)
+    {
+        OS_Keystore_unlock(other);
+    }
+}
+
+// Stream of a keystore without stream functions, the whole key is held in RAM.
+typedef struct
+{
+    // Name of the key, only used by stores
+    char*   name;
+    uint8_t data[];
+}
+BufferedStream;
+
+static OS_Error_t
+buffered_beginStore(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    size_t keySize;
+
+    if (NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Fail early instead of after all data has been collected.
+    if ((NULL != self->vtable->getKeyInfo)
+        && (self->vtable->getKeyInfo(self, name, &keySize) == OS_SUCCESS))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s already exists!",
+                        __func__, name);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    size_t nameSize = strlen(name) + 1;
+
+    if (stream->keySize > SIZE_MAX - sizeof(BufferedStream) - nameSize)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    BufferedStream* buffered = malloc(sizeof(BufferedStream) + stream->keySize
+                                      + nameSize);
+    if (NULL == buffered)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    buffered->name = (char*) &buffered->data[stream->keySize];
+    memcpy(buffered->name, name, nameSize);
+    stream->ctx = buffered;
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+buffered_beginLoad(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_Error_t err;
+    size_t keySize;
+
+    if (NULL == self->vtable->getKeyInfo)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    if ((err = self->vtable->getKeyInfo(self, name, &keySize)) != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    BufferedStream* buffered = malloc(sizeof(BufferedStream) + keySize);
+    if (NULL == buffered)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    buffered->name = NULL;
+
+    if ((err = self->vtable->loadKey(self, name, buffered->data, &keySize))
+        != OS_SUCCESS)
+    {
+        OS_Keystore_zeroize(buffered->data, keySize);
+        free(buffered);
+        return err;
+    }
+
+    stream->keySize = keySize;
+    stream->ctx     = buffered;
+
+    return OS_SUCCESS;
+}
+
+static void
+buffered_close(
+    OS_Keystore_Stream_t*   stream)
+{
+    BufferedStream* buffered = stream->ctx;
+
+    OS_Keystore_zeroize(buffered->data, stream->keySize);
+    free(buffered);
+}
+
+static OS_Error_t
+buffered_commit(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream)
+{
+    BufferedStream* buffered = stream->ctx;
+
+    OS_Error_t err = self->vtable->storeKey(self, buffered->name,
+                                            buffered->data, stream->keySize);
+    buffered_close(stream);
+
+    return err;
+}
+
+static OS_Error_t
+copyKeyChunked(
+    OS_Keystore_t*  srcPtr,
+    const char*     name,
+    OS_Keystore_t*  dstPtr,
+    void*           buffer,
+    size_t          bufferSize)
+{
+    OS_Error_t err;
+    OS_Keystore_Stream_t src;
+    OS_Keystore_Stream_t dst;
+
+    if ((err = OS_Keystore_beginLoadKeyImpl(srcPtr, name, &src)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: beginLoadKey failed with err %d!", __func__, err);
+        return err;
+    }
+
+    if ((err = OS_Keystore_beginStoreKeyImpl(dstPtr, name, src.keySize,
+                                             &dst)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: beginStoreKey failed with err %d!", __func__, err);
+        OS_Keystore_closeStreamImpl(srcPtr, &src);
+        return err;
+    }
+
+    while ((OS_SUCCESS == err) && (src.pos < src.keySize))
+    {
+        size_t len;
+
+        if ((err = OS_Keystore_readKeyChunkImpl(srcPtr, &src, buffer,
+                                                bufferSize, &len))
+            == OS_SUCCESS)
+        {
+            err = OS_Keystore_writeKeyChunkImpl(dstPtr, &dst, buffer, len);
+        }
+    }
+
+    // The source is verified with its last piece, so the key is only added to
+    // the destination once all of it has been read.
+    if (OS_SUCCESS == err)
+    {
+        err = OS_Keystore_commitKeyImpl(dstPtr, &dst);
+    }
+    else
+    {
+        Debug_LOG_ERROR("%s: Passing the key failed with err %d!",
+                        __func__, err);
+        OS_Keystore_closeStreamImpl(dstPtr, &dst);
+    }
+
+    OS_Keystore_closeStreamImpl(srcPtr, &src);
+
+    return err;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+OS_Keystore_free(
+    OS_Keystore_Handle_t hKeystore)
+{
+    return (NULL == hKeystore) ?
+           OS_ERROR_INVALID_HANDLE :
+           hKeystore->vtable->free(hKeystore);
+}
+
+OS_Error_t
+OS_Keystore_storeKey(
+    OS_Keystore_Handle_t hKeystore,
+    const char*          name,
+    void const*          keyData,
+    size_t               keySize)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_KEY, name, keySize);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_KEY);
+    OS_Error_t err = hKeystore->vtable->storeKey(hKeystore, name, keyData,
+                                                 keySize);
+    STATS_END(hKeystore, OS_Keystore_OP_STORE_KEY, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_STORE_KEY, keySize, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_loadKey(
+    OS_Keystore_Handle_t hKeystore,
+    const char*          name,
+    void*                keyData,
+    size_t*              keySize)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_LOAD_KEY, name, 0);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_LOAD_KEY);
+    OS_Error_t err = hKeystore->vtable->loadKey(hKeystore, name, keyData,
+                                                keySize);
+    STATS_END(hKeystore, OS_Keystore_OP_LOAD_KEY, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_LOAD_KEY,
+              ((OS_SUCCESS == err) && (NULL != keySize)) ? *keySize : 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_deleteKey(
+    OS_Keystore_Handle_t hKeystore,
+    const char*          name)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_DELETE_KEY, name, 0);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_DELETE_KEY);
+    OS_Error_t err = hKeystore->vtable->deleteKey(hKeystore, name);
+    STATS_END(hKeystore, OS_Keystore_OP_DELETE_KEY, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_DELETE_KEY, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_copyKey(
+    OS_Keystore_Handle_t hKeystore,
+    const char*          name,
+    OS_Keystore_Handle_t hDestKeystore)
+{
+    if (NULL == hKeystore || NULL == hDestKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_COPY_KEY, name, 0);
+    lockPair(hKeystore, hDestKeystore);
+    STATS_SET_OP(hDestKeystore, OS_Keystore_OP_COPY_KEY);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_COPY_KEY);
+    OS_Error_t err = hKeystore->vtable->copyKey(hKeystore, name, hDestKeystore);
+    STATS_END(hKeystore, OS_Keystore_OP_COPY_KEY, err);
+    STATS_SET_OP(hDestKeystore, OS_Keystore_OP_OTHER);
+    unlockPair(hKeystore, hDestKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_COPY_KEY, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_moveKey(
+    OS_Keystore_Handle_t hKeystore,
+    const char*          name,
+    OS_Keystore_Handle_t hDestKeystore)
+{
+    if (NULL == hKeystore || NULL == hDestKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_MOVE_KEY, name, 0);
+    lockPair(hKeystore, hDestKeystore);
+    STATS_SET_OP(hDestKeystore, OS_Keystore_OP_MOVE_KEY);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_MOVE_KEY);
+    OS_Error_t err = hKeystore->vtable->moveKey(hKeystore, name, hDestKeystore);
+    STATS_END(hKeystore, OS_Keystore_OP_MOVE_KEY, err);
+    STATS_SET_OP(hDestKeystore, OS_Keystore_OP_OTHER);
+    unlockPair(hKeystore, hDestKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_MOVE_KEY, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_wipeKeystore(
+    OS_Keystore_Handle_t hKeystore)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_WIPE_KEYSTORE, NULL, 0);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_WIPE_KEYSTORE);
+    OS_Error_t err = hKeystore->vtable->wipeKeystore(hKeystore);
+    STATS_END(hKeystore, OS_Keystore_OP_WIPE_KEYSTORE, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_WIPE_KEYSTORE, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_storeKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_KEYS, NULL, numItems);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_KEYS);
+    OS_Error_t err = (NULL == hKeystore->vtable->storeKeys) ?
+                     OS_Keystore_storeKeysImpl(hKeystore, items, numItems) :
+                     hKeystore->vtable->storeKeys(hKeystore, items, numItems);
+    STATS_END(hKeystore, OS_Keystore_OP_STORE_KEYS, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_STORE_KEYS, numItems, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_loadKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_LOAD_KEYS, NULL, numItems);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_LOAD_KEYS);
+    OS_Error_t err = (NULL == hKeystore->vtable->loadKeys) ?
+                     OS_Keystore_loadKeysImpl(hKeystore, items, numItems) :
+                     hKeystore->vtable->loadKeys(hKeystore, items, numItems);
+    STATS_END(hKeystore, OS_Keystore_OP_LOAD_KEYS, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_LOAD_KEYS, numItems, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_deleteKeys(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_DELETE_KEYS, NULL, numItems);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_DELETE_KEYS);
+    OS_Error_t err = (NULL == hKeystore->vtable->deleteKeys) ?
+                     OS_Keystore_deleteKeysImpl(hKeystore, items, numItems) :
+                     hKeystore->vtable->deleteKeys(hKeystore, items, numItems);
+    STATS_END(hKeystore, OS_Keystore_OP_DELETE_KEYS, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_DELETE_KEYS, numItems, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_listKeys(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == hKeystore->vtable->listKeys)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_LIST_KEYS, NULL, 0);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_LIST_KEYS);
+    OS_Error_t err = hKeystore->vtable->listKeys(hKeystore, cursor, name,
+                                                 nameSize, keySize);
+    STATS_END(hKeystore, OS_Keystore_OP_LIST_KEYS, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_LIST_KEYS, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_getKeyInfo(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    size_t*                 keySize)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == hKeystore->vtable->getKeyInfo)
+    {
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_GET_KEY_INFO, name, 0);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_GET_KEY_INFO);
+    OS_Error_t err = hKeystore->vtable->getKeyInfo(hKeystore, name, keySize);
+    STATS_END(hKeystore, OS_Keystore_OP_GET_KEY_INFO, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_GET_KEY_INFO,
+              ((OS_SUCCESS == err) && (NULL != keySize)) ? *keySize : 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_borrowKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    void*                   buffer,
+    size_t                  bufferSize,
+    OS_Keystore_Lease_t*    lease)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == lease)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(lease, 0, sizeof(*lease));
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_BORROW_KEY, name, 0);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_BORROW_KEY);
+
+    OS_Error_t err = OS_ERROR_NOT_SUPPORTED;
+
+    if (NULL != hKeystore->vtable->borrowKey)
+    {
+        err = hKeystore->vtable->borrowKey(hKeystore, name, lease);
+        lease->isLent = (OS_SUCCESS == err);
+    }
+
+    if ((OS_ERROR_NOT_SUPPORTED == err) && (NULL != buffer))
+    {
+        // The key cannot be lent, hand out a copy instead.
+        size_t keySize = bufferSize;
+
+        err = hKeystore->vtable->loadKey(hKeystore, name, buffer, &keySize);
+
+        if (OS_SUCCESS == err)
+        {
+            lease->keyData = buffer;
+            lease->keySize = keySize;
+        }
+    }
+
+    STATS_END(hKeystore, OS_Keystore_OP_BORROW_KEY, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_BORROW_KEY,
+              (OS_SUCCESS == err) ? lease->keySize : 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_releaseKey(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Lease_t*    lease)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == lease) || (NULL == lease->keyData))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = OS_SUCCESS;
+
+    if (lease->isLent)
+    {
+        lockRead(hKeystore);
+        err = hKeystore->vtable->releaseKey(hKeystore, lease);
+        unlockRead(hKeystore);
+    }
+    else
+    {
+        // Do not leave a copy of the key in the buffer of the caller.
+        OS_Keystore_zeroize((void*) lease->keyData, lease->keySize);
+    }
+
+    if (OS_SUCCESS == err)
+    {
+        memset(lease, 0, sizeof(*lease));
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_beginStoreKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    size_t                  keySize,
+    OS_Keystore_Stream_t*   stream)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == stream) || (0 == keySize))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM, name, keySize);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM);
+    OS_Error_t err = OS_Keystore_beginStoreKeyImpl(hKeystore, name, keySize,
+                                                   stream);
+    STATS_END(hKeystore, OS_Keystore_OP_STORE_STREAM, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_STORE_STREAM, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_writeKeyChunk(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == stream) || !stream->isStore || (NULL == stream->ctx)
+        || (NULL == data))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM, NULL, len);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM);
+    OS_Error_t err = OS_Keystore_writeKeyChunkImpl(hKeystore, stream, data,
+                                                   len);
+    STATS_END(hKeystore, OS_Keystore_OP_STORE_STREAM, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_STORE_STREAM, len, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_commitKey(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == stream) || !stream->isStore || (NULL == stream->ctx))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM, NULL, 0);
+    OS_Keystore_lock(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM);
+    OS_Error_t err = OS_Keystore_commitKeyImpl(hKeystore, stream);
+    STATS_END(hKeystore, OS_Keystore_OP_STORE_STREAM, err);
+    OS_Keystore_unlock(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_STORE_STREAM, 0, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_beginLoadKey(
+    OS_Keystore_Handle_t    hKeystore,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == stream)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM, name, 0);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM);
+    OS_Error_t err = OS_Keystore_beginLoadKeyImpl(hKeystore, name, stream);
+    STATS_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, stream->keySize, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_readKeyChunk(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len,
+    size_t*                 read)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == stream) || stream->isStore || (NULL == stream->ctx)
+        || (NULL == buffer) || (NULL == read))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    TRACE_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM, NULL, len);
+    lockRead(hKeystore);
+    STATS_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM);
+    OS_Error_t err = OS_Keystore_readKeyChunkImpl(hKeystore, stream, buffer,
+                                                  len, read);
+    STATS_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, err);
+    unlockRead(hKeystore);
+    TRACE_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, *read, err);
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_closeStream(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stream_t*   stream)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == stream) || (NULL == stream->ctx))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err;
+
+    if (stream->isStore)
+    {
+        TRACE_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM, NULL, 0);
+        OS_Keystore_lock(hKeystore);
+        STATS_BEGIN(hKeystore, OS_Keystore_OP_STORE_STREAM);
+        err = OS_Keystore_closeStreamImpl(hKeystore, stream);
+        STATS_END(hKeystore, OS_Keystore_OP_STORE_STREAM, err);
+        OS_Keystore_unlock(hKeystore);
+        TRACE_END(hKeystore, OS_Keystore_OP_STORE_STREAM, 0, err);
+    }
+    else
+    {
+        TRACE_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM, NULL, 0);
+        lockRead(hKeystore);
+        STATS_BEGIN(hKeystore, OS_Keystore_OP_LOAD_STREAM);
+        err = OS_Keystore_closeStreamImpl(hKeystore, stream);
+        STATS_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, err);
+        unlockRead(hKeystore);
+        TRACE_END(hKeystore, OS_Keystore_OP_LOAD_STREAM, 0, err);
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_setLock(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_Keystore_RwLock_t const*     lock)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == lock)
+    {
+        memset(&hKeystore->lock, 0, sizeof(hKeystore->lock));
+        return OS_SUCCESS;
+    }
+
+    if ((NULL == lock->lockRead) || (NULL == lock->unlockRead)
+        || (NULL == lock->lockWrite) || (NULL == lock->unlockWrite))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    hKeystore->lock = *lock;
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_Keystore_getStats(
+    OS_Keystore_Handle_t    hKeystore,
+    OS_Keystore_Stats_t*    stats)
+{
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == stats)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+#if defined(OS_KEYSTORE_STATS)
+    memset(stats, 0, sizeof(*stats));
+
+    for (size_t i = 0; i < OS_Keystore_OP_NUM; i++)
+    {
+        OS_Keystore_OpCounters_t* counters = &hKeystore->stats.ops[i];
+        OS_Keystore_OpStats_t* op = &stats->ops[i];
+
+        op->calls    = STATS_GET(counters->calls);
+        op->notFound = STATS_GET(counters->notFound);
+        op->errors   = STATS_GET(counters->errors);
+        for (size_t j = 0; j < OS_Keystore_Stats_LATENCY_BUCKETS; j++)
+        {
+            op->latency[j] = STATS_GET(counters->latency[j]);
+        }
+        op->fsOpens        = STATS_GET(counters->io[OS_Keystore_IO_FS_OPEN]);
+        op->fsCloses       = STATS_GET(counters->io[OS_Keystore_IO_FS_CLOSE]);
+        op->fsReads        = STATS_GET(counters->io[OS_Keystore_IO_FS_READ]);
+        op->fsWrites       = STATS_GET(counters->io[OS_Keystore_IO_FS_WRITE]);
+        op->fsDeletes      = STATS_GET(counters->io[OS_Keystore_IO_FS_DELETE]);
+        op->fsGetSizes     = STATS_GET(counters->io[OS_Keystore_IO_FS_GET_SIZE]);
+        op->fsBytesRead    = STATS_GET(counters->bytesRead);
+        op->fsBytesWritten = STATS_GET(counters->bytesWritten);
+        op->digestCalls    = STATS_GET(counters->io[OS_Keystore_IO_DIGEST]);
+    }
+    stats->hashMismatches = STATS_GET(hKeystore->stats.hashMismatches);
+
+    if (NULL == hKeystore->vtable->getStats)
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_Keystore_lock(hKeystore);
+    OS_Error_t err = hKeystore->vtable->getStats(hKeystore, stats);
+    OS_Keystore_unlock(hKeystore);
+
+    return err;
+#else
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
 OS_Error_t
-OS_Keystore_free(
-    OS_Keystore_Handle_t hKeystore)
+OS_Keystore_resetStats(
+    OS_Keystore_Handle_t    hKeystore)
 {
-    return (NULL == hKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->free(hKeystore);
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+#if defined(OS_KEYSTORE_STATS)
+    for (size_t i = 0; i < OS_Keystore_OP_NUM; i++)
+    {
+        OS_Keystore_OpCounters_t* counters = &hKeystore->stats.ops[i];
+
+        STATS_CLEAR(counters->calls);
+        STATS_CLEAR(counters->notFound);
+        STATS_CLEAR(counters->errors);
+        for (size_t j = 0; j < OS_Keystore_Stats_LATENCY_BUCKETS; j++)
+        {
+            STATS_CLEAR(counters->latency[j]);
+        }
+        for (size_t j = 0; j < OS_Keystore_IO_NUM; j++)
+        {
+            STATS_CLEAR(counters->io[j]);
+        }
+        STATS_CLEAR(counters->bytesRead);
+        STATS_CLEAR(counters->bytesWritten);
+    }
+    STATS_CLEAR(hKeystore->stats.hashMismatches);
+
+    return OS_SUCCESS;
+#else
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
 }
 
 OS_Error_t
-OS_Keystore_storeKey(
-    OS_Keystore_Handle_t hKeystore,
-    const char*          name,
-    void const*          keyData,
-    size_t               keySize)
+OS_Keystore_setClock(
+    OS_Keystore_Handle_t        hKeystore,
+    OS_Keystore_Clock_t const*  clock)
 {
-    return (NULL == hKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->storeKey(hKeystore, name, keyData, keySize);
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+#if defined(OS_KEYSTORE_HAS_CLOCK)
+    if (NULL == clock)
+    {
+        memset(&hKeystore->clock, 0, sizeof(hKeystore->clock));
+        return OS_SUCCESS;
+    }
+
+    if (NULL == clock->getTimeNs)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    hKeystore->clock = *clock;
+
+    return OS_SUCCESS;
+#else
+    (void) clock;
+
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
 }
 
 OS_Error_t
-OS_Keystore_loadKey(
-    OS_Keystore_Handle_t hKeystore,
-    const char*          name,
-    void*                keyData,
-    size_t*              keySize)
+OS_Keystore_setTraceHook(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_Keystore_TraceHook_t const*  hook)
 {
-    return (NULL == hKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->loadKey(hKeystore, name, keyData, keySize);
+    if (NULL == hKeystore)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+#if defined(OS_KEYSTORE_TRACE)
+    if (NULL == hook)
+    {
+        memset(&hKeystore->traceHook, 0, sizeof(hKeystore->traceHook));
+        return OS_SUCCESS;
+    }
+
+    if (NULL == hook->onEvent)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    hKeystore->traceHook = *hook;
+
+    return OS_SUCCESS;
+#else
+    (void) hook;
+
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
 }
 
-OS_Error_t
-OS_Keystore_deleteKey(
-    OS_Keystore_Handle_t hKeystore,
-    const char*          name)
+
+// Non virtual functions -------------------------------------------------------
+
+void
+OS_Keystore_lock(
+    OS_Keystore_t*  self)
 {
-    return (NULL == hKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->deleteKey(hKeystore, name);
+    if (NULL != self->lock.lockWrite)
+    {
+        self->lock.lockWrite(self->lock.ctx);
+    }
 }
 
-OS_Error_t
-OS_Keystore_copyKey(
-    OS_Keystore_Handle_t hKeystore,
-    const char*          name,
-    OS_Keystore_Handle_t hDestKeystore)
+void
+OS_Keystore_unlock(
+    OS_Keystore_t*  self)
 {
-    return (NULL == hKeystore || NULL == hDestKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->copyKey(hKeystore, name, hDestKeystore);
+    if (NULL != self->lock.unlockWrite)
+    {
+        self->lock.unlockWrite(self->lock.ctx);
+    }
 }
 
-OS_Error_t
-OS_Keystore_moveKey(
-    OS_Keystore_Handle_t hKeystore,
-    const char*          name,
-    OS_Keystore_Handle_t hDestKeystore)
+void
+OS_Keystore_lockShared(
+    OS_Keystore_t*  self)
 {
-    return (NULL == hKeystore || NULL == hDestKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->moveKey(hKeystore, name, hDestKeystore);
+    if (NULL != self->lock.lockRead)
+    {
+        self->lock.lockRead(self->lock.ctx);
+    }
 }
 
-OS_Error_t
-OS_Keystore_wipeKeystore(
-    OS_Keystore_Handle_t hKeystore)
+void
+OS_Keystore_unlockShared(
+    OS_Keystore_t*  self)
 {
-    return (NULL == hKeystore) ?
-           OS_ERROR_INVALID_HANDLE :
-           hKeystore->vtable->wipeKeystore(hKeystore);
+    if (NULL != self->lock.unlockRead)
+    {
+        self->lock.unlockRead(self->lock.ctx);
+    }
 }
 
+void
+OS_Keystore_yield(
+    OS_Keystore_t*  self)
+{
+    if (NULL != self->lock.yield)
+    {
+        self->lock.yield(self->lock.ctx);
+    }
+}
 
-// Non virtual functions -------------------------------------------------------
+void
+OS_Keystore_spinLock(
+    OS_Keystore_t*  self,
+    atomic_flag*    flag)
+{
+    for (unsigned int spins = 1;
+         atomic_flag_test_and_set_explicit(flag, memory_order_acquire);
+         spins++)
+    {
+        // The holder may have been preempted, then it needs the CPU to get
+        // done.
+        if (spins >= MAX_SPINS)
+        {
+            OS_Keystore_yield(self);
+            spins = 0;
+        }
+    }
+}
+
+void
+OS_Keystore_spinUnlock(
+    atomic_flag*    flag)
+{
+    atomic_flag_clear_explicit(flag, memory_order_release);
+}
+
+uint32_t
+OS_Keystore_hashName(
+    void const* name,
+    size_t      len)
+{
+    uint8_t const* p = name;
+    uint32_t hash = 2166136261u;
+
+    while (len--)
+    {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void
+OS_Keystore_zeroize(
+    void*   buf,
+    size_t  size)
+{
+    // Writing through a volatile pointer keeps the compiler from dropping the
+    // stores.
+    volatile uint8_t* p = buf;
+
+    while (size--)
+    {
+        *p++ = 0;
+    }
+}
+
+#if defined(OS_KEYSTORE_STATS)
+
+void
+OS_Keystore_countIo(
+    OS_Keystore_t*      self,
+    OS_Keystore_Io_t    io,
+    size_t              bytes)
+{
+    int op = atomic_load_explicit(&self->stats.op, memory_order_relaxed);
+    OS_Keystore_OpCounters_t* counters = &self->stats.ops[op];
+
+    STATS_ADD(counters->io[io], 1);
+    if (OS_Keystore_IO_FS_READ == io)
+    {
+        STATS_ADD(counters->bytesRead, bytes);
+    }
+    else if (OS_Keystore_IO_FS_WRITE == io)
+    {
+        STATS_ADD(counters->bytesWritten, bytes);
+    }
+}
+
+void
+OS_Keystore_countHashMismatch(
+    OS_Keystore_t*  self)
+{
+    STATS_ADD(self->stats.hashMismatches, 1);
+}
+
+#endif /* OS_KEYSTORE_STATS */
 
 OS_Error_t
 OS_Keystore_copyKeyImpl(
@@ -106,7 +1374,19 @@ OS_Keystore_copyKeyImpl(
     void*           keyBuffer,
     size_t          keyBufferSize)
 {
-    OS_Error_t err = OS_Keystore_loadKey(
+    size_t keySize;
+
+    // The callers hold the locks of both keystores already. A key that does
+    // not fit into the buffer is passed through it piece by piece.
+    if ((NULL != srcPtr->vtable->getKeyInfo)
+        && (keyBufferSize > 0)
+        && (srcPtr->vtable->getKeyInfo(srcPtr, name, &keySize) == OS_SUCCESS)
+        && (keySize > keyBufferSize))
+    {
+        return copyKeyChunked(srcPtr, name, dstPtr, keyBuffer, keyBufferSize);
+    }
+
+    OS_Error_t err = srcPtr->vtable->loadKey(
                          srcPtr,
                          name,
                          keyBuffer,
@@ -118,7 +1398,7 @@ OS_Keystore_copyKeyImpl(
         return err;
     }
 
-    err = OS_Keystore_storeKey(dstPtr, name, keyBuffer, keyBufferSize);
+    err = dstPtr->vtable->storeKey(dstPtr, name, keyBuffer, keyBufferSize);
 
     if (err != OS_SUCCESS)
     {
@@ -135,7 +1415,8 @@ OS_Keystore_moveKeyImpl(
     const char*     name,
     OS_Keystore_t*  dstPtr)
 {
-    OS_Error_t err = OS_Keystore_copyKey(srcPtr, name, dstPtr);
+    // The callers hold the locks of both keystores already.
+    OS_Error_t err = srcPtr->vtable->copyKey(srcPtr, name, dstPtr);
 
     if (err != OS_SUCCESS)
     {
@@ -143,13 +1424,272 @@ OS_Keystore_moveKeyImpl(
         return err;
     }
 
-    err = OS_Keystore_deleteKey(srcPtr, name);
+    err = srcPtr->vtable->deleteKey(srcPtr, name);
 
     if (err != OS_SUCCESS)
     {
         Debug_LOG_ERROR("%s: deleteKey failed with err %d!", __func__, err);
+        // A lent key is still in the source, see OS_Keystore_borrowKey(), so
+        // drop the copy. After other errors the source may have lost the key
+        // already, the copy is then the only one left.
+        if (OS_ERROR_OPERATION_DENIED == err)
+        {
+            dstPtr->vtable->deleteKey(dstPtr, name);
+        }
         return err;
     }
 
     return err;
 }
+
+OS_Error_t
+OS_Keystore_storeKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    if (NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        items[i].result = self->vtable->storeKey(
+                              self,
+                              items[i].name,
+                              items[i].keyData,
+                              items[i].keySize);
+
+        if ((OS_SUCCESS == err) && (items[i].result != OS_SUCCESS))
+        {
+            err = items[i].result;
+        }
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_loadKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    if (NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        items[i].result = self->vtable->loadKey(
+                              self,
+                              items[i].name,
+                              items[i].keyData,
+                              &items[i].keySize);
+
+        if ((OS_SUCCESS == err) && (items[i].result != OS_SUCCESS))
+        {
+            err = items[i].result;
+        }
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_deleteKeysImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    if (NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        items[i].result = self->vtable->deleteKey(self, items[i].name);
+
+        if ((OS_SUCCESS == err) && (items[i].result != OS_SUCCESS))
+        {
+            err = items[i].result;
+        }
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_beginStoreKeyImpl(
+    OS_Keystore_t*          self,
+    const char*             name,
+    size_t                  keySize,
+    OS_Keystore_Stream_t*   stream)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->keySize = keySize;
+    stream->isStore = true;
+
+    OS_Error_t err = (NULL == self->vtable->beginStoreKey) ?
+                     buffered_beginStore(self, name, stream) :
+                     self->vtable->beginStoreKey(self, name, stream);
+
+    if (err != OS_SUCCESS)
+    {
+        memset(stream, 0, sizeof(*stream));
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_writeKeyChunkImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    if (len > stream->keySize - stream->pos)
+    {
+        Debug_LOG_ERROR("%s: %zu bytes exceed the key size of %zu bytes!",
+                        __func__, stream->pos + len, stream->keySize);
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    if (0 == len)
+    {
+        return OS_SUCCESS;
+    }
+
+    if (NULL == self->vtable->writeKeyChunk)
+    {
+        memcpy(&((BufferedStream*) stream->ctx)->data[stream->pos], data, len);
+    }
+    else
+    {
+        err = self->vtable->writeKeyChunk(self, stream, data, len);
+    }
+
+    if (OS_SUCCESS == err)
+    {
+        stream->pos += len;
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_closeStreamImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    if (NULL == self->vtable->closeStream)
+    {
+        buffered_close(stream);
+    }
+    else
+    {
+        err = self->vtable->closeStream(self, stream);
+    }
+
+    memset(stream, 0, sizeof(*stream));
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_commitKeyImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_Error_t err;
+
+    if (stream->pos != stream->keySize)
+    {
+        Debug_LOG_ERROR("%s: Only %zu of %zu bytes were written!",
+                        __func__, stream->pos, stream->keySize);
+        OS_Keystore_closeStreamImpl(self, stream);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    err = (NULL == self->vtable->commitKey) ?
+          buffered_commit(self, stream) :
+          self->vtable->commitKey(self, stream);
+
+    memset(stream, 0, sizeof(*stream));
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_beginLoadKeyImpl(
+    OS_Keystore_t*          self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    memset(stream, 0, sizeof(*stream));
+
+    OS_Error_t err = (NULL == self->vtable->beginLoadKey) ?
+                     buffered_beginLoad(self, name, stream) :
+                     self->vtable->beginLoadKey(self, name, stream);
+
+    if (err != OS_SUCCESS)
+    {
+        memset(stream, 0, sizeof(*stream));
+    }
+
+    return err;
+}
+
+OS_Error_t
+OS_Keystore_readKeyChunkImpl(
+    OS_Keystore_t*          self,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len,
+    size_t*                 read)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    *read = 0;
+
+    if (len > stream->keySize - stream->pos)
+    {
+        len = stream->keySize - stream->pos;
+    }
+
+    if (0 == len)
+    {
+        return OS_SUCCESS;
+    }
+
+    if (NULL == self->vtable->readKeyChunk)
+    {
+        memcpy(buffer, &((BufferedStream*) stream->ctx)->data[stream->pos], len);
+    }
+    else
+    {
+        err = self->vtable->readKeyChunk(self, stream, buffer, len);
+    }
+
+    if (OS_SUCCESS == err)
+    {
+        stream->pos += len;
+        *read        = len;
+    }
+
+    return err;
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreAsync.h"
+#include "OS_KeystoreExt.h"
+
+#include "lib_debug/Debug.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+struct OS_KeystoreAsync
+{
+    OS_Keystore_Handle_t        hKeystore;
+    OS_KeystoreAsync_Sync_t     sync;
+    OS_KeystoreAsync_Request_t* head;
+    OS_KeystoreAsync_Request_t* tail;
+    //! Number of requests that are queued or being executed.
+    atomic_size_t               numPending;
+};
+
+
+// Private functions -----------------------------------------------------------
+
+static void
+lockQueue(
+    OS_KeystoreAsync_t* self)
+{
+    if (NULL != self->sync.lock)
+    {
+        self->sync.lock(self->sync.ctx);
+    }
+}
+
+static void
+unlockQueue(
+    OS_KeystoreAsync_t* self)
+{
+    if (NULL != self->sync.unlock)
+    {
+        self->sync.unlock(self->sync.ctx);
+    }
+}
+
+static OS_Error_t
+submit(
+    OS_KeystoreAsync_t*         self,
+    OS_KeystoreAsync_Request_t* request)
+{
+    request->result = OS_ERROR_IN_PROGRESS;
+    request->next   = NULL;
+    atomic_store(&request->isDone, false);
+    atomic_fetch_add(&self->numPending, 1);
+
+    lockQueue(self);
+    if (NULL == self->tail)
+    {
+        self->head = request;
+    }
+    else
+    {
+        self->tail->next = request;
+    }
+    self->tail = request;
+    unlockQueue(self);
+
+    if (NULL != self->sync.notify)
+    {
+        self->sync.notify(self->sync.ctx);
+    }
+
+    return OS_SUCCESS;
+}
+
+/*
+ * Takes up to maxRequests requests from the head of the queue, all of them of
+ * the same kind as the first one.
+ */
+static size_t
+takeBatch(
+    OS_KeystoreAsync_t*         self,
+    OS_KeystoreAsync_Request_t* batch[],
+    size_t                      maxRequests)
+{
+    size_t n = 0;
+
+    lockQueue(self);
+    while ((NULL != self->head)
+           && (n < maxRequests)
+           && ((0 == n) || (self->head->op == batch[0]->op)))
+    {
+        batch[n++] = self->head;
+        self->head = self->head->next;
+    }
+    if (NULL == self->head)
+    {
+        self->tail = NULL;
+    }
+    unlockQueue(self);
+
+    return n;
+}
+
+static void
+executeBatch(
+    OS_KeystoreAsync_t*         self,
+    OS_KeystoreAsync_Request_t* batch[],
+    size_t                      numRequests)
+{
+    OS_Keystore_KeyItem_t items[OS_KeystoreAsync_MAX_BATCH];
+
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        items[i].name    = batch[i]->name;
+        items[i].keyData = batch[i]->keyData;
+        items[i].keySize = batch[i]->keySize;
+        items[i].result  = OS_ERROR_GENERIC;
+    }
+
+    // The results are reported per item, the overall result is not needed.
+    switch (batch[0]->op)
+    {
+    case OS_KeystoreAsync_OP_STORE_KEY:
+        OS_Keystore_storeKeys(self->hKeystore, items, numRequests);
+        break;
+    case OS_KeystoreAsync_OP_LOAD_KEY:
+        OS_Keystore_loadKeys(self->hKeystore, items, numRequests);
+        break;
+    case OS_KeystoreAsync_OP_DELETE_KEY:
+        OS_Keystore_deleteKeys(self->hKeystore, items, numRequests);
+        break;
+    default:
+        Debug_LOG_ERROR("%s: Invalid request type %d!", __func__,
+                        batch[0]->op);
+        break;
+    }
+
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        OS_KeystoreAsync_Request_t* request = batch[i];
+
+        request->keySize = items[i].keySize;
+        request->result  = items[i].result;
+
+        if (NULL != request->onDone)
+        {
+            request->onDone(request, request->ctx);
+        }
+
+        // The request may be reused by the caller as soon as it is done, so
+        // it must not be accessed anymore afterwards.
+        atomic_store(&request->isDone, true);
+        atomic_fetch_sub(&self->numPending, 1);
+    }
+}
+
+
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+OS_KeystoreAsync_init(
+    OS_KeystoreAsync_Handle_t*      pHandle,
+    OS_Keystore_Handle_t            hKeystore,
+    OS_KeystoreAsync_Sync_t const*  sync)
+{
+    if ((NULL == pHandle) || (NULL == hKeystore))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((NULL != sync) && ((NULL == sync->lock) != (NULL == sync->unlock)))
+    {
+        Debug_LOG_ERROR("%s: Either both or none of lock and unlock must be "
+                        "set!", __func__);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreAsync_t* self = malloc(sizeof(OS_KeystoreAsync_t));
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    memset(self, 0, sizeof(*self));
+    self->hKeystore = hKeystore;
+    if (NULL != sync)
+    {
+        self->sync = *sync;
+    }
+    atomic_init(&self->numPending, 0);
+
+    *pHandle = self;
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreAsync_free(
+    OS_KeystoreAsync_Handle_t   hAsync)
+{
+    if (NULL == hAsync)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (atomic_load(&hAsync->numPending) > 0)
+    {
+        Debug_LOG_ERROR("%s: There are %zu pending requests!", __func__,
+                        atomic_load(&hAsync->numPending));
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    free(hAsync);
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreAsync_storeKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    void const*                 keyData,
+    size_t                      keySize,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx)
+{
+    if (NULL == hAsync)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == request) || (NULL == name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    request->op      = OS_KeystoreAsync_OP_STORE_KEY;
+    request->name    = name;
+    request->keyData = (void*) keyData;
+    request->keySize = keySize;
+    request->onDone  = onDone;
+    request->ctx     = ctx;
+
+    return submit(hAsync, request);
+}
+
+OS_Error_t
+OS_KeystoreAsync_loadKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    void*                       keyData,
+    size_t                      keySize,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx)
+{
+    if (NULL == hAsync)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == request) || (NULL == name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    request->op      = OS_KeystoreAsync_OP_LOAD_KEY;
+    request->name    = name;
+    request->keyData = keyData;
+    request->keySize = keySize;
+    request->onDone  = onDone;
+    request->ctx     = ctx;
+
+    return submit(hAsync, request);
+}
+
+OS_Error_t
+OS_KeystoreAsync_deleteKey(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    OS_KeystoreAsync_Request_t* request,
+    const char*                 name,
+    OS_KeystoreAsync_Callback_t onDone,
+    void*                       ctx)
+{
+    if (NULL == hAsync)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == request) || (NULL == name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    request->op      = OS_KeystoreAsync_OP_DELETE_KEY;
+    request->name    = name;
+    request->keyData = NULL;
+    request->keySize = 0;
+    request->onDone  = onDone;
+    request->ctx     = ctx;
+
+    return submit(hAsync, request);
+}
+
+bool
+OS_KeystoreAsync_isDone(
+    OS_KeystoreAsync_Request_t const*   request)
+{
+    return atomic_load(&request->isDone);
+}
+
+OS_Error_t
+OS_KeystoreAsync_process(
+    OS_KeystoreAsync_Handle_t   hAsync,
+    size_t                      maxRequests,
+    size_t*                     numProcessed)
+{
+    OS_KeystoreAsync_Request_t* batch[OS_KeystoreAsync_MAX_BATCH];
+    size_t done = 0;
+
+    if (NULL == hAsync)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    while ((0 == maxRequests) || (done < maxRequests))
+    {
+        size_t max = OS_KeystoreAsync_MAX_BATCH;
+
+        if ((maxRequests > 0) && (maxRequests - done < max))
+        {
+            max = maxRequests - done;
+        }
+
+        size_t n = takeBatch(hAsync, batch, max);
+        if (0 == n)
+        {
+            break;
+        }
+
+        executeBatch(hAsync, batch, n);
+        done += n;
+    }
+
+    if (NULL != numProcessed)
+    {
+        *numProcessed = done;
+    }
+
+    return OS_SUCCESS;
+}
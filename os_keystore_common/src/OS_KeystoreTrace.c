@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreTrace.h"
+
+#include "lib_debug/Debug.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The events are copied in and out of the slots as atomic words, so a reader
+// never races with a writer that overwrites the slot.
+#define EVENT_WORDS \
+    (sizeof(OS_Keystore_TraceEvent_t) / sizeof(uint64_t))
+
+// Number of events the export reads from the buffer at once.
+#define EXPORT_BATCH    32
+
+Debug_STATIC_ASSERT(
+    sizeof(OS_Keystore_TraceEvent_t) == EVENT_WORDS * sizeof(uint64_t));
+
+typedef struct
+{
+    /**
+     * 2 * position + 1 while the event at the position is written,
+     * 2 * position + 2 once it is complete. 0 if it was never written.
+     */
+    atomic_uint_least64_t   seq;
+    /**
+     * 2 * position + 2 of the last event that was dropped, because the slot
+     * was still being written for an older position.
+     */
+    atomic_uint_least64_t   dropped;
+    atomic_uint_least64_t   words[EVENT_WORDS];
+}
+Slot_t;
+
+struct OS_KeystoreTrace
+{
+    Slot_t*                 slots;
+    size_t                  numSlots;
+    //! Position of the next event, i.e. number of events ever written.
+    atomic_uint_least64_t   head;
+};
+
+static const char* const opNames[OS_Keystore_OP_NUM] =
+{
+    [OS_Keystore_OP_OTHER]          = "other",
+    [OS_Keystore_OP_STORE_KEY]      = "storeKey",
+    [OS_Keystore_OP_LOAD_KEY]       = "loadKey",
+    [OS_Keystore_OP_DELETE_KEY]     = "deleteKey",
+    [OS_Keystore_OP_COPY_KEY]       = "copyKey",
+    [OS_Keystore_OP_MOVE_KEY]       = "moveKey",
+    [OS_Keystore_OP_WIPE_KEYSTORE]  = "wipeKeystore",
+    [OS_Keystore_OP_STORE_KEYS]     = "storeKeys",
+    [OS_Keystore_OP_LOAD_KEYS]      = "loadKeys",
+    [OS_Keystore_OP_DELETE_KEYS]    = "deleteKeys",
+    [OS_Keystore_OP_LIST_KEYS]      = "listKeys",
+    [OS_Keystore_OP_GET_KEY_INFO]   = "getKeyInfo",
+    [OS_Keystore_OP_BORROW_KEY]     = "borrowKey",
+    [OS_Keystore_OP_STORE_STREAM]   = "storeStream",
+    [OS_Keystore_OP_LOAD_STREAM]    = "loadStream",
+};
+
+
+// Private functions -----------------------------------------------------------
+
+static void
+onEvent(
+    void*                           ctx,
+    OS_Keystore_TraceEvent_t const* event)
+{
+    OS_KeystoreTrace_put((OS_KeystoreTrace_t*) ctx, event);
+}
+
+// Returns the position of the oldest event the buffer holds.
+static uint64_t
+getOldest(
+    OS_KeystoreTrace_t* self)
+{
+    uint64_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+
+    return (head > self->numSlots) ? head - self->numSlots : 0;
+}
+
+/*
+ * Copies the event at a position. Returns false if it is not complete yet, so
+ * the reader has to stop there. *isLost is set if it has been overwritten.
+ */
+static bool
+readSlot(
+    OS_KeystoreTrace_t*         self,
+    uint64_t                    pos,
+    OS_Keystore_TraceEvent_t*   event,
+    bool*                       isLost)
+{
+    Slot_t* slot = &self->slots[pos & (self->numSlots - 1)];
+    uint64_t expected = 2 * pos + 2;
+    uint64_t words[EVENT_WORDS];
+
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq < expected)
+    {
+        // The event is not complete yet, unless it or a newer one for the slot
+        // has been dropped.
+        *isLost = (atomic_load_explicit(&slot->dropped, memory_order_acquire)
+                   >= expected);
+        return *isLost;
+    }
+
+    for (size_t i = 0; i < EVENT_WORDS; i++)
+    {
+        words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+    }
+
+    // A writer that started to overwrite the slot in the meantime has changed
+    // the sequence number before it touched the words.
+    atomic_thread_fence(memory_order_acquire);
+    *isLost = (seq != expected)
+              || (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq);
+    if (!*isLost)
+    {
+        memcpy(event, words, sizeof(*event));
+    }
+
+    return true;
+}
+
+static OS_Error_t
+writeEvent(
+    OS_KeystoreTrace_Writer_t const*    writer,
+    OS_Keystore_TraceEvent_t const*     event,
+    bool                                isFirst)
+{
+    char buf[384];
+    const char* name = (event->op < OS_Keystore_OP_NUM) ?
+                       opNames[event->op] : "unknown";
+    bool isBegin = (OS_Keystore_TRACE_BEGIN == event->phase);
+
+    // Every call is an asynchronous slice, as the calls on a keystore are not
+    // nested within each other if it is shared between threads. The id joins
+    // the begin and the end of the call.
+    int len = snprintf(
+                  buf, sizeof(buf),
+                  "%s{\"name\":\"%s\",\"cat\":\"keystore\",\"ph\":\"%c\","
+                  "\"id\":\"0x%" PRIx64 ":%" PRIu32 "\",\"pid\":1,\"tid\":1,"
+                  "\"ts\":%" PRIu64 ".%03u,\"args\":{\"keystore\":\"0x%" PRIx64
+                  "\",\"name\":\"0x%08" PRIx32 "\",\"size\":%" PRIu32,
+                  isFirst ? "" : ",\n",
+                  name,
+                  isBegin ? 'b' : 'e',
+                  event->keystore,
+                  event->callId,
+                  event->timestampNs / 1000,
+                  (unsigned int) (event->timestampNs % 1000),
+                  event->keystore,
+                  event->nameHash,
+                  event->size);
+
+    if (!isBegin && (len > 0) && ((size_t) len < sizeof(buf)))
+    {
+        len += snprintf(buf + len, sizeof(buf) - (size_t) len,
+                        ",\"result\":%" PRId32, event->result);
+    }
+    if ((len > 0) && ((size_t) len < sizeof(buf)))
+    {
+        len += snprintf(buf + len, sizeof(buf) - (size_t) len, "}}");
+    }
+    if ((len < 0) || ((size_t) len >= sizeof(buf)))
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    return writer->write(writer->ctx, buf, (size_t) len);
+}
+
+static OS_Error_t
+writeString(
+    OS_KeystoreTrace_Writer_t const*    writer,
+    const char*                         str)
+{
+    return writer->write(writer->ctx, str, strlen(str));
+}
+
+
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+OS_KeystoreTrace_init(
+    OS_KeystoreTrace_Handle_t*  pHandle,
+    size_t                      numEvents)
+{
+    if ((NULL == pHandle) || (numEvents < 2)
+        || ((numEvents & (numEvents - 1)) != 0))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreTrace_t* self = malloc(sizeof(OS_KeystoreTrace_t));
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    self->slots = calloc(numEvents, sizeof(Slot_t));
+
+    if (NULL == self->slots)
+    {
+        free(self);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    for (size_t i = 0; i < numEvents; i++)
+    {
+        atomic_init(&self->slots[i].seq, 0);
+        atomic_init(&self->slots[i].dropped, 0);
+        for (size_t j = 0; j < EVENT_WORDS; j++)
+        {
+            atomic_init(&self->slots[i].words[j], 0);
+        }
+    }
+    self->numSlots = numEvents;
+    atomic_init(&self->head, 0);
+
+    *pHandle = self;
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreTrace_free(
+    OS_KeystoreTrace_Handle_t   hTrace)
+{
+    if (NULL == hTrace)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    free(hTrace->slots);
+    free(hTrace);
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreTrace_getHook(
+    OS_KeystoreTrace_Handle_t   hTrace,
+    OS_Keystore_TraceHook_t*    hook)
+{
+    if (NULL == hTrace)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if (NULL == hook)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    hook->onEvent = onEvent;
+    hook->ctx     = hTrace;
+
+    return OS_SUCCESS;
+}
+
+void
+OS_KeystoreTrace_put(
+    OS_KeystoreTrace_Handle_t       hTrace,
+    OS_Keystore_TraceEvent_t const* event)
+{
+    uint64_t pos = atomic_fetch_add_explicit(&hTrace->head, 1,
+                                             memory_order_relaxed);
+    Slot_t* slot = &hTrace->slots[pos & (hTrace->numSlots - 1)];
+    uint64_t claimed = 2 * pos + 1;
+    uint64_t words[EVENT_WORDS];
+
+    memcpy(words, event, sizeof(*event));
+
+    // Mark the slot as being written before the words change, see readSlot().
+    // Only one writer at a time may own the slot, a writer preempted for a
+    // whole round of the buffer would otherwise mix its words into the event
+    // of a newer one.
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    do
+    {
+        if (seq > claimed)
+        {
+            // A newer event has claimed the slot already, this one is lost.
+            return;
+        }
+        if (seq & 1)
+        {
+            // An older event is still being written, the writer cannot wait
+            // for it. A writer of an older drop must not undo this one.
+            uint64_t dropped = atomic_load_explicit(&slot->dropped,
+                                                    memory_order_relaxed);
+            while ((dropped < claimed + 1)
+                   && !atomic_compare_exchange_weak_explicit(
+                       &slot->dropped, &dropped, claimed + 1,
+                       memory_order_release, memory_order_relaxed))
+            {
+            }
+            return;
+        }
+    }
+    while (!atomic_compare_exchange_weak_explicit(&slot->seq, &seq, claimed,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed));
+
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < EVENT_WORDS; i++)
+    {
+        atomic_store_explicit(&slot->words[i], words[i], memory_order_relaxed);
+    }
+
+    // The slot is owned, nobody else changes the sequence number meanwhile.
+    atomic_compare_exchange_strong_explicit(&slot->seq, &claimed, claimed + 1,
+                                            memory_order_release,
+                                            memory_order_relaxed);
+}
+
+OS_Error_t
+OS_KeystoreTrace_read(
+    OS_KeystoreTrace_Handle_t   hTrace,
+    uint64_t*                   cursor,
+    OS_Keystore_TraceEvent_t*   events,
+    size_t                      maxEvents,
+    size_t*                     numEvents,
+    uint64_t*                   numLost)
+{
+    if (NULL == hTrace)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == cursor) || (NULL == events) || (NULL == numEvents))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    uint64_t head = atomic_load_explicit(&hTrace->head, memory_order_acquire);
+    uint64_t oldest = getOldest(hTrace);
+    uint64_t pos = *cursor;
+    uint64_t lost = 0;
+    size_t n = 0;
+
+    if (pos < oldest)
+    {
+        lost = oldest - pos;
+        pos  = oldest;
+    }
+
+    while ((pos < head) && (n < maxEvents))
+    {
+        bool isLost;
+
+        if (!readSlot(hTrace, pos, &events[n], &isLost))
+        {
+            break;
+        }
+
+        if (isLost)
+        {
+            lost++;
+        }
+        else
+        {
+            n++;
+        }
+        pos++;
+    }
+
+    *cursor    = pos;
+    *numEvents = n;
+    if (NULL != numLost)
+    {
+        *numLost = lost;
+    }
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreTrace_exportChrome(
+    OS_KeystoreTrace_Handle_t           hTrace,
+    OS_KeystoreTrace_Writer_t const*    writer,
+    uint64_t*                           numLost)
+{
+    OS_Error_t err;
+    OS_Keystore_TraceEvent_t events[EXPORT_BATCH];
+    uint64_t cursor;
+    uint64_t lost = 0;
+    bool isFirst = true;
+
+    if (NULL == hTrace)
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
+
+    if ((NULL == writer) || (NULL == writer->write))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    err = writeString(writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    // Export the events that are in the buffer now, the ones written during
+    // the export would otherwise keep it going forever.
+    cursor = getOldest(hTrace);
+    uint64_t end = atomic_load_explicit(&hTrace->head, memory_order_acquire);
+
+    while (cursor < end)
+    {
+        size_t n;
+        uint64_t skipped;
+        size_t max = (end - cursor < EXPORT_BATCH) ?
+                     (size_t) (end - cursor) : EXPORT_BATCH;
+
+        OS_KeystoreTrace_read(hTrace, &cursor, events, max, &n, &skipped);
+        lost += skipped;
+        if ((0 == n) && (0 == skipped))
+        {
+            // The next event is still being written.
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if ((err = writeEvent(writer, &events[i], isFirst)) != OS_SUCCESS)
+            {
+                Debug_LOG_ERROR("%s: Writing the trace failed with error "
+                                "code %d!", __func__, err);
+                return err;
+            }
+            isFirst = false;
+        }
+    }
+
+    if (NULL != numLost)
+    {
+        *numLost = lost;
+    }
+
+    return writeString(writer, "\n]}\n");
+}
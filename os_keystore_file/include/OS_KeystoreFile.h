@@ -21,6 +21,31 @@
  * initialization), which allows having several instances of the KeystoreFile on
  * the same file system. Each key is stored in its own file and the file name is
  * constructed from a Keystore's "instance name" and the respective "key name".
+ * The names, sizes and hashes of all keys of an instance are kept in an index
+ * file "<instancename>.ix0" (or ".ix1"), so the keys stored by a previous
+ * instance with the same name are available again after initialization.
+ * Optionally, the files of an instance can be kept in a directory of their own,
+ * where the key files can further be spread over subdirectories, see
+ * OS_KeystoreFile_Config_t.
+ *
+ * In pack mode, keys of up to OS_KeystoreFile_PACK_MAX_KEY_SIZE bytes do not
+ * get a file of their own, but are appended as records to a few segment files
+ * "<instancename>.pkN" that stay open. This saves the space of a file per key
+ * and the requests to open and close it. Larger keys still get their own file.
+ * Deleting a packed key leaves its record in the segment file until the
+ * segment is compacted, see OS_KeystoreFile_compact(), or the keystore is
+ * wiped.
+ *
+ * Keys larger than OS_KeystoreFile_MAX_KEY_SIZE can only be stored and loaded
+ * piece by piece, see OS_Keystore_beginStoreKey() and
+ * OS_Keystore_beginLoadKey(). Such a key always gets a file of its own, its
+ * record header is written when the key is committed. It cannot be loaded with
+ * OS_Keystore_loadKey(), copies and scrubs pass it through the buffers of the
+ * instance piece by piece.
+ *
+ * NOTE: A wipe writes the empty index before it deletes the files of the keys.
+ * If a file cannot be deleted, its key is gone from the keystore nevertheless,
+ * the next initialization of the instance removes the file.
  *
  * NOTE: Using different instances of the KeystoreFile with the same file system
  * requires each instance to have a unique instance name. Otherwise, these
@@ -30,6 +55,16 @@
  * of storage and the same file system is weak. If one instance needs to be
  * separated from another instance, each instance should have its own piece of
  * storage (separate ranges of storage can be assigned via the StorageServer).
+ *
+ * NOTE: With a lock set by OS_Keystore_setLock(), listing keys, querying their
+ * sizes and loading cached keys do not take it. They use a copy of the key
+ * names that the writers replace after each change, waiting until the readers
+ * of the previous copy are done. This keeps the names in memory three times.
+ * Other loads and load streams take the lock as readers and run in
+ * parallel. They read into buffers on the stack, about
+ * OS_KeystoreFile_RECORD_HEADER_SIZE + OS_KeystoreFile_MAX_KEY_SIZE bytes for
+ * a load. A load that finds the digest object of the instance in use creates
+ * one of its own, which costs two additional calls into the Crypto API.
  */
 
 #pragma once
@@ -37,11 +72,22 @@
 #include "OS_Crypto.h"
 #include "OS_FileSystem.h"
 #include "OS_Keystore.int.h"
+#include "OS_KeystoreFile_Cache.h"
+#include "OS_KeystoreFile_IndexFile.h"
 #include "OS_KeystoreFile_KeyNameMap.h"
+#include "OS_KeystoreFile_PackFile.h"
+
+#include <stdbool.h>
 
 //! Maximum length of a key name.
 #define OS_KeystoreFile_MAX_INSTANCE_NAME_LEN   15
 
+//! Maximum length of the directory holding the files of an instance.
+#define OS_KeystoreFile_MAX_DIRECTORY_LEN       31
+
+//! Maximum number of subdirectories the key files can be spread over.
+#define OS_KeystoreFile_MAX_SHARDS              256
+
 /**
  * This defines the maximum size of struct OS_CryptoKey_Data_t, which consists of
  *  - an element of type struct OS_CryptoKey_Type_t (size 4 bytes)
@@ -55,26 +101,184 @@
  */
 #define OS_KeystoreFile_MAX_KEY_SIZE            2080
 
-//! Maximum length of a file name. A file names is a combination of instance and
-//! key name in the format "<instancename>_<keyname>.key" and needs 5 more chars
-//! for separator and file extension (excluding the null terminator).
+/**
+ * Every key file starts with a record header which holds a magic value, the
+ * format version, flags, the size of the key data and the SHA256 hash of the
+ * key data. The key data directly follows the header, so a key can be written
+ * and read with a single FileSystem request each.
+ */
+#define OS_KeystoreFile_RECORD_HEADER_SIZE      44
+
+//! Maximum length of a file name. A file name is a combination of instance and
+//! key name in the format "<instancename>_<keyname>.key" or, if a directory is
+//! configured, "<directory>/<keyname>.key" resp. "<directory>/<shard>/<keyname>.key"
+//! with a two digit hex shard (excluding the null terminator).
 #define OS_KeystoreFile_MAX_FILE_NAME_LEN \
-    (OS_KeystoreFile_MAX_INSTANCE_NAME_LEN + 1 + \
+    (OS_KeystoreFile_MAX_DIRECTORY_LEN + 1 + 3 + \
     OS_KeystoreFile_KeyName_MAX_NAME_LEN + 4)
 
+//! Maximum size of a key that is packed into a segment file in pack mode.
+#define OS_KeystoreFile_PACK_MAX_KEY_SIZE       256
+
 //! Macro to get the pointer to the parent struct OS_Keystore_t.
 #define OS_KeystoreFile_TO_OS_KEYSTORE(self)    (&((self)->parent))
 
 
+/**
+ * Optional settings of an OS_KeystoreFile instance.
+ */
+typedef struct
+{
+    /**
+     * Maximum amount of key data in bytes that is kept in RAM to serve
+     * repeated loads of the same keys without accessing the file system. Use
+     * 0 to disable the cache.
+     */
+    size_t          cacheSize;
+    /**
+     * Directory that holds the key and index files of the instance, NULL or
+     * an empty string stores them as "<instancename>_<keyname>.key" in the
+     * root directory. The FileSystem API cannot create directories, so the
+     * directory must exist already (e.g. created when formatting the
+     * partition).
+     */
+    const char*     directory;
+    /**
+     * Number of subdirectories "00" .. "ff" of the directory the key files
+     * are spread over by the hash of the key name, which keeps every single
+     * directory small. 0 puts all key files directly into the directory. The
+     * subdirectories must exist already. Changing the value for an existing
+     * instance requires OS_KeystoreFile_migrate() into another directory.
+     */
+    unsigned int    numShards;
+    /**
+     * Maximum size of a segment file in bytes, a value other than 0 enables
+     * the pack mode. A segment holds records of up to
+     * OS_KeystoreFile_RECORD_HEADER_SIZE + OS_KeystoreFile_PACK_MAX_KEY_SIZE
+     * bytes each, so the segment size must be at least that large. One of the
+     * OS_KeystoreFile_PackFile_MAX_SEGMENTS segments is kept free for
+     * compactions. Keys packed before remain readable when the pack mode is
+     * disabled again.
+     */
+    size_t          packSegmentSize;
+    /**
+     * A key only becomes part of the keystore once its entry has been added to
+     * the index after the key data has been written completely, so a store
+     * interrupted by a power loss never leaves a corrupted key behind. It may
+     * leave an incomplete key file though, which is not visible anymore. If
+     * set, the key files are announced in the index before they are written
+     * and the files of interrupted stores are deleted on the next start. This
+     * costs an additional write of the index per store.
+     */
+    bool            atomicStore;
+}
+OS_KeystoreFile_Config_t;
+
+/**
+ * Counters of the key data cache, see OS_KeystoreFile_getCacheStats().
+ */
+typedef struct
+{
+    //! Number of loads served from the cache.
+    uint64_t    hits;
+    //! Number of loads that had to read the key file.
+    uint64_t    misses;
+    //! Number of keys removed from the cache to make room for others.
+    uint64_t    evictions;
+    //! Amount of key data currently held in the cache in bytes.
+    size_t      usedBytes;
+}
+OS_KeystoreFile_CacheStats_t;
+
+/**
+ * Position of an integrity scrub, see OS_KeystoreFile_scrub(). Must be
+ * initialized with OS_KeystoreFile_ScrubCursor_INIT.
+ */
+typedef struct
+{
+    size_t  pos;
+}
+OS_KeystoreFile_ScrubCursor_t;
+
+#define OS_KeystoreFile_ScrubCursor_INIT    { .pos = 0 }
+
+/**
+ * Callback invoked by OS_KeystoreFile_scrub() for every corrupted key. It runs
+ * while the lock of the keystore is held, see OS_Keystore_setLock(), so it must
+ * not use the keystore.
+ *
+ * @param[in]  ctx      Context passed in OS_KeystoreFile_ScrubParams_t.
+ * @param[in]  name     Name of the corrupted key.
+ * @param[in]  err      OS_ERROR_GENERIC if the key data does not match its
+ *                      hash, otherwise the error of reading the key data.
+ */
+typedef void
+(*OS_KeystoreFile_ScrubCallback_t)(
+    void*       ctx,
+    const char* name,
+    OS_Error_t  err);
+
+/**
+ * Settings of a scrub step, see OS_KeystoreFile_scrub().
+ */
+typedef struct
+{
+    //! Maximum number of keys verified per call, 0 for no limit.
+    size_t                          maxKeys;
+    //! Maximum amount of key data in bytes verified per call, 0 for no limit.
+    size_t                          maxBytes;
+    //! Quarantine the corrupted keys.
+    bool                            quarantine;
+    //! Invoked for every corrupted key, may be NULL.
+    OS_KeystoreFile_ScrubCallback_t onCorrupted;
+    //! Passed to onCorrupted.
+    void*                           ctx;
+}
+OS_KeystoreFile_ScrubParams_t;
+
+struct OS_KeystoreFile_Stream;
+
 typedef struct
 {
     OS_Keystore_t               parent;
-    OS_FileSystem_Handle_t      hFs;
+    // FileSystem the instance is stored on, accounted to parent
+    OS_KeystoreFile_Fs          fs;
     OS_Crypto_Handle_t          hCrypto;
+    // SHA256 digest object, created on first use and kept for the lifetime of
+    // the instance
+    OS_CryptoDigest_Handle_t    hDigest;
+    // set while a key is hashed with hDigest
+    atomic_flag                 digestBusy;
     // null terminated string
     char                        name[OS_KeystoreFile_MAX_INSTANCE_NAME_LEN + 1];
+    // key names as changed by the writers, readers use it only under the lock
     OS_KeystoreFile_KeyNameMap  keyNameMap;
+    // copies of keyNameMap published for the readers that take no lock, and
+    // the one in use, see snapshot_publish()
+    OS_KeystoreFile_KeyNameMap  snapshots[2];
+    _Atomic(OS_KeystoreFile_KeyNameMap const*) snapshot;
+    bool                        isSnapshotOutdated;
+    // set while a reader publishes the first snapshot
+    atomic_flag                 snapshotBusy;
+    // epoch and number of readers per epoch, used to wait until the readers
+    // of a replaced snapshot are done
+    atomic_uint                 epoch;
+    atomic_size_t               readers[2];
+    OS_KeystoreFile_IndexFile   indexFile;
+    OS_KeystoreFile_Cache       cache;
+    OS_KeystoreFile_PackFile    packFile;
+    // null terminated string, empty for the flat layout
+    char                        directory[OS_KeystoreFile_MAX_DIRECTORY_LEN + 1];
+    unsigned int                numShards;
+    bool                        atomicStore;
+    // streams that have not been ended yet
+    struct OS_KeystoreFile_Stream* streams;
+    atomic_flag                 streamsLock;
+    // buffers of the operations that take the lock as writer
     unsigned char               buffer[OS_KeystoreFile_MAX_KEY_SIZE];
+    // record header followed by the key data, as written to / read from a file
+    unsigned char               record[OS_KeystoreFile_RECORD_HEADER_SIZE +
+                                       OS_KeystoreFile_MAX_KEY_SIZE];
 }
 OS_KeystoreFile_t;
 
@@ -89,6 +293,8 @@ OS_KeystoreFile_t;
  *                                      OS_KeystoreFile_t context.
  * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
  *                                      valid for some reason.
+ * @retval OS_ERROR_INVALID_STATE      The index file of the instance is
+ *                                      damaged, it is not touched.
  * @retval OS_ERROR_ABORTED             Some of the internal initialisations
  *                                      failed.
  *
@@ -98,7 +304,9 @@ OS_KeystoreFile_t;
  *                      to be used to store / load the keys when using the API
  *                      functions with the created context.
  * @param[in]  hCrypto  Handle that references the Crypto context to be used to
- *                      hash the keys.
+ *                      hash the keys. Not used if the library is built with
+ *                      OS_KEYSTORE_FILE_LOCAL_DIGEST, as the hash is then
+ *                      computed locally.
  * @param[in]  name     Unique name (ID) for the created context.
  */
 OS_Error_t
@@ -107,3 +315,151 @@ OS_KeystoreFile_init(
     OS_FileSystem_Handle_t  hFs,
     OS_Crypto_Handle_t      hCrypto,
     const char*             name);
+
+/**
+ * Same as OS_KeystoreFile_init(), but allows to set optional parameters of the
+ * instance.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
+ *                                      OS_KeystoreFile_t context.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason.
+ * @retval OS_ERROR_INVALID_STATE      The index file of the instance is
+ *                                      damaged, it is not touched.
+ * @retval OS_ERROR_ABORTED             Some of the internal initialisations
+ *                                      failed.
+ *
+ * @param[out] pHandle  Pointer to the variable of the caller supposed to hold
+ *                      the OS_Keystore_Handle_t return value.
+ * @param[in]  hFs      See OS_KeystoreFile_init().
+ * @param[in]  hCrypto  See OS_KeystoreFile_init().
+ * @param[in]  name     See OS_KeystoreFile_init().
+ * @param[in]  config   Optional settings, NULL selects the defaults which are
+ *                      the same as with OS_KeystoreFile_init().
+ */
+OS_Error_t
+OS_KeystoreFile_initWithConfig(
+    OS_Keystore_Handle_t*           pHandle,
+    OS_FileSystem_Handle_t          hFs,
+    OS_Crypto_Handle_t              hCrypto,
+    const char*                     name,
+    OS_KeystoreFile_Config_t const* config);
+
+/**
+ * Compacts one segment file in pack mode, which drops the records of deleted
+ * keys. The live records of the segment are copied into an empty segment and
+ * the old segment file is deleted.
+ *
+ * Only segments with at least half of their bytes being dead are compacted.
+ * The function is meant to be called repeatedly when the system is idle,
+ * each call takes at most the time to copy one segment. If all segments are
+ * full, storing a key compacts a segment on its own.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle does not refer to an
+ *                                      OS_KeystoreFile instance.
+ * @retval OS_ERROR_INVALID_PARAMETER   isDone is NULL.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  There is no empty segment to copy the
+ *                                      records into.
+ * @retval other                        Error of the underlying FileSystem.
+ *
+ * @param[in]  hKeystore    Handle of the OS_KeystoreFile instance.
+ * @param[out] isDone       Set to true if no segment is left that is worth
+ *                          compacting.
+ */
+OS_Error_t
+OS_KeystoreFile_compact(
+    OS_Keystore_Handle_t    hKeystore,
+    bool*                   isDone);
+
+/**
+ * Verifies the next keys of the keystore against their hashes, so corrupted
+ * key data is detected before the key is needed. The function is meant to be
+ * called repeatedly when the system is idle, each call verifies up to the
+ * limits given in params and resumes at the position kept in cursor. At least
+ * one key is verified per call.
+ *
+ * The key data is always read from the storage, the cache is bypassed.
+ * Corrupted keys are reported via params->onCorrupted. If params->quarantine
+ * is set, they are also marked as quarantined in the index: loading or copying
+ * such a key fails with OS_ERROR_GENERIC right away and later scrubs skip it.
+ * A quarantined key still exists, it has to be deleted to store a new key with
+ * the same name.
+ *
+ * NOTE: Keys stored or deleted between two calls may be skipped or verified
+ * twice in the current pass. The callback must not modify the keystore.
+ *
+ * @retval OS_SUCCESS                   Operation was successful, which does
+ *                                      not mean that all keys are intact.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle does not refer to an
+ *                                      OS_KeystoreFile instance.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the parameters are NULL.
+ * @retval other                        Hashing a key or quarantining it
+ *                                      failed, the next call continues with
+ *                                      that key.
+ *
+ * @param[in]     hKeystore Handle of the OS_KeystoreFile instance.
+ * @param[in,out] cursor    Position of the scrub, set back to the start when
+ *                          a pass is complete.
+ * @param[in]     params    Limits and reporting of this step.
+ * @param[out]    isDone    Set to true when the pass over all keys is
+ *                          complete.
+ */
+OS_Error_t
+OS_KeystoreFile_scrub(
+    OS_Keystore_Handle_t                    hKeystore,
+    OS_KeystoreFile_ScrubCursor_t*          cursor,
+    OS_KeystoreFile_ScrubParams_t const*    params,
+    bool*                                   isDone);
+
+/**
+ * Returns the counters of the key data cache of an OS_KeystoreFile instance,
+ * which allow to check whether the configured cache size fits the workload.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_HANDLE      The handle does not refer to an
+ *                                      OS_KeystoreFile instance.
+ * @retval OS_ERROR_INVALID_PARAMETER   stats is NULL.
+ *
+ * @param[in]  hKeystore    Handle of the OS_KeystoreFile instance.
+ * @param[out] stats        Receives the counters.
+ */
+OS_Error_t
+OS_KeystoreFile_getCacheStats(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_KeystoreFile_CacheStats_t*   stats);
+
+/**
+ * Moves all keys of the instance with the given name from one file layout to
+ * another, e.g. from the flat layout into a sharded directory. The key data is
+ * copied without hashing it again.
+ *
+ * If copying a key fails, the keys in the source layout are left untouched and
+ * the migration can be repeated. Keys already present in the target layout are
+ * skipped. The source layout is only removed after all keys have been copied.
+ *
+ * The index files are kept in the directory of a layout, so the directories
+ * of both layouts must differ. To change the number of shards of a directory,
+ * migrate into another directory.
+ *
+ * NOTE: No instance with the given name may exist while the migration runs.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the parameters are invalid or
+ *                                      both configs use the same directory.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate the temporary
+ *                                      instances.
+ * @retval other                        Error of the underlying FileSystem.
+ *
+ * @param[in]  hFs      See OS_KeystoreFile_init().
+ * @param[in]  name     See OS_KeystoreFile_init().
+ * @param[in]  from     Current layout, NULL selects the flat layout.
+ * @param[in]  to       New layout, NULL selects the flat layout.
+ */
+OS_Error_t
+OS_KeystoreFile_migrate(
+    OS_FileSystem_Handle_t          hFs,
+    const char*                     name,
+    OS_KeystoreFile_Config_t const* from,
+    OS_KeystoreFile_Config_t const* to);
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * RAM cache of the key data of an OS_KeystoreFile instance.
+ *
+ * The cache holds copies of recently loaded keys, so loading a hot key again
+ * requires neither FileSystem requests nor hashing. Entries are only filled
+ * with key data whose hash has been verified, the cache does not verify them
+ * again on a hit.
+ *
+ * The size of the cached key data is limited by a byte budget and the number
+ * of entries by OS_KeystoreFile_Cache_MAX_ENTRIES. When space is needed, an
+ * entry is evicted using the CLOCK algorithm, i.e. the entries are visited in
+ * a round robin fashion and an entry is only evicted if it has not been hit
+ * since the last visit.
+ *
+ * The key data of an entry is zeroized whenever the entry is removed.
+ *
+ * Loads of an OS_KeystoreFile run in parallel, so all functions take a spin
+ * lock of the cache, see OS_Keystore_spinLock().
+ */
+
+#pragma once
+
+#include "OS_Keystore.int.h"
+#include "OS_KeystoreFile_KeyName.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+//! Maximum number of keys held by the cache at the same time.
+#define OS_KeystoreFile_Cache_MAX_ENTRIES   32
+
+typedef struct
+{
+    bool                        isUsed;
+    //! Set on every hit, cleared when the clock hand passes the entry.
+    bool                        isReferenced;
+    uint32_t                    hash;
+    OS_KeystoreFile_KeyName     name;
+    size_t                      size;
+    uint8_t*                    data;
+}
+OS_KeystoreFile_Cache_Entry;
+
+typedef struct
+{
+    //! Keystore whose lock yields while the spin lock is busy.
+    OS_Keystore_t*              keystore;
+    atomic_flag                 lock;
+    OS_KeystoreFile_Cache_Entry entries[OS_KeystoreFile_Cache_MAX_ENTRIES];
+    //! Maximum amount of key data in bytes, 0 disables the cache.
+    size_t                      budget;
+    //! Amount of key data currently held in bytes.
+    size_t                      used;
+    //! Position of the clock hand in entries[].
+    unsigned int                hand;
+    uint64_t                    hits;
+    uint64_t                    misses;
+    uint64_t                    evictions;
+}
+OS_KeystoreFile_Cache;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+void
+OS_KeystoreFile_Cache_ctor(
+    OS_KeystoreFile_Cache*  self,
+    OS_Keystore_t*          keystore,
+    size_t                  budget);
+
+/**
+ * Removes all entries, see OS_KeystoreFile_Cache_clear().
+ */
+void
+OS_KeystoreFile_Cache_dtor(
+    OS_KeystoreFile_Cache*  self);
+
+/**
+ * Copies the cached key data into keyData and counts a hit. If the key is not
+ * cached, a miss is counted and false is returned.
+ *
+ * The caller has to make sure keyData can hold the key, i.e. the key size
+ * known to the keystore fits into the buffer.
+ */
+bool
+OS_KeystoreFile_Cache_get(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash,
+    void*                           keyData,
+    size_t                          keySize);
+
+/**
+ * Adds a verified key to the cache, evicting other entries as needed. A key
+ * larger than the budget is not cached. Failing to add a key is not an error,
+ * the key is just not cached then.
+ */
+void
+OS_KeystoreFile_Cache_put(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash,
+    void const*                     keyData,
+    size_t                          keySize);
+
+/**
+ * Removes the key from the cache and zeroizes its data, if it is cached.
+ */
+void
+OS_KeystoreFile_Cache_remove(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash);
+
+/**
+ * Removes all entries and zeroizes their data. The statistics are kept.
+ */
+void
+OS_KeystoreFile_Cache_clear(
+    OS_KeystoreFile_Cache*  self);
+
+/**
+ * Returns the counters and the amount of key data held, which loads running
+ * in parallel update.
+ */
+void
+OS_KeystoreFile_Cache_getCounters(
+    OS_KeystoreFile_Cache*  self,
+    uint64_t*               hits,
+    uint64_t*               misses,
+    uint64_t*               evictions,
+    size_t*                 used);
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * FileSystem access of an OS_KeystoreFile instance.
+ *
+ * The functions pass the calls to the OS_FileSystem API and account them to
+ * the operation running on the keystore, see OS_Keystore_getStats(). Without
+ * OS_KEYSTORE_STATS they reduce to the plain OS_FileSystem calls.
+ */
+
+#pragma once
+
+#include "OS_Keystore.int.h"
+#include "OS_FileSystem.h"
+
+#include <stddef.h>
+
+
+typedef struct
+{
+    OS_FileSystem_Handle_t  hFs;
+    //! Keystore the calls are accounted to.
+    OS_Keystore_t*          keystore;
+}
+OS_KeystoreFile_Fs;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_open(
+    OS_KeystoreFile_Fs const*       self,
+    OS_FileSystemFile_Handle_t*     hFile,
+    const char*                     name,
+    const OS_FileSystem_OpenMode_t  mode,
+    const OS_FileSystem_OpenFlags_t flags)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_OPEN, 0);
+
+    return OS_FileSystemFile_open(self->hFs, hFile, name, mode, flags);
+}
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_close(
+    OS_KeystoreFile_Fs const*           self,
+    const OS_FileSystemFile_Handle_t    hFile)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_CLOSE, 0);
+
+    return OS_FileSystemFile_close(self->hFs, hFile);
+}
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_read(
+    OS_KeystoreFile_Fs const*           self,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    void*                               buffer)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_READ, len);
+
+    return OS_FileSystemFile_read(self->hFs, hFile, offset, len, buffer);
+}
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_write(
+    OS_KeystoreFile_Fs const*           self,
+    const OS_FileSystemFile_Handle_t    hFile,
+    const off_t                         offset,
+    const size_t                        len,
+    const void*                         buffer)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_WRITE, len);
+
+    return OS_FileSystemFile_write(self->hFs, hFile, offset, len, buffer);
+}
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_delete(
+    OS_KeystoreFile_Fs const*   self,
+    const char*                 name)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_DELETE, 0);
+
+    return OS_FileSystemFile_delete(self->hFs, name);
+}
+
+static inline OS_Error_t
+OS_KeystoreFile_Fs_getSize(
+    OS_KeystoreFile_Fs const*   self,
+    const char*                 name,
+    off_t*                      sz)
+{
+    OS_Keystore_STATS_COUNT_IO(self->keystore, OS_Keystore_IO_FS_GET_SIZE, 0);
+
+    return OS_FileSystemFile_getSize(self->hFs, name, sz);
+}
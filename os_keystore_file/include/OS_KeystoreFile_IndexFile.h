@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Persistent index of an OS_KeystoreFile instance.
+ *
+ * The index file holds the name, size, hash and, for packed keys, the location
+ * of the record of every key of an instance, so the keys stored during a
+ * previous boot are known again right after OS_KeystoreFile_init() without
+ * touching the individual key files.
+ *
+ * A file consists of a header, a snapshot of all keys terminated by an END
+ * entry and a journal of ADD/DEL entries appended by every store and delete.
+ * All entries have the same size and carry a checksum, so a torn append is
+ * detected and dropped when the file is loaded. Any other damaged entry makes
+ * the load fail, as the keys it holds would otherwise be lost with the next
+ * rewrite.
+ *
+ * Once the journal grows too long, the index is compacted by writing a new
+ * snapshot with the next generation number into the alternate file and then
+ * deleting the old one. When loading, the valid file with the highest
+ * generation wins, so an interrupted compaction never loses the index.
+ */
+
+#pragma once
+
+#include "OS_KeystoreFile_Fs.h"
+#include "OS_KeystoreFile_KeyInfo.h"
+#include "OS_KeystoreFile_KeyName.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+//! Maximum length of an index file name in the format "<prefix>.ixN", where
+//! the prefix is "<directory>/<instancename>" with a directory of up to 31
+//! chars or just "<instancename>" with up to 15 chars (excluding the null
+//! terminator).
+#define OS_KeystoreFile_IndexFile_MAX_FILE_NAME_LEN     (31 + 1 + 15 + 4)
+
+typedef enum
+{
+    OS_KeystoreFile_IndexFile_OP_ADD = 1,
+    OS_KeystoreFile_IndexFile_OP_DEL = 2,
+    //! Terminates the snapshot part of an index file.
+    OS_KeystoreFile_IndexFile_OP_END = 3,
+    //! Announces that a key file is about to be written, it is followed by
+    //! an ADD entry once the file is complete.
+    OS_KeystoreFile_IndexFile_OP_INTENT = 4,
+}
+OS_KeystoreFile_IndexFile_Op;
+
+typedef struct
+{
+    OS_KeystoreFile_IndexFile_Op    op;
+    OS_KeystoreFile_KeyName         name;
+    OS_KeystoreFile_KeyInfo         info;
+}
+OS_KeystoreFile_IndexFile_Entry;
+
+typedef struct
+{
+    OS_KeystoreFile_Fs const*   fs;
+    // null terminated strings
+    char                    fileName[2][OS_KeystoreFile_IndexFile_MAX_FILE_NAME_LEN + 1];
+    //! Index of the file in fileName[] that currently holds the index.
+    unsigned int            active;
+    //! False as long as no index file has been written.
+    bool                    exists;
+    //! The active file has been written by an older version and must be
+    //! rewritten before entries can be appended.
+    bool                    isLegacy;
+    uint32_t                generation;
+    //! Offset at which the next journal entry is appended.
+    size_t                  writeOffset;
+    //! Number of journal entries in the active file.
+    size_t                  numEntries;
+}
+OS_KeystoreFile_IndexFile;
+
+/**
+ * Callback invoked for every ADD/DEL/INTENT entry found when loading an index
+ * file, in the order the entries were written.
+ */
+typedef bool
+(*OS_KeystoreFile_IndexFile_ReplayFn)(
+    void*                                   ctx,
+    OS_KeystoreFile_IndexFile_Entry const*  entry);
+
+/**
+ * Callback which provides the i-th live key when writing a snapshot.
+ */
+typedef bool
+(*OS_KeystoreFile_IndexFile_GetEntryFn)(
+    void*                                   ctx,
+    size_t                                  i,
+    OS_KeystoreFile_IndexFile_Entry*        entry);
+
+
+/* Public functions ----------------------------------------------------------*/
+
+void
+OS_KeystoreFile_IndexFile_ctor(
+    OS_KeystoreFile_IndexFile*  self,
+    OS_KeystoreFile_Fs const*   fs,
+    const char*                 prefix);
+
+/**
+ * Reads the index file with a single read and replays its entries.
+ *
+ * A missing index file is not an error, it just results in an empty index.
+ *
+ * @retval OS_ERROR_INVALID_STATE   The index is damaged, i.e. the file to be
+ *                                  loaded has an invalid entry that is not at
+ *                                  the end of its journal, or the header or
+ *                                  the snapshot of a file that may be the
+ *                                  latest one is invalid.
+ * @retval OS_ERROR_ABORTED         The replay callback failed.
+ */
+OS_Error_t
+OS_KeystoreFile_IndexFile_load(
+    OS_KeystoreFile_IndexFile*          self,
+    OS_KeystoreFile_IndexFile_ReplayFn  replay,
+    void*                               ctx);
+
+/**
+ * Appends journal entries with a single write.
+ *
+ * Fails with OS_ERROR_INVALID_STATE if the active file has been written by an
+ * older version, see OS_KeystoreFile_IndexFile_needsCompaction().
+ */
+OS_Error_t
+OS_KeystoreFile_IndexFile_append(
+    OS_KeystoreFile_IndexFile*              self,
+    OS_KeystoreFile_IndexFile_Entry const*  entries,
+    size_t                                  numEntries);
+
+/**
+ * Writes a snapshot of numEntries live keys into the alternate file and
+ * makes it the active one.
+ */
+OS_Error_t
+OS_KeystoreFile_IndexFile_rewrite(
+    OS_KeystoreFile_IndexFile*              self,
+    OS_KeystoreFile_IndexFile_GetEntryFn    getEntry,
+    void*                                   ctx,
+    size_t                                  numEntries);
+
+/**
+ * Checks whether the journal has grown large enough compared to the number of
+ * live keys that a rewrite is worthwhile. An index file written by an older
+ * version always needs a rewrite.
+ */
+bool
+OS_KeystoreFile_IndexFile_needsCompaction(
+    OS_KeystoreFile_IndexFile const*    self,
+    size_t                              numLiveKeys);
+
+/**
+ * Deletes both index files, which leaves an empty index behind.
+ */
+OS_Error_t
+OS_KeystoreFile_IndexFile_remove(
+    OS_KeystoreFile_IndexFile*  self);
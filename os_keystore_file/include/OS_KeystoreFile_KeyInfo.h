@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define OS_KeystoreFile_KeyInfo_HASH_SIZE   32
+
+//! The key has been found corrupted and is not loaded anymore.
+#define OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED    0x01
+
+typedef struct OS_KeystoreFile_KeyInfo
+{
+    size_t      keySize;
+    // SHA256 hash of the key data, as stored in the record header of the file
+    uint8_t     hash[OS_KeystoreFile_KeyInfo_HASH_SIZE];
+    // Pack segment holding the record of the key, 0 if the key has a file of
+    // its own
+    uint32_t    segment;
+    // Offset of the record in the pack segment
+    uint32_t    offset;
+    // OS_KeystoreFile_KeyInfo_FLAG_xxx
+    uint8_t     flags;
+}
+OS_KeystoreFile_KeyInfo;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+OS_KeystoreFile_KeyInfo_ctorCopy(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src);
+
+bool
+OS_KeystoreFile_KeyInfo_ctorMove(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src);
+
+bool
+OS_KeystoreFile_KeyInfo_assign(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src);
+
+void
+OS_KeystoreFile_KeyInfo_dtor(
+    OS_KeystoreFile_KeyInfo* el);
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define OS_KeystoreFile_KeyName_MAX_NAME_LEN    15
@@ -43,3 +44,7 @@ bool
 OS_KeystoreFile_KeyName_isEqual(
     OS_KeystoreFile_KeyName const* a,
     OS_KeystoreFile_KeyName const* b);
+
+uint32_t
+OS_KeystoreFile_KeyName_getHash(
+    OS_KeystoreFile_KeyName const* self);
@@ -6,13 +6,141 @@
  * For commercial licensing, contact: info.cyber@hensoldt.net
  */
 
+/**
+ * @file
+ *
+ * Map from key names to key infos, implemented as open addressing hash table
+ * with linear probing.
+ *
+ * The hash of a name is computed once by the caller and then passed to the
+ * lookup. A lookup returns the slot of the key, which stays valid until the
+ * map is modified, so existence check, size fetch and removal of a key can
+ * share a single lookup.
+ */
+
 #pragma once
 
-#include "OS_KeystoreFile_KeySize.h"
+#include "OS_KeystoreFile_KeyInfo.h"
 #include "OS_KeystoreFile_KeyName.h"
-#include "lib_utils/MapT.h"
 
-MapT_DECLARE(
-    OS_KeystoreFile_KeyName,
-    OS_KeystoreFile_KeySize,
-    OS_KeystoreFile_KeyNameMap);
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+typedef struct
+{
+    bool                        isUsed;
+    uint32_t                    hash;
+    OS_KeystoreFile_KeyName     key;
+    OS_KeystoreFile_KeyInfo     value;
+}
+OS_KeystoreFile_KeyNameMap_Slot;
+
+typedef struct
+{
+    OS_KeystoreFile_KeyNameMap_Slot*    slots;
+    //! Number of slots, always a power of two.
+    size_t                              capacity;
+    //! Number of used slots.
+    size_t                              size;
+}
+OS_KeystoreFile_KeyNameMap;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+OS_KeystoreFile_KeyNameMap_ctor(
+    OS_KeystoreFile_KeyNameMap* self,
+    size_t                      capacity);
+
+void
+OS_KeystoreFile_KeyNameMap_dtor(
+    OS_KeystoreFile_KeyNameMap* self);
+
+/**
+ * Returns the slot holding the key or -1 if the key is not in the map.
+ */
+int
+OS_KeystoreFile_KeyNameMap_find(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    OS_KeystoreFile_KeyName const*      key,
+    uint32_t                            hash);
+
+/**
+ * Inserts a key that is not yet in the map. All slots previously returned
+ * become invalid.
+ */
+bool
+OS_KeystoreFile_KeyNameMap_insert(
+    OS_KeystoreFile_KeyNameMap*     self,
+    OS_KeystoreFile_KeyName const*  key,
+    uint32_t                        hash,
+    OS_KeystoreFile_KeyInfo const*  value);
+
+/**
+ * Removes the key in the given slot. All slots previously returned become
+ * invalid.
+ */
+void
+OS_KeystoreFile_KeyNameMap_removeAt(
+    OS_KeystoreFile_KeyNameMap* self,
+    int                         slot);
+
+/**
+ * Makes self a copy of src, with the keys in the same slots. Fails only if
+ * the slots of self have to be reallocated for the capacity of src, self is
+ * then left unchanged.
+ */
+bool
+OS_KeystoreFile_KeyNameMap_assign(
+    OS_KeystoreFile_KeyNameMap*         self,
+    OS_KeystoreFile_KeyNameMap const*   src);
+
+/**
+ * Removes all keys.
+ */
+void
+OS_KeystoreFile_KeyNameMap_clear(
+    OS_KeystoreFile_KeyNameMap* self);
+
+/**
+ * Returns the first used slot starting at the given one or -1 if there is
+ * none, which allows to iterate over all keys.
+ */
+int
+OS_KeystoreFile_KeyNameMap_getNext(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot);
+
+OS_KeystoreFile_KeyName const*
+OS_KeystoreFile_KeyNameMap_getKeyAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot);
+
+OS_KeystoreFile_KeyInfo const*
+OS_KeystoreFile_KeyNameMap_getValueAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot);
+
+/**
+ * Replaces the value of the entry in the given slot, no entries are moved.
+ */
+void
+OS_KeystoreFile_KeyNameMap_setValueAt(
+    OS_KeystoreFile_KeyNameMap*     self,
+    int                             slot,
+    OS_KeystoreFile_KeyInfo const*  value);
+
+/**
+ * Returns the hash of the key in the slot, as passed on insert.
+ */
+uint32_t
+OS_KeystoreFile_KeyNameMap_getHashAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot);
+
+size_t
+OS_KeystoreFile_KeyNameMap_getSize(
+    OS_KeystoreFile_KeyNameMap const*   self);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Pack segments of an OS_KeystoreFile instance.
+ *
+ * In pack mode, small keys are not written into files of their own but
+ * appended as records to one of a few segment files "<prefix>.pkN". The
+ * location (segment and offset) of every record is kept in the index, so a
+ * record is read with a single read request. The files of the segments stay
+ * open for the lifetime of the instance.
+ *
+ * Records are never modified, deleting a key only makes its record dead. Dead
+ * records are dropped by compacting a segment: its live records are copied
+ * into an empty segment and the old file is deleted. One segment is always
+ * kept empty for that purpose, so a compaction never runs out of space.
+ *
+ * Segments are numbered from 1 to OS_KeystoreFile_PackFile_MAX_SEGMENTS, as
+ * segment 0 in the index denotes a key with a file of its own.
+ */
+
+#pragma once
+
+#include "OS_KeystoreFile_Fs.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+//! Number of segment files of an instance.
+#define OS_KeystoreFile_PackFile_MAX_SEGMENTS           8
+
+//! Maximum length of a segment file name in the format "<prefix>.pkN", see
+//! OS_KeystoreFile_IndexFile_MAX_FILE_NAME_LEN.
+#define OS_KeystoreFile_PackFile_MAX_FILE_NAME_LEN      (31 + 1 + 15 + 4)
+
+typedef struct
+{
+    //! Set once hFile is valid, see OS_KeystoreFile_PackFile_read().
+    atomic_bool                 isOpen;
+    OS_FileSystemFile_Handle_t  hFile;
+    //! Number of bytes written into the file, live and dead records.
+    size_t                      size;
+    //! Number of bytes of live records.
+    size_t                      liveBytes;
+}
+OS_KeystoreFile_PackFile_Segment;
+
+typedef struct
+{
+    OS_KeystoreFile_Fs const*           fs;
+    // null terminated strings
+    char                                fileName[OS_KeystoreFile_PackFile_MAX_SEGMENTS]
+                                                [OS_KeystoreFile_PackFile_MAX_FILE_NAME_LEN + 1];
+    OS_KeystoreFile_PackFile_Segment    segments[OS_KeystoreFile_PackFile_MAX_SEGMENTS];
+    //! Maximum size of a segment file, 0 if no new records are packed.
+    size_t                              segmentSize;
+    //! Segment new records are appended to, 0 if none has been chosen yet.
+    unsigned int                        active;
+    //! Taken by reads that open a segment.
+    atomic_flag                         openLock;
+}
+OS_KeystoreFile_PackFile;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+void
+OS_KeystoreFile_PackFile_ctor(
+    OS_KeystoreFile_PackFile*   self,
+    OS_KeystoreFile_Fs const*   fs,
+    const char*                 prefix,
+    size_t                      segmentSize);
+
+/**
+ * Closes the segment files.
+ */
+void
+OS_KeystoreFile_PackFile_dtor(
+    OS_KeystoreFile_PackFile*   self);
+
+/**
+ * Determines the size of the existing segment files. The live bytes have to be
+ * added with OS_KeystoreFile_PackFile_addLive() from the index.
+ */
+OS_Error_t
+OS_KeystoreFile_PackFile_load(
+    OS_KeystoreFile_PackFile*   self);
+
+/**
+ * Accounts a live record of len bytes to a segment.
+ */
+void
+OS_KeystoreFile_PackFile_addLive(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    size_t                      len);
+
+/**
+ * Marks a record of len bytes in a segment as dead.
+ */
+void
+OS_KeystoreFile_PackFile_release(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    size_t                      len);
+
+/**
+ * Selects the segment a record of len bytes is appended to. Returns 0 if only
+ * the spare segment is left, the caller has to compact a segment then.
+ */
+unsigned int
+OS_KeystoreFile_PackFile_allocate(
+    OS_KeystoreFile_PackFile*   self,
+    size_t                      len);
+
+/**
+ * Appends a record to the end of a segment and accounts it as live.
+ */
+OS_Error_t
+OS_KeystoreFile_PackFile_write(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    void const*                 record,
+    size_t                      len,
+    uint32_t*                   offset);
+
+/**
+ * Reads len bytes at offset from a segment, opening its file on first use.
+ * Reads may run in parallel with each other, but not with the other functions.
+ */
+OS_Error_t
+OS_KeystoreFile_PackFile_read(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    uint32_t                    offset,
+    void*                       record,
+    size_t                      len);
+
+/**
+ * Returns an empty segment to copy live records into, 0 if there is none.
+ */
+unsigned int
+OS_KeystoreFile_PackFile_getEmpty(
+    OS_KeystoreFile_PackFile const* self);
+
+/**
+ * Returns the segment with the most dead bytes or 0 if there is none worth
+ * compacting. Unless force is set, at least half of a segment must be dead.
+ */
+unsigned int
+OS_KeystoreFile_PackFile_getCompactionCandidate(
+    OS_KeystoreFile_PackFile const* self,
+    bool                            force);
+
+/**
+ * Deletes the file of a segment, which makes it empty. A missing file is not
+ * an error.
+ */
+OS_Error_t
+OS_KeystoreFile_PackFile_remove(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment);
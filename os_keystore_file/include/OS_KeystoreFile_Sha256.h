@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * Minimal software SHA256 (FIPS 180-4), used to compute the integrity hash of
+ * the key data locally when OS_KEYSTORE_FILE_LOCAL_DIGEST is set, so no call
+ * of the Crypto API is needed when storing or loading a key.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define OS_KeystoreFile_Sha256_SIZE     32
+
+typedef struct
+{
+    uint32_t    state[8];
+    uint64_t    length;
+    uint8_t     block[64];
+    size_t      blockLen;
+}
+OS_KeystoreFile_Sha256;
+
+
+/* Public functions ----------------------------------------------------------*/
+
+void
+OS_KeystoreFile_Sha256_init(
+    OS_KeystoreFile_Sha256* self);
+
+void
+OS_KeystoreFile_Sha256_process(
+    OS_KeystoreFile_Sha256* self,
+    const void*             data,
+    size_t                  len);
+
+void
+OS_KeystoreFile_Sha256_finalize(
+    OS_KeystoreFile_Sha256* self,
+    uint8_t                 digest[OS_KeystoreFile_Sha256_SIZE]);
@@ -7,6 +7,8 @@
  */
 
 #include "OS_KeystoreFile.h"
+#include "OS_KeystoreFile_Sha256.h"
+#include "lib_debug/Debug.h"
 #include "lib_utils/BitConverter.h"
 
 #include <string.h>
@@ -15,6 +17,105 @@
 #define KEY_LEN_SIZE          (sizeof(uint32_t))
 #define KEY_HASH_SIZE         32
 
+// Layout of the record header that precedes the key data in every key file.
+// All multi-byte fields are stored in big endian.
+#define RECORD_MAGIC          0x4F534B53  // "OSKS"
+#define RECORD_VERSION        1
+#define RECORD_FLAGS_NONE     0
+
+#define RECORD_OFFS_MAGIC     0
+#define RECORD_OFFS_VERSION   4
+#define RECORD_OFFS_FLAGS     5
+#define RECORD_OFFS_RESERVED  6
+#define RECORD_OFFS_KEY_SIZE  8
+#define RECORD_OFFS_HASH      12
+
+// Files written by earlier versions only hold the hash and the key size in
+// front of the key data.
+#define LEGACY_HEADER_SIZE    (KEY_HASH_SIZE + KEY_LEN_SIZE)
+
+// Number of times a writer polls the readers before it yields, see
+// snapshot_publish().
+#define MAX_SPINS             64
+
+Debug_STATIC_ASSERT(
+    OS_KeystoreFile_RECORD_HEADER_SIZE == (RECORD_OFFS_HASH + KEY_HASH_SIZE));
+Debug_STATIC_ASSERT(
+    OS_KeystoreFile_KeyInfo_HASH_SIZE == KEY_HASH_SIZE);
+Debug_STATIC_ASSERT(
+    OS_KeystoreFile_IndexFile_MAX_FILE_NAME_LEN >=
+    OS_KeystoreFile_MAX_DIRECTORY_LEN + 1 +
+    OS_KeystoreFile_MAX_INSTANCE_NAME_LEN + 4);
+// The shard is encoded with two hex digits.
+Debug_STATIC_ASSERT(
+    OS_KeystoreFile_MAX_SHARDS <= 256);
+
+typedef struct
+{
+    uint32_t    magic;
+    uint8_t     version;
+    uint8_t     flags;
+    uint32_t    keySize;
+    uint8_t     hash[KEY_HASH_SIZE];
+}
+RecordHeader;
+
+// A key name resolved once per API call: the padded name, its hash and the
+// slot in the map (-1 if the key is not registered).
+typedef struct
+{
+    OS_KeystoreFile_KeyName name;
+    uint32_t                hash;
+    int                     slot;
+}
+KeyLookup;
+
+typedef struct
+{
+    OS_KeystoreFile_KeyNameMap const*   map;
+    int                                 slot;
+}
+SnapshotCursor;
+
+#if defined(OS_KEYSTORE_FILE_LOCAL_DIGEST)
+typedef OS_KeystoreFile_Sha256      StreamDigest;
+#else
+typedef OS_CryptoDigest_Handle_t    StreamDigest;
+#endif
+
+// State of a key that is stored or loaded piece by piece. The open streams of
+// an instance are kept in a list, so a name cannot be taken twice by pending
+// stores and nothing is left behind when the instance is freed.
+typedef struct OS_KeystoreFile_Stream
+{
+    struct OS_KeystoreFile_Stream*  next;
+    KeyLookup                       lookup;
+    StreamDigest                    digest;
+    bool                            isStore;
+    // Set once a call has failed, the stream can only be closed then
+    OS_Error_t                      err;
+    // File of a store, open until the stream ends
+    OS_FileSystemFile_Handle_t      hFile;
+    bool                            isFileOpen;
+    // Key as found when a load was started
+    OS_KeystoreFile_KeyInfo         info;
+    // Hash in the record header, checked with the last piece of a load
+    unsigned char                   readHash[KEY_HASH_SIZE];
+    // Offset of the key data in the file resp. the segment
+    size_t                          dataOffset;
+}
+KeyStream;
+
+// State while the index is replayed. The names of INTENT entries are collected
+// to find the files of stores that have not been completed.
+typedef struct
+{
+    OS_KeystoreFile_t*          self;
+    OS_KeystoreFile_KeyNameMap  pending;
+    bool                        hasPending;
+}
+ReplayState;
+
 
 // Vtable definition -----------------------------------------------------------
 
@@ -51,6 +152,73 @@ static OS_Error_t
 OS_KeystoreFile_wipeKeystore(
     OS_Keystore_t*  ptr);
 
+static OS_Error_t
+OS_KeystoreFile_storeKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+static OS_Error_t
+OS_KeystoreFile_deleteKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems);
+
+static OS_Error_t
+OS_KeystoreFile_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize);
+
+static OS_Error_t
+OS_KeystoreFile_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize);
+
+static OS_Error_t
+OS_KeystoreFile_getKeystoreStats(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stats_t*    stats);
+
+static OS_Error_t
+OS_KeystoreFile_beginStoreKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreFile_writeKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len);
+
+static OS_Error_t
+OS_KeystoreFile_commitKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreFile_beginLoadKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream);
+
+static OS_Error_t
+OS_KeystoreFile_readKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len);
+
+static OS_Error_t
+OS_KeystoreFile_closeStream(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream);
+
 static const OS_Keystore_Vtable_t OS_KeystoreFile_vtable =
 {
     .free           = OS_KeystoreFile_free,
@@ -59,35 +227,207 @@ static const OS_Keystore_Vtable_t OS_KeystoreFile_vtable =
     .deleteKey      = OS_KeystoreFile_deleteKey,
     .copyKey        = OS_KeystoreFile_copyKey,
     .moveKey        = OS_Keystore_moveKeyImpl,
-    .wipeKeystore   = OS_KeystoreFile_wipeKeystore
+    .wipeKeystore   = OS_KeystoreFile_wipeKeystore,
+    .storeKeys      = OS_KeystoreFile_storeKeys,
+    .loadKeys       = OS_Keystore_loadKeysImpl,
+    .deleteKeys     = OS_KeystoreFile_deleteKeys,
+    .listKeys       = OS_KeystoreFile_listKeys,
+    .getKeyInfo     = OS_KeystoreFile_getKeyInfo,
+    .getStats       = OS_KeystoreFile_getKeystoreStats,
+    .beginStoreKey  = OS_KeystoreFile_beginStoreKey,
+    .writeKeyChunk  = OS_KeystoreFile_writeKeyChunk,
+    .commitKey      = OS_KeystoreFile_commitKey,
+    .beginLoadKey   = OS_KeystoreFile_beginLoadKey,
+    .readKeyChunk   = OS_KeystoreFile_readKeyChunk,
+    .closeStream    = OS_KeystoreFile_closeStream,
+    // Reads look the keys up in a snapshot of the key names. They take the
+    // lock as readers only to read key files, with buffers and digests of
+    // their own, see OS_KeystoreFile_loadKey().
+    .hasLockFreeReads = true
 };
 
 
 // Private functions -----------------------------------------------------------
 
+#if defined(OS_KEYSTORE_FILE_LOCAL_DIGEST)
+
 static OS_Error_t
 createKeyHash(
-    OS_Crypto_Handle_t hCrypto,
+    OS_KeystoreFile_t* self,
     const void*        keyData,
     size_t             keyDataSize,
     void*              output)
 {
-    OS_Error_t err = OS_SUCCESS;
-    OS_CryptoDigest_Handle_t hDigest;
+    OS_KeystoreFile_Sha256 sha;
+
+    (void) self;
+
+    OS_KeystoreFile_Sha256_init(&sha);
+    OS_KeystoreFile_Sha256_process(&sha, keyData, keyDataSize);
+    OS_KeystoreFile_Sha256_finalize(&sha, output);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+digest_init(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest)
+{
+    (void) self;
+
+    OS_KeystoreFile_Sha256_init(digest);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+digest_process(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest,
+    const void*         data,
+    size_t              len)
+{
+    (void) self;
+
+    OS_KeystoreFile_Sha256_process(digest, data, len);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+digest_finalize(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest,
+    void*               output)
+{
+    (void) self;
+
+    OS_KeystoreFile_Sha256_finalize(digest, output);
+
+    return OS_SUCCESS;
+}
+
+static void
+digest_free(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest)
+{
+    (void) self;
+
+    memset(digest, 0, sizeof(*digest));
+}
 
-    err = OS_CryptoDigest_init(
-              &hDigest,
-              hCrypto,
-              OS_CryptoDigest_ALG_SHA256);
+#else
+
+// A stream hashes its key over several calls, so it needs a digest object of
+// its own. So does a load running in parallel to another one, see
+// createKeyHash().
+static OS_Error_t
+digest_init(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest)
+{
+    OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+    OS_Error_t err = OS_CryptoDigest_init(
+                         digest,
+                         self->hCrypto,
+                         OS_CryptoDigest_ALG_SHA256);
 
     if (err != OS_SUCCESS)
     {
         Debug_LOG_ERROR("%s: OS_CryptoDigest_init() failed with error code %d!",
                         __func__, err);
-        goto ERR_EXIT;
+        *digest = NULL;
+    }
+
+    return err;
+}
+
+static OS_Error_t
+digest_process(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest,
+    const void*         data,
+    size_t              len)
+{
+    OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+    OS_Error_t err = OS_CryptoDigest_process(*digest, data, len);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: OS_CryptoDigest_process() failed with error code %d!",
+                        __func__, err);
+    }
+
+    return err;
+}
+
+static OS_Error_t
+digest_finalize(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest,
+    void*               output)
+{
+    size_t digestSize = KEY_HASH_SIZE;
+
+    OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+    OS_Error_t err = OS_CryptoDigest_finalize(*digest, output, &digestSize);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: OS_CryptoDigest_finalize() failed with error code %d!",
+                        __func__, err);
+    }
+
+    return err;
+}
+
+static void
+digest_free(
+    OS_KeystoreFile_t*  self,
+    StreamDigest*       digest)
+{
+    (void) self;
+
+    if (NULL != *digest)
+    {
+        OS_CryptoDigest_free(*digest);
+        *digest = NULL;
+    }
+}
+
+static OS_Error_t
+hashWithInstanceDigest(
+    OS_KeystoreFile_t* self,
+    const void*        keyData,
+    size_t             keyDataSize,
+    void*              output)
+{
+    OS_Error_t err = OS_SUCCESS;
+
+    // The digest object lives as long as the keystore instance, as creating
+    // and freeing it for every key costs two additional calls into the Crypto
+    // API. OS_CryptoDigest_finalize() resets it for the next use.
+    if (NULL == self->hDigest)
+    {
+        OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+        err = OS_CryptoDigest_init(
+                  &self->hDigest,
+                  self->hCrypto,
+                  OS_CryptoDigest_ALG_SHA256);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: OS_CryptoDigest_init() failed with error code %d!",
+                            __func__, err);
+            self->hDigest = NULL;
+            return err;
+        }
     }
 
-    err = OS_CryptoDigest_process(hDigest, keyData, keyDataSize);
+    OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+    err = OS_CryptoDigest_process(self->hDigest, keyData, keyDataSize);
 
     if (err != OS_SUCCESS)
     {
@@ -97,7 +437,8 @@ createKeyHash(
     }
 
     size_t digestSize = KEY_HASH_SIZE;
-    err = OS_CryptoDigest_finalize(hDigest, output, &digestSize);
+    OS_Keystore_STATS_COUNT_IO(&self->parent, OS_Keystore_IO_DIGEST, 0);
+    err = OS_CryptoDigest_finalize(self->hDigest, output, &digestSize);
 
     if (err != OS_SUCCESS)
     {
@@ -106,46 +447,155 @@ createKeyHash(
         goto ERR_DESTRUCT;
     }
 
+    return OS_SUCCESS;
+
 ERR_DESTRUCT:
-    OS_CryptoDigest_free(hDigest);
+    // The state of the digest object is unknown now, so start over with a
+    // fresh one next time.
+    OS_CryptoDigest_free(self->hDigest);
+    self->hDigest = NULL;
+
+    return err;
+}
+
+static OS_Error_t
+createKeyHash(
+    OS_KeystoreFile_t* self,
+    const void*        keyData,
+    size_t             keyDataSize,
+    void*              output)
+{
+    OS_Error_t err;
+    StreamDigest digest;
+
+    // Loads run in parallel, a load that finds the digest object of the
+    // instance in use hashes with a digest object of its own.
+    if (!atomic_flag_test_and_set_explicit(&self->digestBusy,
+                                           memory_order_acquire))
+    {
+        err = hashWithInstanceDigest(self, keyData, keyDataSize, output);
+        atomic_flag_clear_explicit(&self->digestBusy, memory_order_release);
+
+        return err;
+    }
+
+    if ((err = digest_init(self, &digest)) != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    if ((err = digest_process(self, &digest, keyData, keyDataSize))
+        == OS_SUCCESS)
+    {
+        err = digest_finalize(self, &digest, output);
+    }
+
+    digest_free(self, &digest);
 
-ERR_EXIT:
     return err;
 }
 
+#endif /* OS_KEYSTORE_FILE_LOCAL_DIGEST */
+
 static void
 getFileName(
-    const char*  instName,
-    const char*  keyName,
-    const size_t sz,
-    char*        fileName)
+    OS_KeystoreFile_t const*    self,
+    const char*                 keyName,
+    const size_t                sz,
+    char*                       fileName)
+{
+    if ('\0' == self->directory[0])
+    {
+        // Create file name in the format "<instancename>_<keyname>.key".
+        snprintf(fileName, sz, "%s_%s.key", self->name, keyName);
+    }
+    else if (0 == self->numShards)
+    {
+        // Create file name in the format "<directory>/<keyname>.key".
+        snprintf(fileName, sz, "%s/%s.key", self->directory, keyName);
+    }
+    else
+    {
+        OS_KeystoreFile_KeyName name;
+
+        memset(&name, 0, sizeof(name));
+        strncpy(name.buffer, keyName, sizeof(name.buffer) - 1);
+
+        // Create file name in the format "<directory>/<shard>/<keyname>.key",
+        // where the shard is selected by the hash of the key name.
+        snprintf(fileName, sz, "%s/%02x/%s.key", self->directory,
+                 OS_KeystoreFile_KeyName_getHash(&name) % self->numShards,
+                 keyName);
+    }
+}
+
+static void
+record_serializeHeader(
+    void*       record,
+    const void* keyDataHash,
+    size_t      keySize)
+{
+    uint8_t* p = record;
+
+    BitConverter_putUint32BE(RECORD_MAGIC, &p[RECORD_OFFS_MAGIC]);
+    p[RECORD_OFFS_VERSION]      = RECORD_VERSION;
+    p[RECORD_OFFS_FLAGS]        = RECORD_FLAGS_NONE;
+    p[RECORD_OFFS_RESERVED]     = 0;
+    p[RECORD_OFFS_RESERVED + 1] = 0;
+    BitConverter_putUint32BE((uint32_t) keySize, &p[RECORD_OFFS_KEY_SIZE]);
+    memcpy(&p[RECORD_OFFS_HASH], keyDataHash, KEY_HASH_SIZE);
+}
+
+static size_t
+record_serialize(
+    void*       record,
+    const void* keyData,
+    const void* keyDataHash,
+    size_t      keySize)
+{
+    uint8_t* p = record;
+
+    record_serializeHeader(record, keyDataHash, keySize);
+    memcpy(&p[OS_KeystoreFile_RECORD_HEADER_SIZE], keyData, keySize);
+
+    return OS_KeystoreFile_RECORD_HEADER_SIZE + keySize;
+}
+
+static bool
+record_parse(
+    const void*     record,
+    RecordHeader*   header)
 {
-    // Todo: Eventually we would like to have each instance have its own
-    //       directory, but right now we don't support that.
+    const uint8_t* p = record;
 
-    // Create file name in the format "<instancename>_<keyname>.key".
-    snprintf(fileName, sz, "%s_%s.key", instName, keyName);
+    header->magic   = BitConverter_getUint32BE(&p[RECORD_OFFS_MAGIC]);
+    header->version = p[RECORD_OFFS_VERSION];
+    header->flags   = p[RECORD_OFFS_FLAGS];
+    header->keySize = BitConverter_getUint32BE(&p[RECORD_OFFS_KEY_SIZE]);
+    memcpy(header->hash, &p[RECORD_OFFS_HASH], sizeof(header->hash));
+
+    return (RECORD_MAGIC == header->magic) && (RECORD_VERSION == header->version);
 }
 
 static OS_Error_t
 fs_writeKey(
-    OS_FileSystem_Handle_t hFs,
+    OS_KeystoreFile_t*     self,
     const void*            keyData,
     const void*            keyDataHash,
     size_t                 keySize,
-    const char*            instName,
     const char*            keyName)
 {
-    uint8_t keySizeBuffer[KEY_LEN_SIZE];
     OS_Error_t err = OS_SUCCESS;
+    OS_KeystoreFile_Fs const* fs = &self->fs;
+    void* record = self->record;
     OS_FileSystemFile_Handle_t hFile;
     char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
-    size_t offs;
+    size_t recordSize;
 
-    getFileName(instName, keyName, sizeof(fileName), fileName);
+    getFileName(self, keyName, sizeof(fileName), fileName);
 
-    err = OS_FileSystemFile_open(
-              hFs,
+    err = OS_KeystoreFile_Fs_open(
+              fs,
               &hFile,
               fileName,
               OS_FileSystem_OpenMode_RDWR,
@@ -158,81 +608,103 @@ fs_writeKey(
         return OS_ERROR_OPERATION_DENIED;
     }
 
-    err  = OS_ERROR_OPERATION_DENIED;
-    offs = 0;
+    // Header and key data go into the file with a single write, so every key
+    // costs exactly one write request on the FileSystem.
+    recordSize = record_serialize(record, keyData, keyDataHash, keySize);
 
-    err = OS_FileSystemFile_write(
-              hFs,
-              hFile,
-              offs,
-              KEY_HASH_SIZE,
-              keyDataHash);
+    OS_Error_t writeErr = OS_KeystoreFile_Fs_write(
+                              fs,
+                              hFile,
+                              0,
+                              recordSize,
+                              record);
 
-    if (err != OS_SUCCESS)
+    if (writeErr != OS_SUCCESS)
     {
         Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
-                        fileName, err);
-        goto err0;
+                        fileName, writeErr);
     }
 
-    offs += KEY_HASH_SIZE;
-
-    BitConverter_putUint32BE((uint32_t) keySize, keySizeBuffer);
-
-    err = OS_FileSystemFile_write(
-              hFs,
-              hFile,
-              offs,
-              KEY_LEN_SIZE,
-              keySizeBuffer);
-
-    if (err != OS_SUCCESS)
+    if ((err = OS_KeystoreFile_Fs_close(fs, hFile)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
+        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
                         fileName, err);
-        goto err0;
     }
 
-    offs += KEY_LEN_SIZE;
+    return (writeErr != OS_SUCCESS) ? writeErr : err;
+}
+
+static OS_Error_t
+fs_readLegacyRecord(
+    OS_KeystoreFile_Fs const*   fs,
+    OS_FileSystemFile_Handle_t  hFile,
+    void*                       keyData,
+    void*                       keyDataHash,
+    size_t                      keySize,
+    const char*                 fileName,
+    void*                       record,
+    bool                        isRead)
+{
+    OS_Error_t err;
+    const uint8_t* p = record;
 
-    if ((err = OS_FileSystemFile_write(hFs, hFile, offs,
-                                       keySize,
-                                       keyData)) != OS_SUCCESS)
+    // Files written before the introduction of the record header consist of
+    // the hash, the key size and the key data. As they are shorter than a
+    // record with header, the first read may have failed at the end of file.
+    if (!isRead)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
-                        fileName, err);
-        goto err0;
+        err = OS_KeystoreFile_Fs_read(
+                  fs,
+                  hFile,
+                  0,
+                  LEGACY_HEADER_SIZE + keySize,
+                  record);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+                            fileName, err);
+            return err;
+        }
     }
 
-err0:
-    if ((err = OS_FileSystemFile_close(hFs, hFile)) != OS_SUCCESS)
+    size_t realKeySize = BitConverter_getUint32BE(&p[KEY_HASH_SIZE]);
+
+    if (realKeySize != keySize)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
-                        fileName, err);
+        Debug_LOG_ERROR("Key size in map (%zu bytes) does not match the size of "
+                        "the key data (%zu bytes) found in '%s'",
+                        keySize, realKeySize, fileName);
+        return OS_ERROR_OPERATION_DENIED;
     }
 
-    return err;
+    memcpy(keyDataHash, p, KEY_HASH_SIZE);
+    memcpy(keyData, &p[LEGACY_HEADER_SIZE], keySize);
+
+    return OS_SUCCESS;
 }
 
+// The record is read into the given buffer, which has to hold the record
+// header and the key data.
 static OS_Error_t
 fs_readKey(
-    OS_FileSystem_Handle_t hFs,
+    OS_KeystoreFile_t*     self,
     void*                  keyData,
     void*                  keyDataHash,
     size_t                 keySize,
-    const char*            instName,
-    const char*            keyName)
+    const char*            keyName,
+    void*                  record)
 {
-    uint8_t keySizeBuffer[KEY_LEN_SIZE];
     OS_Error_t err = OS_SUCCESS;
+    OS_KeystoreFile_Fs const* fs = &self->fs;
     OS_FileSystemFile_Handle_t hFile;
+    RecordHeader header;
     char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
-    size_t offs, realKeySize;
 
-    getFileName(instName, keyName, sizeof(fileName), fileName);
+    getFileName(self, keyName, sizeof(fileName), fileName);
 
-    err = OS_FileSystemFile_open(
-              hFs,
+    err = OS_KeystoreFile_Fs_open(
+              fs,
               &hFile,
               fileName,
               OS_FileSystem_OpenMode_RDONLY,
@@ -245,587 +717,3380 @@ fs_readKey(
         return OS_ERROR_OPERATION_DENIED;
     }
 
-    err  = OS_ERROR_OPERATION_DENIED;
-    offs = 0;
+    // Header and key data are fetched with a single read.
+    OS_Error_t readErr = OS_KeystoreFile_Fs_read(
+                             fs,
+                             hFile,
+                             0,
+                             OS_KeystoreFile_RECORD_HEADER_SIZE + keySize,
+                             record);
 
-    err = OS_FileSystemFile_read(
-              hFs,
-              hFile,
-              offs,
-              KEY_HASH_SIZE,
-              keyDataHash);
+    if (readErr == OS_SUCCESS && record_parse(record, &header))
+    {
+        if (header.keySize != keySize)
+        {
+            Debug_LOG_ERROR("Key size in map (%zu bytes) does not match the size of "
+                            "the key data (%zu bytes) found in '%s'",
+                            keySize, (size_t) header.keySize, fileName);
+            readErr = OS_ERROR_OPERATION_DENIED;
+        }
+        else
+        {
+            memcpy(keyDataHash, header.hash, KEY_HASH_SIZE);
+            memcpy(keyData,
+                   (uint8_t*) record + OS_KeystoreFile_RECORD_HEADER_SIZE,
+                   keySize);
+        }
+    }
+    else
+    {
+        readErr = fs_readLegacyRecord(
+                      fs,
+                      hFile,
+                      keyData,
+                      keyDataHash,
+                      keySize,
+                      fileName,
+                      record,
+                      (OS_SUCCESS == readErr));
+    }
 
-    if (err != OS_SUCCESS)
+    if ((err = OS_KeystoreFile_Fs_close(fs, hFile)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
                         fileName, err);
-        goto err0;
     }
 
-    offs += KEY_HASH_SIZE;
+    return (readErr != OS_SUCCESS) ? readErr : err;
+}
+
+static OS_Error_t
+fs_deleteKey(
+    OS_KeystoreFile_t const*    self,
+    const char*                 keyName)
+{
+    OS_Error_t err;
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
 
-    err = OS_FileSystemFile_read(
-              hFs,
-              hFile,
-              offs,
-              KEY_LEN_SIZE,
-              keySizeBuffer);
+    getFileName(self, keyName, sizeof(fileName), fileName);
 
-    if (err != OS_SUCCESS)
+    if ((err = OS_KeystoreFile_Fs_delete(&self->fs, fileName)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+        Debug_LOG_ERROR("OS_FileSystemFile_delete() failed on '%s' with %d",
                         fileName, err);
-        goto err0;
     }
 
-    realKeySize = BitConverter_getUint32BE(keySizeBuffer);
+    return err;
+}
 
-    if (realKeySize != keySize)
-    {
-        Debug_LOG_ERROR("Key size in map (%zu bytes) does not match the size of "
-                        "the key data (%zu bytes) found in '%s'",
-                        keySize, realKeySize, fileName);
-        goto err0;
-    }
+static OS_Error_t
+fs_copyKey(
+    OS_KeystoreFile_t*              self,
+    OS_KeystoreFile_t*              dst,
+    const char*                     keyName,
+    OS_KeystoreFile_KeyInfo const*  info)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_Fs const* fs = &self->fs;
+    OS_FileSystemFile_Handle_t hSrc;
+    OS_FileSystemFile_Handle_t hDst;
+    RecordHeader header;
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+    size_t recordSize = OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize;
+    size_t len;
 
-    offs += KEY_LEN_SIZE;
+    getFileName(self, keyName, sizeof(fileName), fileName);
 
-    err = OS_FileSystemFile_read(
-              hFs,
-              hFile,
-              offs,
-              keySize,
-              keyData);
+    err = OS_KeystoreFile_Fs_open(
+              fs,
+              &hSrc,
+              fileName,
+              OS_FileSystem_OpenMode_RDONLY,
+              OS_FileSystem_OpenFlags_NONE);
 
     if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
                         fileName, err);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
+    // The key does not fit into the buffers, so the file is copied piece by
+    // piece as it is. Only the header is checked against the index, as with
+    // the smaller keys.
+    err = OS_KeystoreFile_Fs_read(fs, hSrc, 0,
+                                  OS_KeystoreFile_RECORD_HEADER_SIZE,
+                                  self->record);
+
+    if ((OS_SUCCESS == err)
+        && (!record_parse(self->record, &header)
+            || (header.keySize != info->keySize)
+            || (memcmp(header.hash, info->hash, KEY_HASH_SIZE) != 0)))
+    {
+        OS_Keystore_STATS_COUNT_HASH_MISMATCH(&self->parent);
+        Debug_LOG_ERROR("%s: The key is corrupted - hash value does not correspond to the index!",
+                        __func__);
+        err = OS_ERROR_GENERIC;
+    }
+
+    if (err != OS_SUCCESS)
+    {
         goto err0;
     }
 
-err0:
-    if ((err = OS_FileSystemFile_close(hFs, hFile)) != OS_SUCCESS)
+    getFileName(dst, keyName, sizeof(fileName), fileName);
+
+    err = OS_KeystoreFile_Fs_open(
+              &dst->fs,
+              &hDst,
+              fileName,
+              OS_FileSystem_OpenMode_RDWR,
+              OS_FileSystem_OpenFlags_CREATE);
+
+    if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
                         fileName, err);
+        err = OS_ERROR_OPERATION_DENIED;
+        goto err0;
     }
 
-    return err;
-}
+    for (size_t pos = 0; (OS_SUCCESS == err) && (pos < recordSize); pos += len)
+    {
+        len = recordSize - pos;
+        if (len > sizeof(self->record))
+        {
+            len = sizeof(self->record);
+        }
 
-static OS_Error_t
-fs_deleteKey(
-    OS_FileSystem_Handle_t hFs,
-    const char*            instName,
-    const char*            keyName)
-{
-    OS_Error_t err;
-    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+        err = OS_KeystoreFile_Fs_read(fs, hSrc, pos, len, self->record);
+        if (OS_SUCCESS == err)
+        {
+            err = OS_KeystoreFile_Fs_write(&dst->fs, hDst, pos, len,
+                                           self->record);
+        }
+    }
 
-    getFileName(instName, keyName, sizeof(fileName), fileName);
+    OS_Error_t closeErr = OS_KeystoreFile_Fs_close(&dst->fs, hDst);
 
-    if ((err = OS_FileSystemFile_delete(hFs, fileName)) != OS_SUCCESS)
+    if (OS_SUCCESS == err)
     {
-        Debug_LOG_ERROR("OS_FileSystemFile_delete() failed on '%s' with %d",
+        err = closeErr;
+    }
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Copying the key into '%s' failed with %d",
                         fileName, err);
+        OS_KeystoreFile_Fs_delete(&dst->fs, fileName);
     }
 
+err0:
+    OS_KeystoreFile_Fs_close(fs, hSrc);
+
     return err;
 }
 
-static OS_Error_t
-map_registerKey(
+static void
+keyName_init(
+    OS_KeystoreFile_KeyName*    keyName,
+    const char*                 name)
+{
+    // Zero padding keeps the unused part of the name deterministic, as the
+    // whole buffer is written into the index file.
+    memset(keyName->buffer, 0, sizeof(keyName->buffer));
+    memcpy(keyName->buffer, name, strnlen(name, sizeof(keyName->buffer) - 1));
+}
+
+static void
+map_lookupIn(
+    OS_KeystoreFile_KeyNameMap const*   map,
+    const char*                         name,
+    KeyLookup*                          lookup)
+{
+    keyName_init(&lookup->name, name);
+    lookup->hash = OS_KeystoreFile_KeyName_getHash(&lookup->name);
+    lookup->slot = OS_KeystoreFile_KeyNameMap_find(
+                       map,
+                       &lookup->name,
+                       lookup->hash);
+}
+
+static inline void
+map_lookup(
     OS_KeystoreFile_t*  self,
     const char*         name,
-    size_t              keySize)
+    KeyLookup*          lookup)
 {
-    OS_KeystoreFile_KeyName keyName;
+    map_lookupIn(&self->keyNameMap, name, lookup);
+}
+
+static inline bool
+map_checkKeyExists(
+    KeyLookup const*    lookup)
+{
+    return (lookup->slot >= 0);
+}
 
-    strncpy(keyName.buffer, name, sizeof(keyName.buffer) - 1);
-    keyName.buffer[sizeof(keyName.buffer) - 1] = '\0';
+static inline OS_KeystoreFile_KeyInfo const*
+map_getKeyInfo(
+    OS_KeystoreFile_t*  self,
+    KeyLookup const*    lookup)
+{
+    return OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, lookup->slot);
+}
 
+static OS_Error_t
+map_registerKey(
+    OS_KeystoreFile_t*              self,
+    KeyLookup*                      lookup,
+    OS_KeystoreFile_KeyInfo const*  keyInfo)
+{
     if (!OS_KeystoreFile_KeyNameMap_insert(
             &self->keyNameMap,
-            &keyName,
-            &keySize))
+            &lookup->name,
+            lookup->hash,
+            keyInfo))
     {
         Debug_LOG_ERROR("%s: Failed to save the key name!", __func__);
         return OS_ERROR_INSUFFICIENT_SPACE;
     }
 
+    // Inserting may have moved other keys, the slot has to be looked up again
+    // when it is needed.
+    lookup->slot = -1;
+    self->isSnapshotOutdated = true;
+
     return OS_SUCCESS;
 }
 
-static bool
-map_checkKeyExists(
+static void
+map_deregisterKey(
     OS_KeystoreFile_t*  self,
-    const char*         name)
+    KeyLookup*          lookup)
 {
-    OS_KeystoreFile_KeyName keyName;
+    OS_KeystoreFile_KeyNameMap_removeAt(&self->keyNameMap, lookup->slot);
+    lookup->slot = -1;
+    self->isSnapshotOutdated = true;
+}
 
-    strncpy(keyName.buffer, name, sizeof(keyName.buffer) - 1);
-    keyName.buffer[sizeof(keyName.buffer) - 1] = '\0';
+static void
+map_setKeyInfo(
+    OS_KeystoreFile_t*              self,
+    int                             slot,
+    OS_KeystoreFile_KeyInfo const*  keyInfo)
+{
+    OS_KeystoreFile_KeyNameMap_setValueAt(&self->keyNameMap, slot, keyInfo);
+    self->isSnapshotOutdated = true;
+}
 
-    return OS_KeystoreFile_KeyNameMap_getIndexOf(&self->keyNameMap, &keyName)
-           >= 0 ? true : false;
+static void
+map_clear(
+    OS_KeystoreFile_t*  self)
+{
+    OS_KeystoreFile_KeyNameMap_clear(&self->keyNameMap);
+    self->isSnapshotOutdated = true;
 }
 
-static size_t
-map_getKeySize(
+static OS_KeystoreFile_KeyNameMap const*
+snapshot_copy(
+    OS_KeystoreFile_t*                  self,
+    OS_KeystoreFile_KeyNameMap const*   current)
+{
+    // The spare snapshot is not used by any reader, snapshot_publish() waited
+    // for them when it was replaced.
+    OS_KeystoreFile_KeyNameMap* next = (current == &self->snapshots[0]) ?
+                                       &self->snapshots[1] :
+                                       &self->snapshots[0];
+
+    if (!OS_KeystoreFile_KeyNameMap_assign(next, &self->keyNameMap))
+    {
+        Debug_LOG_WARNING("%s: Failed to copy the key names, reads take the "
+                          "lock until the next change!", __func__);
+        return &self->keyNameMap;
+    }
+
+    return next;
+}
+
+static OS_KeystoreFile_KeyNameMap const*
+snapshot_enter(
     OS_KeystoreFile_t*  self,
-    const char*         name)
+    unsigned int*       epoch)
 {
-    int keyIndex;
+    // Count this reader in the current epoch before the snapshot is fetched,
+    // so a writer that publishes a new snapshot afterwards waits for it, see
+    // snapshot_publish().
+    *epoch = atomic_load(&self->epoch) & 1;
+    atomic_fetch_add(&self->readers[*epoch], 1);
+
+    OS_KeystoreFile_KeyNameMap const* map = atomic_load(&self->snapshot);
 
-    keyIndex = OS_KeystoreFile_KeyNameMap_getIndexOf(
-                   &self->keyNameMap,
-                   (OS_KeystoreFile_KeyName*) name);
+    if (map != &self->keyNameMap)
+    {
+        return map;
+    }
 
-    if (keyIndex < 0)
+    // Without a copy the map of the writers is read under the lock. A reader
+    // that waits for the lock must not hold up a writer that waits for the
+    // readers, so it does not count as one.
+    atomic_fetch_sub(&self->readers[*epoch], 1);
+    OS_Keystore_lockShared(&self->parent);
+
+    // The first reader after a lock has been set publishes a copy for the
+    // following ones, the writers are held off by the lock.
+    if ((NULL != self->parent.lock.lockWrite)
+        && !atomic_flag_test_and_set(&self->snapshotBusy))
     {
-        return 0;
+        if (atomic_load(&self->snapshot) == &self->keyNameMap)
+        {
+            atomic_store(&self->snapshot, snapshot_copy(self, map));
+        }
+        atomic_flag_clear(&self->snapshotBusy);
     }
 
-    return *OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, keyIndex);
+    return map;
 }
 
-static OS_Error_t
-map_deregisterKey(
-    OS_KeystoreFile_t*  self,
-    const char*         name)
+static void
+snapshot_leave(
+    OS_KeystoreFile_t*                  self,
+    OS_KeystoreFile_KeyNameMap const*   map,
+    unsigned int                        epoch)
+{
+    if (map == &self->keyNameMap)
+    {
+        OS_Keystore_unlockShared(&self->parent);
+    }
+    else
+    {
+        atomic_fetch_sub(&self->readers[epoch], 1);
+    }
+}
+
+static void
+snapshot_publish(
+    OS_KeystoreFile_t*  self)
 {
-    OS_KeystoreFile_KeyName keyName;
+    OS_KeystoreFile_KeyNameMap const* current = atomic_load(&self->snapshot);
+
+    // Called by the writers when they are done, they are serialized.
+    if (!self->isSnapshotOutdated)
+    {
+        return;
+    }
+    self->isSnapshotOutdated = false;
 
-    strncpy(keyName.buffer, name, sizeof(keyName.buffer) - 1);
-    keyName.buffer[sizeof(keyName.buffer) - 1] = '\0';
+    // Without a lock the handle is not shared, so the readers can use the map
+    // of the writers.
+    OS_KeystoreFile_KeyNameMap const* next =
+        (NULL == self->parent.lock.lockWrite) ?
+        &self->keyNameMap : snapshot_copy(self, current);
 
-    if (!OS_KeystoreFile_KeyNameMap_remove(&self->keyNameMap, &keyName))
+    if (next == current)
     {
-        Debug_LOG_ERROR("%s: Failed to remove the key name!", __func__);
-        return OS_ERROR_ABORTED;
+        return;
     }
 
-    return OS_SUCCESS;
+    atomic_store(&self->snapshot, next);
+
+    // Wait until the readers of the previous snapshot are done. Readers that
+    // fetched the epoch just before it is advanced may still count themselves
+    // in the previous epoch, so both epochs are drained one after the other.
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        unsigned int epoch = atomic_fetch_add(&self->epoch, 1) & 1;
+
+        for (unsigned int spins = 1; atomic_load(&self->readers[epoch]) > 0;
+             spins++)
+        {
+            // Readers only look up a key and copy it from the cache, so this
+            // is short unless a reader was preempted. Then it needs the CPU
+            // to get done.
+            if (spins >= MAX_SPINS)
+            {
+                OS_Keystore_yield(&self->parent);
+                spins = 0;
+            }
+        }
+    }
 }
 
-static inline bool
-isStoreKeyParametersOk(
+static KeyStream*
+stream_findStore(
     OS_KeystoreFile_t*  self,
-    const char*         name,
-    void const*         keyData,
-    size_t              keySize)
+    KeyLookup const*    lookup)
 {
-    if (NULL == self || NULL == keyData || NULL == name)
+    // A store that has been started but not committed yet holds on to its
+    // name, so no other key can be stored with it in the meantime.
+    for (KeyStream* stream = self->streams; NULL != stream;
+         stream = stream->next)
     {
-        return false;
+        if (stream->isStore && (stream->lookup.hash == lookup->hash)
+            && (memcmp(&stream->lookup.name, &lookup->name,
+                       sizeof(lookup->name)) == 0))
+        {
+            return stream;
+        }
     }
 
-    size_t nameLen = strlen(name);
+    return NULL;
+}
 
-    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+static bool
+index_replayEntry(
+    void*                                   ctx,
+    OS_KeystoreFile_IndexFile_Entry const*  entry)
+{
+    ReplayState* state = (ReplayState*) ctx;
+    OS_KeystoreFile_t* self = state->self;
+    KeyLookup lookup;
+
+    map_lookup(self, entry->name.buffer, &lookup);
+
+    if (OS_KeystoreFile_IndexFile_OP_INTENT == entry->op)
     {
-        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
-                        __func__,
-                        nameLen,
-                        OS_KeystoreFile_KeyName_MAX_NAME_LEN);
-        return false;
+        if (!state->hasPending)
+        {
+            if (!OS_KeystoreFile_KeyNameMap_ctor(&state->pending, 0))
+            {
+                return false;
+            }
+            state->hasPending = true;
+        }
+
+        // Whether the store has been completed is only known at the end.
+        return (OS_KeystoreFile_KeyNameMap_find(&state->pending, &lookup.name,
+                                                lookup.hash) >= 0)
+               || OS_KeystoreFile_KeyNameMap_insert(&state->pending,
+                                                    &lookup.name,
+                                                    lookup.hash,
+                                                    &entry->info);
     }
 
-    if (keySize > OS_KeystoreFile_MAX_KEY_SIZE || keySize == 0)
+    if (entry->info.segment > OS_KeystoreFile_PackFile_MAX_SEGMENTS)
     {
-        Debug_LOG_ERROR("%s: The length of the passed key data %zu is invalid, must be in the range [1;%d]!",
-                        __func__, keySize, OS_KeystoreFile_MAX_KEY_SIZE);
+        Debug_LOG_ERROR("%s: Invalid segment %u for key '%s'", __func__,
+                        (unsigned int) entry->info.segment, entry->name.buffer);
         return false;
     }
 
-    if (map_checkKeyExists(self, name))
+    // A key may show up several times in the journal, the last entry wins.
+    if (map_checkKeyExists(&lookup))
     {
-        Debug_LOG_ERROR("%s: The key with the name %s already exists!",
-                        __func__, name);
-        return false;
+        map_deregisterKey(self, &lookup);
+    }
+
+    if (OS_KeystoreFile_IndexFile_OP_ADD == entry->op)
+    {
+        return (map_registerKey(self, &lookup, &entry->info) == OS_SUCCESS);
     }
 
     return true;
 }
 
-static inline bool
-isLoadKeyParametersOk(
-    OS_KeystoreFile_t*  self,
-    const char*         name,
-    void*               keyData,
-    size_t*             keySize)
+static bool
+index_getEntry(
+    void*                               ctx,
+    size_t                              i,
+    OS_KeystoreFile_IndexFile_Entry*    entry)
 {
-    if (NULL == self || NULL == keySize || NULL == keyData || NULL == name)
+    SnapshotCursor* cursor = (SnapshotCursor*) ctx;
+    OS_KeystoreFile_KeyNameMap const* map = cursor->map;
+
+    // Entries are produced in cursor order. They are requested in ascending
+    // order, so the cursor just moves on to the next used slot and i is not
+    // needed.
+    (void) i;
+
+    cursor->slot = OS_KeystoreFile_KeyNameMap_getNext(map, cursor->slot + 1);
+
+    if (cursor->slot < 0)
     {
         return false;
     }
 
-    size_t nameLen = strlen(name);
+    entry->name = *OS_KeystoreFile_KeyNameMap_getKeyAt(map, cursor->slot);
+    entry->info = *OS_KeystoreFile_KeyNameMap_getValueAt(map, cursor->slot);
 
-    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+    return true;
+}
+
+static void
+index_compact(
+    OS_KeystoreFile_t* self)
+{
+    size_t numKeys = OS_KeystoreFile_KeyNameMap_getSize(&self->keyNameMap);
+    SnapshotCursor cursor = { .map = &self->keyNameMap, .slot = -1 };
+
+    // The journal is still intact if this fails, so it is only worth a warning.
+    OS_Error_t err = OS_KeystoreFile_IndexFile_rewrite(
+                         &self->indexFile,
+                         index_getEntry,
+                         &cursor,
+                         numKeys);
+    if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
-                        __func__, nameLen, OS_KeystoreFile_KeyName_MAX_NAME_LEN);
-        return false;
+        Debug_LOG_WARNING("%s: Compacting the index file failed, err %d!",
+                          __func__, err);
     }
+}
 
-    size_t my_keysize = *keySize;
+static void
+index_compactIfNeeded(
+    OS_KeystoreFile_t* self)
+{
+    size_t numKeys = OS_KeystoreFile_KeyNameMap_getSize(&self->keyNameMap);
 
-    if (my_keysize > OS_KeystoreFile_MAX_KEY_SIZE)
+    if (OS_KeystoreFile_IndexFile_needsCompaction(&self->indexFile, numKeys))
     {
-        Debug_LOG_ERROR("%s: The length of the passed key data %zu is invalid, must be in the range [1;%d]!",
-                        __func__, my_keysize, OS_KeystoreFile_MAX_KEY_SIZE);
-        return false;
+        index_compact(self);
     }
+}
 
-    return true;
+static void
+index_recoverPending(
+    OS_KeystoreFile_t*                  self,
+    OS_KeystoreFile_KeyNameMap const*   pending)
+{
+    bool hasOrphans = false;
+    bool isClean    = true;
+
+    // A key announced by an INTENT entry without being stored afterwards
+    // belongs to a store that has been interrupted, e.g. by a power loss. Its
+    // file may be incomplete and is not part of the keystore, so remove it.
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(pending, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(pending, slot + 1))
+    {
+        OS_KeystoreFile_KeyName const* keyName =
+            OS_KeystoreFile_KeyNameMap_getKeyAt(pending, slot);
+
+        if (OS_KeystoreFile_KeyNameMap_find(
+                &self->keyNameMap,
+                keyName,
+                OS_KeystoreFile_KeyNameMap_getHashAt(pending, slot)) >= 0)
+        {
+            continue;
+        }
+
+        char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1];
+
+        getFileName(self, keyName->buffer, sizeof(fileName), fileName);
+        hasOrphans = true;
+
+        // The store may have failed before the file was created.
+        OS_Error_t err = OS_KeystoreFile_Fs_delete(&self->fs, fileName);
+        if (OS_SUCCESS == err)
+        {
+            Debug_LOG_INFO("%s: Removed '%s' of an interrupted store",
+                           __func__, fileName);
+        }
+        else if (err != OS_ERROR_FS_FILE_NOT_FOUND)
+        {
+            Debug_LOG_ERROR("%s: Failed to remove '%s', err %d!",
+                            __func__, fileName, err);
+            isClean = false;
+        }
+    }
+
+    // Without the INTENT entries, the next start does not need to look at the
+    // files again.
+    if (hasOrphans && isClean)
+    {
+        index_compact(self);
+    }
+}
+
+static void
+index_appendOrphans(
+    OS_KeystoreFile_t*                  self,
+    OS_KeystoreFile_KeyNameMap const*   orphans)
+{
+    OS_KeystoreFile_IndexFile_Entry entries[16];
+    size_t numEntries = 0;
+
+    // The files of the orphans are announced like those of an interrupted
+    // store, so the next start removes them, see index_recoverPending().
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(orphans, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(orphans, slot + 1))
+    {
+        memset(&entries[numEntries], 0, sizeof(entries[numEntries]));
+        entries[numEntries].op   = OS_KeystoreFile_IndexFile_OP_INTENT;
+        entries[numEntries].name =
+            *OS_KeystoreFile_KeyNameMap_getKeyAt(orphans, slot);
+        numEntries++;
+
+        if (numEntries == (sizeof(entries) / sizeof(entries[0])))
+        {
+            OS_KeystoreFile_IndexFile_append(&self->indexFile, entries,
+                                             numEntries);
+            numEntries = 0;
+        }
+    }
+
+    if (numEntries > 0)
+    {
+        OS_KeystoreFile_IndexFile_append(&self->indexFile, entries, numEntries);
+    }
 }
 
 static OS_Error_t
-ctor(
-    OS_KeystoreFile_t*     self,
-    OS_FileSystem_Handle_t hFs,
-    OS_Crypto_Handle_t     hCrypto,
-    const char*            name)
+pack_readKey(
+    OS_KeystoreFile_t*              self,
+    OS_KeystoreFile_KeyInfo const*  info,
+    void*                           keyData,
+    void*                           keyDataHash,
+    unsigned char*                  record)
 {
-    if (NULL == self || NULL == hFs || NULL == name)
+    OS_Error_t err;
+    RecordHeader header;
+
+    // The index knows where the record is, so it is fetched with a single read
+    // from the segment file, which is already open.
+    err = OS_KeystoreFile_PackFile_read(
+              &self->packFile,
+              info->segment,
+              info->offset,
+              record,
+              OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize);
+
+    if (err != OS_SUCCESS)
     {
-        return OS_ERROR_INVALID_PARAMETER;
+        return err;
     }
-    else if (strlen(name) > OS_KeystoreFile_MAX_INSTANCE_NAME_LEN)
+
+    if (!record_parse(record, &header) || (header.keySize != info->keySize))
     {
-        return OS_ERROR_INVALID_PARAMETER;
+        Debug_LOG_ERROR("%s: No valid record of %zu bytes at offset %u of segment %u",
+                        __func__, info->keySize, (unsigned int) info->offset,
+                        (unsigned int) info->segment);
+        return OS_ERROR_OPERATION_DENIED;
     }
 
-    memset(self, 0, sizeof(OS_KeystoreFile_t));
+    memcpy(keyDataHash, header.hash, KEY_HASH_SIZE);
+    memcpy(keyData, &record[OS_KeystoreFile_RECORD_HEADER_SIZE],
+           info->keySize);
+
+    return OS_SUCCESS;
+}
+
+static void
+pack_dropMoved(
+    OS_KeystoreFile_t*                      self,
+    OS_KeystoreFile_IndexFile_Entry const*  entries,
+    size_t                                  numEntries)
+{
+    for (size_t i = 0; i < numEntries; i++)
+    {
+        OS_KeystoreFile_PackFile_release(
+            &self->packFile,
+            entries[i].info.segment,
+            OS_KeystoreFile_RECORD_HEADER_SIZE + entries[i].info.keySize);
+    }
+}
+
+static OS_Error_t
+pack_commitMoved(
+    OS_KeystoreFile_t*                      self,
+    OS_KeystoreFile_IndexFile_Entry const*  entries,
+    int const*                              slots,
+    size_t                                  numEntries)
+{
+    OS_Error_t err = OS_KeystoreFile_IndexFile_append(&self->indexFile, entries,
+                                                      numEntries);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+        pack_dropMoved(self, entries, numEntries);
+        return err;
+    }
 
-    if (!OS_KeystoreFile_KeyNameMap_ctor(&self->keyNameMap, 1))
+    for (size_t i = 0; i < numEntries; i++)
+    {
+        OS_KeystoreFile_KeyInfo const* old =
+            OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slots[i]);
+
+        OS_KeystoreFile_PackFile_release(
+            &self->packFile,
+            old->segment,
+            OS_KeystoreFile_RECORD_HEADER_SIZE + old->keySize);
+        map_setKeyInfo(self, slots[i], &entries[i].info);
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+pack_compactSegment(
+    OS_KeystoreFile_t*  self,
+    unsigned int        segment)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_IndexFile_Entry entries[16];
+    int slots[16];
+    size_t numEntries = 0;
+    unsigned int target = OS_KeystoreFile_PackFile_getEmpty(&self->packFile);
+
+    // Copy the live records into the spare segment. The index entries pointing
+    // to the new locations are written before the old segment is deleted, so
+    // an interrupted compaction leaves just some dead records behind.
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, slot + 1))
+    {
+        OS_KeystoreFile_KeyInfo const* info =
+            OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slot);
+        size_t recordSize = OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize;
+
+        if (info->segment != segment)
+        {
+            continue;
+        }
+
+        if (0 == target)
+        {
+            Debug_LOG_ERROR("%s: No empty segment left!", __func__);
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+
+        memset(&entries[numEntries], 0, sizeof(entries[numEntries]));
+        entries[numEntries].op   = OS_KeystoreFile_IndexFile_OP_ADD;
+        entries[numEntries].name =
+            *OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap, slot);
+        entries[numEntries].info = *info;
+
+        // The record is copied as it is, its hash is checked when the key is
+        // loaded.
+        err = OS_KeystoreFile_PackFile_read(&self->packFile, segment,
+                                            info->offset, self->record,
+                                            recordSize);
+        if (OS_SUCCESS == err)
+        {
+            err = OS_KeystoreFile_PackFile_write(
+                      &self->packFile,
+                      target,
+                      self->record,
+                      recordSize,
+                      &entries[numEntries].info.offset);
+        }
+
+        if (err != OS_SUCCESS)
+        {
+            pack_dropMoved(self, entries, numEntries);
+            return err;
+        }
+
+        entries[numEntries].info.segment = target;
+        slots[numEntries] = slot;
+        numEntries++;
+
+        if (numEntries == (sizeof(entries) / sizeof(entries[0])))
+        {
+            if ((err = pack_commitMoved(self, entries, slots, numEntries))
+                != OS_SUCCESS)
+            {
+                return err;
+            }
+            numEntries = 0;
+        }
+    }
+
+    if ((numEntries > 0)
+        && ((err = pack_commitMoved(self, entries, slots, numEntries))
+            != OS_SUCCESS))
+    {
+        return err;
+    }
+
+    index_compactIfNeeded(self);
+
+    return OS_KeystoreFile_PackFile_remove(&self->packFile, segment);
+}
+
+static OS_Error_t
+pack_writeKey(
+    OS_KeystoreFile_t*          self,
+    const void*                 keyData,
+    OS_KeystoreFile_KeyInfo*    info)
+{
+    OS_Error_t err;
+    size_t recordSize = OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize;
+    unsigned int segment = OS_KeystoreFile_PackFile_allocate(&self->packFile,
+                                                             recordSize);
+
+    if (0 == segment)
+    {
+        // Only the spare segment is left, make room by compacting the segment
+        // with the most dead records.
+        unsigned int candidate =
+            OS_KeystoreFile_PackFile_getCompactionCandidate(&self->packFile,
+                                                            true);
+        if (0 == candidate)
+        {
+            Debug_LOG_ERROR("%s: All segments are full!", __func__);
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+
+        if ((err = pack_compactSegment(self, candidate)) != OS_SUCCESS)
+        {
+            return err;
+        }
+
+        segment = OS_KeystoreFile_PackFile_allocate(&self->packFile, recordSize);
+        if (0 == segment)
+        {
+            Debug_LOG_ERROR("%s: All segments are full!", __func__);
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+    }
+
+    // The compaction uses the record buffer too, so the record is serialized
+    // only now.
+    record_serialize(self->record, keyData, info->hash, info->keySize);
+
+    err = OS_KeystoreFile_PackFile_write(
+              &self->packFile,
+              segment,
+              self->record,
+              recordSize,
+              &info->offset);
+
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    info->segment = segment;
+
+    return OS_SUCCESS;
+}
+
+// The key data is either kept in a file of its own or, in pack mode, as a
+// record in one of the segment files. Small keys are packed, larger ones still
+// get their own file.
+static inline bool
+isPackable(
+    OS_KeystoreFile_t const*    self,
+    size_t                      keySize)
+{
+    return (self->packFile.segmentSize > 0)
+           && (keySize <= OS_KeystoreFile_PACK_MAX_KEY_SIZE);
+}
+
+static OS_Error_t
+data_write(
+    OS_KeystoreFile_t*          self,
+    const char*                 keyName,
+    const void*                 keyData,
+    OS_KeystoreFile_KeyInfo*    info)
+{
+    if (isPackable(self, info->keySize))
+    {
+        return pack_writeKey(self, keyData, info);
+    }
+
+    info->segment = 0;
+    info->offset  = 0;
+
+    return fs_writeKey(self, keyData, info->hash, info->keySize, keyName);
+}
+
+// Loads run in parallel, so the caller passes the buffer the record is read
+// into. It has to hold the record header and the key data.
+static OS_Error_t
+data_read(
+    OS_KeystoreFile_t*              self,
+    const char*                     keyName,
+    OS_KeystoreFile_KeyInfo const*  info,
+    void*                           keyData,
+    void*                           keyDataHash,
+    unsigned char*                  record)
+{
+    if (info->segment > 0)
+    {
+        return pack_readKey(self, info, keyData, keyDataHash, record);
+    }
+
+    return fs_readKey(self, keyData, keyDataHash, info->keySize, keyName,
+                      record);
+}
+
+static OS_Error_t
+data_delete(
+    OS_KeystoreFile_t*              self,
+    const char*                     keyName,
+    OS_KeystoreFile_KeyInfo const*  info)
+{
+    if (info->segment > 0)
+    {
+        // The record stays in the segment file until it is compacted.
+        OS_KeystoreFile_PackFile_release(
+            &self->packFile,
+            info->segment,
+            OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize);
+        return OS_SUCCESS;
+    }
+
+    return fs_deleteKey(self, keyName);
+}
+
+static inline bool
+isStoreKeyParametersOk(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    void const*         keyData,
+    size_t              keySize,
+    KeyLookup*          lookup)
+{
+    if (NULL == self || NULL == keyData || NULL == name)
+    {
+        return false;
+    }
+
+    size_t nameLen = strlen(name);
+
+    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
+                        __func__,
+                        nameLen,
+                        OS_KeystoreFile_KeyName_MAX_NAME_LEN);
+        return false;
+    }
+
+    if (keySize > OS_KeystoreFile_MAX_KEY_SIZE || keySize == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key data %zu is invalid, must be in the range [1;%d]!",
+                        __func__, keySize, OS_KeystoreFile_MAX_KEY_SIZE);
+        return false;
+    }
+
+    map_lookup(self, name, lookup);
+
+    if (map_checkKeyExists(lookup) || (NULL != stream_findStore(self, lookup)))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s already exists!",
+                        __func__, name);
+        return false;
+    }
+
+    return true;
+}
+
+static inline bool
+isKeyNameOk(
+    const char* name)
+{
+    if (NULL == name)
+    {
+        return false;
+    }
+
+    size_t nameLen = strlen(name);
+
+    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
+                        __func__,
+                        nameLen,
+                        OS_KeystoreFile_KeyName_MAX_NAME_LEN);
+        return false;
+    }
+
+    return true;
+}
+
+static inline bool
+isLoadKeyParametersOk(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    void*               keyData,
+    size_t*             keySize)
+{
+    if (NULL == self || NULL == keySize || NULL == keyData || NULL == name)
+    {
+        return false;
+    }
+
+    size_t nameLen = strlen(name);
+
+    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
+                        __func__, nameLen, OS_KeystoreFile_KeyName_MAX_NAME_LEN);
+        return false;
+    }
+
+    size_t my_keysize = *keySize;
+
+    if (my_keysize > OS_KeystoreFile_MAX_KEY_SIZE)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key data %zu is invalid, must be in the range [1;%d]!",
+                        __func__, my_keysize, OS_KeystoreFile_MAX_KEY_SIZE);
+        return false;
+    }
+
+    return true;
+}
+
+static OS_Error_t
+getBatchResult(
+    OS_Keystore_KeyItem_t const*    items,
+    size_t                          numItems)
+{
+    for (size_t i = 0; i < numItems; i++)
+    {
+        if (items[i].result != OS_SUCCESS)
+        {
+            return items[i].result;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+writeKeyFile(
+    OS_KeystoreFile_t*                  self,
+    OS_Keystore_KeyItem_t const*        item,
+    OS_KeystoreFile_IndexFile_Entry*    entry)
+{
+    OS_Error_t err;
+    KeyLookup lookup;
+
+    if (!isStoreKeyParametersOk(self, item->name, item->keyData, item->keySize,
+                                &lookup))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->op           = OS_KeystoreFile_IndexFile_OP_ADD;
+    entry->name         = lookup.name;
+    entry->info.keySize = item->keySize;
+
+    err = createKeyHash(
+              self,
+              item->keyData,
+              item->keySize,
+              entry->info.hash);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not hash the key data, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    err = data_write(self, item->name, item->keyData, &entry->info);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not write the key data to the file, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    // Registering the key right away makes a second key with the same name in
+    // the same batch fail as duplicate.
+    err = map_registerKey(self, &lookup, &entry->info);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to register the key name, error code %d!",
+                        __func__, err);
+        data_delete(self, item->name, &entry->info);
+        return err;
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+index_appendIntents(
+    OS_KeystoreFile_t*                  self,
+    OS_Keystore_KeyItem_t const*        items,
+    size_t                              numItems,
+    OS_KeystoreFile_IndexFile_Entry*    entries)
+{
+    size_t numEntries = 0;
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        size_t nameLen = (NULL == items[i].name) ? 0 : strlen(items[i].name);
+
+        // Invalid items fail later without writing anything and an interrupted
+        // write of a packed key just leaves a dead record behind.
+        if ((0 == nameLen) || (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN)
+            || isPackable(self, items[i].keySize))
+        {
+            continue;
+        }
+
+        memset(&entries[numEntries], 0, sizeof(entries[numEntries]));
+        entries[numEntries].op = OS_KeystoreFile_IndexFile_OP_INTENT;
+        keyName_init(&entries[numEntries].name, items[i].name);
+        numEntries++;
+    }
+
+    if (0 == numEntries)
+    {
+        return OS_SUCCESS;
+    }
+
+    return OS_KeystoreFile_IndexFile_append(&self->indexFile, entries,
+                                            numEntries);
+}
+
+static OS_Error_t
+storeKeyBatch(
+    OS_KeystoreFile_t*                  self,
+    OS_Keystore_KeyItem_t*              items,
+    size_t                              numItems,
+    OS_KeystoreFile_IndexFile_Entry*    entries)
+{
+    OS_Error_t err;
+    size_t numEntries = 0;
+
+    // Announce the key files before writing them, so the files of an
+    // interrupted store can be found and removed on the next start.
+    if (self->atomicStore
+        && ((err = index_appendIntents(self, items, numItems, entries))
+            != OS_SUCCESS))
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+
+        for (size_t i = 0; i < numItems; i++)
+        {
+            items[i].result = err;
+        }
+
+        return err;
+    }
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        items[i].result = writeKeyFile(self, &items[i], &entries[numEntries]);
+
+        if (OS_SUCCESS == items[i].result)
+        {
+            numEntries++;
+        }
+    }
+
+    if (0 == numEntries)
+    {
+        return getBatchResult(items, numItems);
+    }
+
+    // A compaction triggered by a later key of the batch may have moved the
+    // records of earlier ones, so take their locations from the map.
+    if (self->packFile.segmentSize > 0)
+    {
+        for (size_t i = 0; i < numEntries; i++)
+        {
+            KeyLookup lookup;
+
+            map_lookup(self, entries[i].name.buffer, &lookup);
+            entries[i].info = *map_getKeyInfo(self, &lookup);
+        }
+    }
+
+    // The index entries are what makes the keys known after a restart, so
+    // they are only written once the key files are complete. All of them go
+    // into the index file with a single append.
+    err = OS_KeystoreFile_IndexFile_append(&self->indexFile, entries,
+                                           numEntries);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+
+        // Some of the entries may have made it into the file nevertheless, so
+        // try to cancel them.
+        for (size_t i = 0; i < numEntries; i++)
+        {
+            entries[i].op = OS_KeystoreFile_IndexFile_OP_DEL;
+        }
+        OS_KeystoreFile_IndexFile_append(&self->indexFile, entries, numEntries);
+
+        // The entries belong to the successful items in the same order.
+        for (size_t i = 0, j = 0; i < numItems; i++)
+        {
+            if (items[i].result != OS_SUCCESS)
+            {
+                continue;
+            }
+
+            KeyLookup lookup;
+
+            map_lookup(self, items[i].name, &lookup);
+            map_deregisterKey(self, &lookup);
+            data_delete(self, items[i].name, &entries[j++].info);
+
+            items[i].result = err;
+        }
+
+        return err;
+    }
+
+    index_compactIfNeeded(self);
+
+    return getBatchResult(items, numItems);
+}
+
+static OS_Error_t
+removeKey(
+    OS_KeystoreFile_t*                  self,
+    OS_Keystore_KeyItem_t const*        item,
+    OS_KeystoreFile_IndexFile_Entry*    entry)
+{
+    KeyLookup lookup;
+
+    if (!isKeyNameOk(item->name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    map_lookup(self, item->name, &lookup);
+
+    if (!map_checkKeyExists(&lookup))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
+                        __func__, item->name);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    OS_KeystoreFile_Cache_remove(&self->cache, &lookup.name, lookup.hash);
+
+    memset(entry, 0, sizeof(*entry));
+    entry->op   = OS_KeystoreFile_IndexFile_OP_DEL;
+    entry->name = lookup.name;
+    entry->info = *map_getKeyInfo(self, &lookup);
+
+    // Deregistering the key right away makes a second occurrence of the name
+    // in the same batch fail with OS_ERROR_NOT_FOUND.
+    map_deregisterKey(self, &lookup);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+deleteKeyBatch(
+    OS_KeystoreFile_t*                  self,
+    OS_Keystore_KeyItem_t*              items,
+    size_t                              numItems,
+    OS_KeystoreFile_IndexFile_Entry*    entries)
+{
+    OS_Error_t err;
+    size_t numEntries = 0;
+
+    for (size_t i = 0; i < numItems; i++)
+    {
+        items[i].result = removeKey(self, &items[i], &entries[numEntries]);
+
+        if (OS_SUCCESS == items[i].result)
+        {
+            numEntries++;
+        }
+    }
+
+    if (0 == numEntries)
+    {
+        return getBatchResult(items, numItems);
+    }
+
+    err = OS_KeystoreFile_IndexFile_append(&self->indexFile, entries,
+                                           numEntries);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+
+        // The keys still exist, so bring them back into the map. This does
+        // not need to grow the map, as it held them before.
+        for (size_t i = 0; i < numEntries; i++)
+        {
+            KeyLookup lookup;
+
+            map_lookup(self, entries[i].name.buffer, &lookup);
+            map_registerKey(self, &lookup, &entries[i].info);
+        }
+
+        for (size_t i = 0; i < numItems; i++)
+        {
+            if (OS_SUCCESS == items[i].result)
+            {
+                items[i].result = err;
+            }
+        }
+
+        return err;
+    }
+
+    index_compactIfNeeded(self);
+
+    // The keys are gone from the index, the files are just left-overs now.
+    // The entries belong to the successful items in the same order.
+    for (size_t i = 0, j = 0; i < numItems; i++)
+    {
+        if (items[i].result != OS_SUCCESS)
+        {
+            continue;
+        }
+
+        err = data_delete(self, items[i].name, &entries[j++].info);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: data_delete failed with error code %d!",
+                            __func__, err);
+            items[i].result = err;
+        }
+    }
+
+    return getBatchResult(items, numItems);
+}
+
+static OS_Error_t
+copyKeyFile(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    OS_KeystoreFile_t*  dst)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_IndexFile_Entry entry;
+    unsigned char readHash[KEY_HASH_SIZE];
+    KeyLookup srcLookup;
+    KeyLookup dstLookup;
+
+    if (!isKeyNameOk(name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    map_lookup(self, name, &srcLookup);
+
+    if (!map_checkKeyExists(&srcLookup))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
+                        __func__, name);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    map_lookup(dst, name, &dstLookup);
+
+    if (map_checkKeyExists(&dstLookup)
+        || (NULL != stream_findStore(dst, &dstLookup)))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s already exists!",
+                        __func__, name);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op   = OS_KeystoreFile_IndexFile_OP_ADD;
+    entry.name = dstLookup.name;
+    entry.info = *map_getKeyInfo(self, &srcLookup);
+
+    if (entry.info.flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+    {
+        Debug_LOG_ERROR("%s: The key %s has been quarantined as corrupted!",
+                        __func__, name);
+        return OS_ERROR_GENERIC;
+    }
+
+    bool isLarge = (entry.info.keySize > sizeof(self->buffer));
+
+    // The key data is read, but not hashed again. Only the hash stored with
+    // the data is compared to the one in the index of the source, a mismatch
+    // fails the copy. The hash of the index goes along with the data into the
+    // destination, so data corrupted behind a matching hash is copied and
+    // loading it from the destination fails just as it would have failed
+    // from the source. Keys too large for the buffer get the same check while
+    // their file is copied.
+    if (!isLarge
+        && !OS_KeystoreFile_Cache_get(&self->cache, &srcLookup.name,
+                                   srcLookup.hash, self->buffer,
+                                   entry.info.keySize))
+    {
+        err = data_read(self, name, &entry.info, self->buffer, readHash,
+                        self->record);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Could not read the key data from the file, err %d!",
+                            __func__, err);
+            return err;
+        }
+
+        // Comparing the hashes is cheap and catches a mismatching file.
+        if (memcmp(readHash, entry.info.hash, KEY_HASH_SIZE) != 0)
+        {
+            OS_Keystore_STATS_COUNT_HASH_MISMATCH(&self->parent);
+            Debug_LOG_ERROR("%s: The key is corrupted - hash value does not correspond to the index!",
+                            __func__);
+            return OS_ERROR_GENERIC;
+        }
+    }
+
+    if (dst->atomicStore && !isPackable(dst, entry.info.keySize))
+    {
+        OS_KeystoreFile_IndexFile_Entry intent;
+
+        memset(&intent, 0, sizeof(intent));
+        intent.op   = OS_KeystoreFile_IndexFile_OP_INTENT;
+        intent.name = dstLookup.name;
+
+        if ((err = OS_KeystoreFile_IndexFile_append(&dst->indexFile, &intent, 1))
+            != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                            __func__, err);
+            return err;
+        }
+    }
+
+    // Sets the location of the key in the destination.
+    err = isLarge ? fs_copyKey(self, dst, name, &entry.info) :
+          data_write(dst, name, self->buffer, &entry.info);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not write the key data to the file, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    err = OS_KeystoreFile_IndexFile_append(&dst->indexFile, &entry, 1);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+        goto err0;
+    }
+
+    err = map_registerKey(dst, &dstLookup, &entry.info);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to register the key name, error code %d!",
+                        __func__, err);
+        goto err1;
+    }
+
+    index_compactIfNeeded(dst);
+
+    return OS_SUCCESS;
+
+err1:
+    entry.op = OS_KeystoreFile_IndexFile_OP_DEL;
+    OS_KeystoreFile_IndexFile_append(&dst->indexFile, &entry, 1);
+err0:
+    data_delete(dst, name, &entry.info);
+    return err;
+}
+
+// Load streams begin and end in parallel, so the list has a spin lock. The
+// writers, which hold the lock of the keystore, can walk it without.
+static void
+stream_link(
+    OS_KeystoreFile_t*  self,
+    KeyStream*          stream)
+{
+    OS_Keystore_spinLock(&self->parent, &self->streamsLock);
+    stream->next  = self->streams;
+    self->streams = stream;
+    OS_Keystore_spinUnlock(&self->streamsLock);
+}
+
+static void
+stream_free(
+    OS_KeystoreFile_t*  self,
+    KeyStream*          stream)
+{
+    OS_Keystore_spinLock(&self->parent, &self->streamsLock);
+
+    KeyStream** link = &self->streams;
+
+    while (*link != stream)
+    {
+        link = &(*link)->next;
+    }
+    *link = stream->next;
+
+    OS_Keystore_spinUnlock(&self->streamsLock);
+
+    digest_free(self, &stream->digest);
+    free(stream);
+}
+
+static void
+stream_drop(
+    OS_KeystoreFile_t*  self,
+    KeyStream*          stream)
+{
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+
+    if (stream->isFileOpen)
+    {
+        OS_KeystoreFile_Fs_close(&self->fs, stream->hFile);
+    }
+
+    // Without an index entry the file is not part of the keystore anyway. If
+    // it cannot be deleted now, the next start removes it with atomicStore.
+    getFileName(self, stream->lookup.name.buffer, sizeof(fileName), fileName);
+    OS_KeystoreFile_Fs_delete(&self->fs, fileName);
+
+    stream_free(self, stream);
+}
+
+static OS_Error_t
+stream_readHeader(
+    OS_KeystoreFile_t*  self,
+    KeyStream*          stream)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_Fs const* fs = &self->fs;
+    OS_FileSystemFile_Handle_t hFile;
+    RecordHeader header;
+    // Only the header is read, which also covers a legacy header.
+    unsigned char record[OS_KeystoreFile_RECORD_HEADER_SIZE];
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+
+    if (stream->info.segment > 0)
+    {
+        err = OS_KeystoreFile_PackFile_read(
+                  &self->packFile,
+                  stream->info.segment,
+                  stream->info.offset,
+                  record,
+                  OS_KeystoreFile_RECORD_HEADER_SIZE);
+
+        if ((OS_SUCCESS == err) && !record_parse(record, &header))
+        {
+            Debug_LOG_ERROR("%s: No valid record at offset %u of segment %u",
+                            __func__, (unsigned int) stream->info.offset,
+                            (unsigned int) stream->info.segment);
+            err = OS_ERROR_OPERATION_DENIED;
+        }
+
+        stream->dataOffset = stream->info.offset +
+                             OS_KeystoreFile_RECORD_HEADER_SIZE;
+    }
+    else
+    {
+        getFileName(self, stream->lookup.name.buffer, sizeof(fileName),
+                    fileName);
+
+        err = OS_KeystoreFile_Fs_open(
+                  fs,
+                  &hFile,
+                  fileName,
+                  OS_FileSystem_OpenMode_RDONLY,
+                  OS_FileSystem_OpenFlags_NONE);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                            fileName, err);
+            return OS_ERROR_OPERATION_DENIED;
+        }
+
+        err = OS_KeystoreFile_Fs_read(fs, hFile, 0,
+                                      OS_KeystoreFile_RECORD_HEADER_SIZE,
+                                      record);
+
+        if ((OS_SUCCESS == err) && record_parse(record, &header))
+        {
+            stream->dataOffset = OS_KeystoreFile_RECORD_HEADER_SIZE;
+        }
+        else
+        {
+            // A file written before the introduction of the record header,
+            // see fs_readLegacyRecord().
+            err = OS_KeystoreFile_Fs_read(fs, hFile, 0, LEGACY_HEADER_SIZE,
+                                          record);
+
+            header.keySize = BitConverter_getUint32BE(
+                                 &record[KEY_HASH_SIZE]);
+            memcpy(header.hash, record, KEY_HASH_SIZE);
+            stream->dataOffset = LEGACY_HEADER_SIZE;
+        }
+
+        OS_KeystoreFile_Fs_close(fs, hFile);
+    }
+
+    if (err != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    if (header.keySize != stream->info.keySize)
+    {
+        Debug_LOG_ERROR("Key size in map (%zu bytes) does not match the size of "
+                        "the key data (%zu bytes) found in the record",
+                        stream->info.keySize, (size_t) header.keySize);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
+    memcpy(stream->readHash, header.hash, KEY_HASH_SIZE);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+stream_readData(
+    OS_KeystoreFile_t*  self,
+    KeyStream*          stream,
+    size_t              pos,
+    void*               buffer,
+    size_t              len)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_Fs const* fs = &self->fs;
+    OS_FileSystemFile_Handle_t hFile;
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+    int slot = OS_KeystoreFile_KeyNameMap_find(&self->keyNameMap,
+                                               &stream->lookup.name,
+                                               stream->lookup.hash);
+
+    // The lock is not held between two pieces, so the key may have been
+    // deleted or replaced in the meantime.
+    OS_KeystoreFile_KeyInfo const* info = (slot < 0) ? NULL :
+                                          OS_KeystoreFile_KeyNameMap_getValueAt(
+                                              &self->keyNameMap, slot);
+
+    if ((NULL == info) || (info->keySize != stream->info.keySize)
+        || (memcmp(info->hash, stream->info.hash, KEY_HASH_SIZE) != 0))
+    {
+        Debug_LOG_ERROR("%s: The key %s has been removed!", __func__,
+                        stream->lookup.name.buffer);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    if (info->flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+    {
+        Debug_LOG_ERROR("%s: The key %s has been quarantined as corrupted!",
+                        __func__, stream->lookup.name.buffer);
+        return OS_ERROR_GENERIC;
+    }
+
+    // A compaction moves packed records without changing them.
+    if ((info->segment > 0)
+        && ((info->segment != stream->info.segment)
+            || (info->offset != stream->info.offset)))
+    {
+        stream->info.segment = info->segment;
+        stream->info.offset  = info->offset;
+        stream->dataOffset   = info->offset + OS_KeystoreFile_RECORD_HEADER_SIZE;
+    }
+
+    if (info->segment > 0)
+    {
+        return OS_KeystoreFile_PackFile_read(
+                   &self->packFile,
+                   info->segment,
+                   (uint32_t) (stream->dataOffset + pos),
+                   buffer,
+                   len);
+    }
+
+    getFileName(self, stream->lookup.name.buffer, sizeof(fileName), fileName);
+
+    // The file is not kept open, so the key can still be deleted while it is
+    // being read.
+    err = OS_KeystoreFile_Fs_open(
+              fs,
+              &hFile,
+              fileName,
+              OS_FileSystem_OpenMode_RDONLY,
+              OS_FileSystem_OpenFlags_NONE);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        fileName, err);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
+    err = OS_KeystoreFile_Fs_read(fs, hFile, stream->dataOffset + pos, len,
+                                  buffer);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+                        fileName, err);
+    }
+
+    OS_KeystoreFile_Fs_close(fs, hFile);
+
+    return err;
+}
+
+static bool
+cache_load(
+    OS_KeystoreFile_t*                  self,
+    OS_KeystoreFile_KeyNameMap const*   map,
+    const char*                         name,
+    void*                               keyData,
+    size_t*                             keySize)
+{
+    KeyLookup lookup;
+
+    map_lookupIn(map, name, &lookup);
+
+    if (!map_checkKeyExists(&lookup))
+    {
+        return false;
+    }
+
+    // The errors are reported by loadKey().
+    OS_KeystoreFile_KeyInfo const* keyInfo =
+        OS_KeystoreFile_KeyNameMap_getValueAt(map, lookup.slot);
+
+    if ((keyInfo->flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+        || (keyInfo->keySize > *keySize)
+        || !OS_KeystoreFile_Cache_get(&self->cache, &lookup.name, lookup.hash,
+                                      keyData, keyInfo->keySize))
+    {
+        return false;
+    }
+
+    *keySize = keyInfo->keySize;
+
+    return true;
+}
+
+static OS_Error_t
+loadKey(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    void*               keyData,
+    size_t*             keySize,
+    bool                useCache)
+{
+    OS_Error_t err;
+    unsigned char calculatedHash[KEY_HASH_SIZE];
+    unsigned char readHash[KEY_HASH_SIZE];
+    // Loads run in parallel, so the record buffer of the instance cannot be
+    // used.
+    unsigned char record[OS_KeystoreFile_RECORD_HEADER_SIZE +
+                         OS_KeystoreFile_MAX_KEY_SIZE];
+    KeyLookup lookup;
+
+    map_lookup(self, name, &lookup);
+
+    if (!map_checkKeyExists(&lookup))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
+                        __func__, name);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    // Get the size of the written key data from the map and check that the
+    // provided buffer is large enough
+    OS_KeystoreFile_KeyInfo const* keyInfo = map_getKeyInfo(self, &lookup);
+    size_t savedKeySize = keyInfo->keySize;
+
+    if (keyInfo->flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+    {
+        Debug_LOG_ERROR("%s: The key %s has been quarantined as corrupted!",
+                        __func__, name);
+        return OS_ERROR_GENERIC;
+    }
+
+    if (savedKeySize > *keySize)
+    {
+        Debug_LOG_ERROR("%s: The actual amount of key data (%zu bytes) is bigger "
+                        "than the expected size (%zu bytes)",
+                        __func__, savedKeySize, *keySize);
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    // Cached keys have been verified when they were read from the file. A
+    // caller that has just looked there does not look again, so a miss is
+    // only counted once.
+    if (useCache && OS_KeystoreFile_Cache_get(&self->cache, &lookup.name, lookup.hash,
+                                  keyData, savedKeySize))
+    {
+        *keySize = savedKeySize;
+        return OS_SUCCESS;
+    }
+
+    err = data_read(self, name, keyInfo, keyData, readHash, record);
+    OS_Keystore_zeroize(record, OS_KeystoreFile_RECORD_HEADER_SIZE +
+                        savedKeySize);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not read the key data from the file, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    err = createKeyHash(
+              self,
+              keyData,
+              savedKeySize,
+              calculatedHash);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not hash the key data, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    // The hash in the file has to match the data as well as the hash that was
+    // recorded in the index when the key was stored.
+    if ((memcmp(readHash, calculatedHash, KEY_HASH_SIZE) != 0)
+        || (memcmp(keyInfo->hash, calculatedHash, KEY_HASH_SIZE) != 0))
+    {
+        OS_Keystore_STATS_COUNT_HASH_MISMATCH(&self->parent);
+        Debug_LOG_ERROR("%s: The key is corrupted - hash value does not correspond to the data!",
+                        __func__);
+        err = OS_ERROR_GENERIC;
+        return err;
+    }
+
+    OS_KeystoreFile_Cache_put(&self->cache, &lookup.name, lookup.hash,
+                              keyData, savedKeySize);
+
+    *keySize = savedKeySize;
+
+    return err;
+}
+
+static OS_Error_t
+stream_beginLoad(
+    OS_KeystoreFile_t*      self,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_Error_t err;
+    KeyLookup lookup;
+
+    map_lookup(self, name, &lookup);
+
+    if (!map_checkKeyExists(&lookup))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
+                        __func__, name);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    OS_KeystoreFile_KeyInfo const* keyInfo = map_getKeyInfo(self, &lookup);
+
+    if (keyInfo->flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+    {
+        Debug_LOG_ERROR("%s: The key %s has been quarantined as corrupted!",
+                        __func__, name);
+        return OS_ERROR_GENERIC;
+    }
+
+    KeyStream* ks = calloc(1, sizeof(*ks));
+    if (NULL == ks)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    ks->lookup = lookup;
+    ks->info   = *keyInfo;
+
+    if ((err = digest_init(self, &ks->digest)) != OS_SUCCESS)
+    {
+        goto err0;
+    }
+
+    // The cache is bypassed, the key is read from the storage piece by piece.
+    if ((err = stream_readHeader(self, ks)) != OS_SUCCESS)
+    {
+        goto err1;
+    }
+
+    stream_link(self, ks);
+
+    stream->keySize = ks->info.keySize;
+    stream->ctx     = ks;
+
+    return OS_SUCCESS;
+
+err1:
+    digest_free(self, &ks->digest);
+err0:
+    free(ks);
+    return err;
+}
+
+static OS_Error_t
+stream_readChunk(
+    OS_KeystoreFile_t*      self,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len)
+{
+    OS_Error_t err;
+    KeyStream* ks = stream->ctx;
+    unsigned char calculatedHash[KEY_HASH_SIZE];
+
+    if (ks->err != OS_SUCCESS)
+    {
+        return ks->err;
+    }
+
+    if ((err = stream_readData(self, ks, stream->pos, buffer, len))
+        == OS_SUCCESS)
+    {
+        err = digest_process(self, &ks->digest, buffer, len);
+    }
+
+    // Same check as in loadKey(), once all of the key has been read.
+    if ((OS_SUCCESS == err) && (stream->pos + len == stream->keySize)
+        && ((err = digest_finalize(self, &ks->digest, calculatedHash))
+            == OS_SUCCESS)
+        && ((memcmp(ks->readHash, calculatedHash, KEY_HASH_SIZE) != 0)
+            || (memcmp(ks->info.hash, calculatedHash, KEY_HASH_SIZE) != 0)))
+    {
+        OS_Keystore_STATS_COUNT_HASH_MISMATCH(&self->parent);
+        Debug_LOG_ERROR("%s: The key is corrupted - hash value does not correspond to the data!",
+                        __func__);
+        err = OS_ERROR_GENERIC;
+    }
+
+    if (err != OS_SUCCESS)
+    {
+        ks->err = err;
+    }
+
+    return err;
+}
+
+static OS_Error_t
+copyKeyData(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    OS_Keystore_t*      dstPtr)
+{
+    OS_Error_t err;
+    OS_Keystore_Stream_t src;
+    OS_Keystore_Stream_t dst;
+    size_t keySize = sizeof(self->buffer);
+    KeyLookup lookup;
+
+    // The API holds the locks of both keystores already, but the loads of the
+    // vtable take the lock of this one again. So the key is read with the
+    // functions behind them, like OS_Keystore_copyKeyImpl() would do it.
+    map_lookup(self, name, &lookup);
+
+    bool isLarge = map_checkKeyExists(&lookup)
+                   && (map_getKeyInfo(self, &lookup)->keySize > keySize);
+
+    if (!isLarge)
+    {
+        if ((err = loadKey(self, name, self->buffer, &keySize, true))
+            == OS_SUCCESS)
+        {
+            err = dstPtr->vtable->storeKey(dstPtr, name, self->buffer, keySize);
+        }
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Copying the key failed with err %d!",
+                            __func__, err);
+        }
+
+        memset(self->buffer, 0, sizeof(self->buffer));
+
+        return err;
+    }
+
+    memset(&src, 0, sizeof(src));
+
+    if ((err = stream_beginLoad(self, name, &src)) != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    if ((err = OS_Keystore_beginStoreKeyImpl(dstPtr, name, src.keySize,
+                                             &dst)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: beginStoreKey failed with err %d!", __func__, err);
+        stream_free(self, src.ctx);
+        return err;
+    }
+
+    while ((OS_SUCCESS == err) && (src.pos < src.keySize))
+    {
+        size_t len = src.keySize - src.pos;
+
+        if (len > sizeof(self->buffer))
+        {
+            len = sizeof(self->buffer);
+        }
+
+        if ((err = stream_readChunk(self, &src, self->buffer, len))
+            == OS_SUCCESS)
+        {
+            src.pos += len;
+            err = OS_Keystore_writeKeyChunkImpl(dstPtr, &dst, self->buffer,
+                                                len);
+        }
+    }
+
+    memset(self->buffer, 0, sizeof(self->buffer));
+
+    // The source is verified with its last piece, so the key is only added to
+    // the destination once all of it has been read.
+    if (OS_SUCCESS == err)
+    {
+        err = OS_Keystore_commitKeyImpl(dstPtr, &dst);
+    }
+    else
+    {
+        OS_Keystore_closeStreamImpl(dstPtr, &dst);
+    }
+
+    stream_free(self, src.ctx);
+
+    return err;
+}
+
+static OS_Error_t
+scrubLargeKey(
+    OS_KeystoreFile_t*  self,
+    const char*         name,
+    OS_Error_t*         keyErr)
+{
+    OS_Keystore_Stream_t stream;
+
+    // The key is verified piece by piece, the stream checks the hashes with
+    // the last one. The lock is held, so the stream is read without taking it
+    // again.
+    memset(&stream, 0, sizeof(stream));
+    *keyErr = stream_beginLoad(self, name, &stream);
+
+    while ((OS_SUCCESS == *keyErr) && (stream.pos < stream.keySize))
+    {
+        size_t len = stream.keySize - stream.pos;
+
+        if (len > sizeof(self->buffer))
+        {
+            len = sizeof(self->buffer);
+        }
+
+        *keyErr = stream_readChunk(self, &stream, self->buffer, len);
+        stream.pos += len;
+    }
+
+    memset(self->buffer, 0, sizeof(self->buffer));
+
+    if (NULL != stream.ctx)
+    {
+        stream_free(self, stream.ctx);
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+scrubKey(
+    OS_KeystoreFile_t*  self,
+    int                 slot,
+    OS_Error_t*         keyErr)
+{
+    OS_Error_t err;
+    unsigned char calculatedHash[KEY_HASH_SIZE];
+    unsigned char readHash[KEY_HASH_SIZE];
+    OS_KeystoreFile_KeyInfo const* info =
+        OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slot);
+    OS_KeystoreFile_KeyName const* keyName =
+        OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap, slot);
+
+    if (info->keySize > sizeof(self->buffer))
+    {
+        return scrubLargeKey(self, keyName->buffer, keyErr);
+    }
+
+    // The cache is bypassed, what matters is the data in the storage.
+    *keyErr = data_read(self, keyName->buffer, info, self->buffer, readHash,
+                        self->record);
+    if (*keyErr != OS_SUCCESS)
+    {
+        return OS_SUCCESS;
+    }
+
+    err = createKeyHash(self, self->buffer, info->keySize, calculatedHash);
+    memset(self->buffer, 0, info->keySize);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not hash the key data, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    // Same check as in loadKey().
+    if ((memcmp(readHash, calculatedHash, KEY_HASH_SIZE) != 0)
+        || (memcmp(info->hash, calculatedHash, KEY_HASH_SIZE) != 0))
+    {
+        OS_Keystore_STATS_COUNT_HASH_MISMATCH(&self->parent);
+        *keyErr = OS_ERROR_GENERIC;
+    }
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+quarantineKey(
+    OS_KeystoreFile_t*  self,
+    int                 slot)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_IndexFile_Entry entry;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op          = OS_KeystoreFile_IndexFile_OP_ADD;
+    entry.name        = *OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap,
+                                                             slot);
+    entry.info        = *OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap,
+                                                               slot);
+    entry.info.flags |= OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED;
+
+    // The key keeps its data and location, the new entry just replaces the
+    // flags.
+    if ((err = OS_KeystoreFile_IndexFile_append(&self->indexFile, &entry, 1))
+        != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+        return err;
+    }
+
+    OS_KeystoreFile_Cache_remove(
+        &self->cache,
+        &entry.name,
+        OS_KeystoreFile_KeyNameMap_getHashAt(&self->keyNameMap, slot));
+    map_setKeyInfo(self, slot, &entry.info);
+
+    index_compactIfNeeded(self);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+scrubStep(
+    OS_KeystoreFile_t*                      self,
+    OS_KeystoreFile_ScrubCursor_t*          cursor,
+    OS_KeystoreFile_ScrubParams_t const*    params,
+    bool*                                   isDone)
+{
+    OS_Error_t err = OS_SUCCESS;
+    size_t numKeys  = 0;
+    size_t numBytes = 0;
+    int slot;
+
+    for (slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap,
+                                                   (int) cursor->pos);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, slot + 1))
+    {
+        OS_KeystoreFile_KeyInfo const* info =
+            OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slot);
+
+        // At least one key is verified per call, so the pass always advances.
+        if ((numKeys > 0)
+            && (((params->maxKeys > 0) && (numKeys >= params->maxKeys))
+                || ((params->maxBytes > 0)
+                    && (numBytes + info->keySize > params->maxBytes))))
+        {
+            break;
+        }
+
+        if (info->flags & OS_KeystoreFile_KeyInfo_FLAG_QUARANTINED)
+        {
+            continue;
+        }
+
+        numKeys++;
+        numBytes += info->keySize;
+
+        OS_Error_t keyErr;
+
+        if ((err = scrubKey(self, slot, &keyErr)) != OS_SUCCESS)
+        {
+            cursor->pos = slot;
+            *isDone     = false;
+            return err;
+        }
+
+        if (OS_SUCCESS == keyErr)
+        {
+            continue;
+        }
+
+        OS_KeystoreFile_KeyName const* keyName =
+            OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap, slot);
+
+        Debug_LOG_WARNING("%s: The key %s is corrupted, err %d!",
+                          __func__, keyName->buffer, keyErr);
+
+        if (NULL != params->onCorrupted)
+        {
+            params->onCorrupted(params->ctx, keyName->buffer, keyErr);
+        }
+
+        if (params->quarantine
+            && ((err = quarantineKey(self, slot)) != OS_SUCCESS))
+        {
+            // Continue at this key next time.
+            cursor->pos = slot;
+            *isDone     = false;
+            return err;
+        }
+    }
+
+    // A finished pass starts over with the next call.
+    cursor->pos = (slot < 0) ? 0 : slot;
+    *isDone     = (slot < 0);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+ctor(
+    OS_KeystoreFile_t*              self,
+    OS_FileSystem_Handle_t          hFs,
+    OS_Crypto_Handle_t              hCrypto,
+    const char*                     name,
+    OS_KeystoreFile_Config_t const* config)
+{
+    if (NULL == self || NULL == hFs || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    else if (strlen(name) > OS_KeystoreFile_MAX_INSTANCE_NAME_LEN)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    else if ((NULL != config) && (NULL != config->directory)
+             && (strlen(config->directory) > OS_KeystoreFile_MAX_DIRECTORY_LEN))
+    {
+        Debug_LOG_ERROR("%s: The directory name is too long!", __func__);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    else if ((NULL != config) && (config->numShards > 0)
+             && ((NULL == config->directory) || ('\0' == config->directory[0])
+                 || (config->numShards > OS_KeystoreFile_MAX_SHARDS)))
+    {
+        Debug_LOG_ERROR("%s: Shards require a directory and must not exceed %u!",
+                        __func__, OS_KeystoreFile_MAX_SHARDS);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+    else if ((NULL != config) && (config->packSegmentSize > 0)
+             && ((config->packSegmentSize < OS_KeystoreFile_RECORD_HEADER_SIZE +
+                  OS_KeystoreFile_PACK_MAX_KEY_SIZE)
+                 || (config->packSegmentSize > UINT32_MAX)))
+    {
+        Debug_LOG_ERROR("%s: The segment size %zu is invalid!",
+                        __func__, config->packSegmentSize);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(self, 0, sizeof(OS_KeystoreFile_t));
+    atomic_flag_clear(&self->digestBusy);
+    atomic_flag_clear(&self->streamsLock);
+    atomic_flag_clear(&self->snapshotBusy);
+    // No lock is set yet, so the readers use the map of the writers.
+    atomic_init(&self->snapshot, &self->keyNameMap);
+    atomic_init(&self->epoch, 0);
+    atomic_init(&self->readers[0], 0);
+    atomic_init(&self->readers[1], 0);
+
+    if (!OS_KeystoreFile_KeyNameMap_ctor(&self->keyNameMap, 0))
+    {
+        return OS_ERROR_ABORTED;
+    }
+
+    strncpy(self->name, name, sizeof(self->name) - 1);
+    self->name[sizeof(self->name) - 1] = '\0';
+
+    self->fs.hFs      = hFs;
+    self->fs.keystore = &self->parent;
+    self->hCrypto     = hCrypto;
+
+    char indexPrefix[OS_KeystoreFile_MAX_DIRECTORY_LEN + 1 +
+                     OS_KeystoreFile_MAX_INSTANCE_NAME_LEN + 1];
+
+    if ((NULL != config) && (NULL != config->directory))
+    {
+        strncpy(self->directory, config->directory, sizeof(self->directory) - 1);
+        self->numShards = config->numShards;
+    }
+
+    self->atomicStore = (NULL != config) && config->atomicStore;
+
+    // The index and segment files live next to the key files, but are never
+    // sharded.
+    if ('\0' == self->directory[0])
+    {
+        snprintf(indexPrefix, sizeof(indexPrefix), "%s", self->name);
+    }
+    else
+    {
+        snprintf(indexPrefix, sizeof(indexPrefix), "%s/%s", self->directory,
+                 self->name);
+    }
+
+    OS_KeystoreFile_IndexFile_ctor(&self->indexFile, &self->fs, indexPrefix);
+    OS_KeystoreFile_PackFile_ctor(&self->packFile, &self->fs, indexPrefix,
+                                  (NULL == config) ? 0 : config->packSegmentSize);
+    OS_KeystoreFile_Cache_ctor(&self->cache, &self->parent,
+                               (NULL == config) ? 0 : config->cacheSize);
+
+    // Bring back the keys stored by a previous instance with the same name.
+    ReplayState replay = { .self = self, .hasPending = false };
+    OS_Error_t err = OS_KeystoreFile_IndexFile_load(
+                         &self->indexFile,
+                         index_replayEntry,
+                         &replay);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to load the index file, err %d!",
+                        __func__, err);
+        goto err0;
+    }
+
+    // The segment files are only looked at if there are packed keys or new
+    // keys are to be packed.
+    bool hasPackedKeys = false;
+
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, slot + 1))
+    {
+        OS_KeystoreFile_KeyInfo const* info =
+            OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slot);
+
+        if (info->segment > 0)
+        {
+            OS_KeystoreFile_PackFile_addLive(
+                &self->packFile,
+                info->segment,
+                OS_KeystoreFile_RECORD_HEADER_SIZE + info->keySize);
+            hasPackedKeys = true;
+        }
+    }
+
+    if ((hasPackedKeys || (self->packFile.segmentSize > 0))
+        && ((err = OS_KeystoreFile_PackFile_load(&self->packFile)) != OS_SUCCESS))
+    {
+        Debug_LOG_ERROR("%s: Failed to load the segment files, err %d!",
+                        __func__, err);
+        goto err0;
+    }
+
+    // Only the journal written since the last compaction is looked at, the
+    // other key files are not touched.
+    if (replay.hasPending)
+    {
+        index_recoverPending(self, &replay.pending);
+        OS_KeystoreFile_KeyNameMap_dtor(&replay.pending);
+    }
+
+    // An index file written by an older version is converted right away.
+    index_compactIfNeeded(self);
+
+    OS_KeystoreFile_TO_OS_KEYSTORE(self)->vtable = &OS_KeystoreFile_vtable;
+
+    return OS_SUCCESS;
+
+err0:
+    if (replay.hasPending)
+    {
+        OS_KeystoreFile_KeyNameMap_dtor(&replay.pending);
+    }
+    OS_KeystoreFile_KeyNameMap_dtor(&self->keyNameMap);
+
+    // A damaged index is reported as such, so it is not mistaken for an
+    // instance that just failed to initialize.
+    return (OS_ERROR_INVALID_STATE == err) ? err : OS_ERROR_ABORTED;
+}
+
+static OS_Error_t
+dtor(
+    OS_KeystoreFile_t* self)
+{
+    if (self == NULL)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Keys of stores that have not been committed are dropped.
+    while (NULL != self->streams)
+    {
+        if (self->streams->isStore)
+        {
+            stream_drop(self, self->streams);
+        }
+        else
+        {
+            stream_free(self, self->streams);
+        }
+    }
+
+    OS_KeystoreFile_KeyNameMap_dtor(&self->keyNameMap);
+    OS_KeystoreFile_KeyNameMap_dtor(&self->snapshots[0]);
+    OS_KeystoreFile_KeyNameMap_dtor(&self->snapshots[1]);
+    OS_KeystoreFile_Cache_dtor(&self->cache);
+    OS_KeystoreFile_PackFile_dtor(&self->packFile);
+
+    if (NULL != self->hDigest)
+    {
+        OS_CryptoDigest_free(self->hDigest);
+    }
+
+    return OS_SUCCESS;
+}
+
+
+// Exported via Vtable ---------------------------------------------------------
+
+static OS_Error_t
+OS_KeystoreFile_free(
+    OS_Keystore_t* ptr)
+{
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+
+    OS_Error_t err = dtor(self);
+    if (OS_SUCCESS == err)
+    {
+        free(self);
+    }
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_storeKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void const*     keyData,
+    size_t          keySize)
+{
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+    OS_KeystoreFile_IndexFile_Entry entry;
+    OS_Keystore_KeyItem_t item =
+    {
+        .name    = name,
+        .keyData = (void*) keyData,
+        .keySize = keySize
+    };
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = storeKeyBatch(self, &item, 1, &entry);
+    snapshot_publish(self);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_loadKey(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    void*           keyData,
+    size_t*         keySize)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+    unsigned int epoch;
+
+    if (!isLoadKeyParametersOk(self, name, keyData, keySize))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Hot keys are taken from the cache without the lock.
+    OS_KeystoreFile_KeyNameMap const* map = snapshot_enter(self, &epoch);
+    bool isCached = cache_load(self, map, name, keyData, keySize);
+    snapshot_leave(self, map, epoch);
+
+    if (isCached)
+    {
+        return OS_SUCCESS;
+    }
+
+    // Writers delete key files and move packed records, so they are read
+    // under the lock. The key may have changed in the meantime, so it is
+    // looked up again.
+    OS_Keystore_lockShared(&self->parent);
+    err = loadKey(self, name, keyData, keySize, false);
+    OS_Keystore_unlockShared(&self->parent);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_deleteKey(
+    OS_Keystore_t*  ptr,
+    const char*     name)
+{
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+    OS_KeystoreFile_IndexFile_Entry entry;
+    OS_Keystore_KeyItem_t item = { .name = name };
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = deleteKeyBatch(self, &item, 1, &entry);
+    snapshot_publish(self);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_copyKey(
+    OS_Keystore_t*  srcPtr,
+    const char*     name,
+    OS_Keystore_t*  dstPtr)
+{
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) srcPtr;
+
+    if (NULL == self || NULL == dstPtr)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Between two instances on the same file system, the key data and its
+    // hash can be taken over as they are.
+    if ((dstPtr->vtable == &OS_KeystoreFile_vtable)
+        && (((OS_KeystoreFile_t*) dstPtr)->fs.hFs == self->fs.hFs))
+    {
+        OS_KeystoreFile_t* dst = (OS_KeystoreFile_t*) dstPtr;
+        OS_Error_t err = copyKeyFile(self, name, dst);
+        snapshot_publish(dst);
+
+        return err;
+    }
+
+    return copyKeyData(self, name, dstPtr);
+}
+
+static OS_Error_t
+OS_KeystoreFile_wipeKeystore(
+    OS_Keystore_t*  ptr)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+
+    if (NULL == self)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Every deleted key leaves the cache anyway, but make sure no key data
+    // survives a wipe.
+    OS_KeystoreFile_Cache_clear(&self->cache);
+
+    if (OS_KeystoreFile_KeyNameMap_getSize(&self->keyNameMap) > 0)
+    {
+        // The empty snapshot goes first, so the index never refers to a file
+        // that is already gone. If it cannot be written, all keys are still
+        // there and the wipe can be retried.
+        err = OS_KeystoreFile_IndexFile_rewrite(&self->indexFile, NULL, NULL,
+                                                0);
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Failed to write the index file, err %d!",
+                            __func__, err);
+            return err;
+        }
+    }
+    else
+    {
+        Debug_LOG_INFO("%s: Wiping an empty keystore, only dead records are "
+                       "removed", __func__);
+    }
+
+    OS_Error_t result = OS_SUCCESS;
+
+    // The records of packed keys go away with their segment files, which
+    // also removes the dead records left by deleted keys. A segment file that
+    // is left behind holds only dead records for the next start.
+    for (unsigned int i = 0; i < OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        err = OS_KeystoreFile_PackFile_remove(&self->packFile, i + 1);
+
+        if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Failed to remove segment %u, err %d!",
+                            __func__, i + 1, err);
+            result = (OS_SUCCESS == result) ? err : result;
+        }
+    }
+
+    OS_KeystoreFile_KeyNameMap orphans;
+    bool hasOrphans = false;
+
+    // Delete all key files in one pass. The keys whose files cannot be
+    // deleted are collected, so the next start removes their files.
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(&self->keyNameMap, slot + 1))
+    {
+        OS_KeystoreFile_KeyName const* keyName =
+            OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap, slot);
+
+        OS_KeystoreFile_KeyInfo const* info =
+            OS_KeystoreFile_KeyNameMap_getValueAt(&self->keyNameMap, slot);
+
+        if (info->segment > 0)
+        {
+            continue;
+        }
+
+        err = fs_deleteKey(self, keyName->buffer);
+
+        // A missing file is a left-over of an earlier, interrupted wipe.
+        if ((OS_SUCCESS == err) || (OS_ERROR_FS_FILE_NOT_FOUND == err))
+        {
+            continue;
+        }
+
+        Debug_LOG_ERROR("%s: Failed to delete the key %s!",
+                        __func__, keyName->buffer);
+        result = (OS_SUCCESS == result) ? err : result;
+
+        if (!hasOrphans)
+        {
+            if (!OS_KeystoreFile_KeyNameMap_ctor(&orphans, 0))
+            {
+                continue;
+            }
+            hasOrphans = true;
+        }
+
+        if (!OS_KeystoreFile_KeyNameMap_insert(
+                &orphans,
+                keyName,
+                OS_KeystoreFile_KeyNameMap_getHashAt(&self->keyNameMap, slot),
+                info))
+        {
+            Debug_LOG_ERROR("%s: Lost track of the file of key %s!",
+                            __func__, keyName->buffer);
+        }
+    }
+
+    if (hasOrphans)
+    {
+        index_appendOrphans(self, &orphans);
+        OS_KeystoreFile_KeyNameMap_dtor(&orphans);
+    }
+
+    map_clear(self);
+    snapshot_publish(self);
+
+    return result;
+}
+
+static OS_Error_t
+OS_KeystoreFile_storeKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+
+    if (NULL == self || NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (0 == numItems)
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_KeystoreFile_IndexFile_Entry* entries = malloc(numItems * sizeof(*entries));
+
+    if (NULL == entries)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    err = storeKeyBatch(self, items, numItems, entries);
+    snapshot_publish(self);
+
+    free(entries);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_deleteKeys(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_KeyItem_t*  items,
+    size_t                  numItems)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+
+    if (NULL == self || NULL == items)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (0 == numItems)
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_KeystoreFile_IndexFile_Entry* entries = malloc(numItems * sizeof(*entries));
+
+    if (NULL == entries)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    err = deleteKeyBatch(self, items, numItems, entries);
+    snapshot_publish(self);
+
+    free(entries);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize)
+{
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+
+    if (NULL == self || NULL == cursor || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = OS_SUCCESS;
+    unsigned int epoch;
+    OS_KeystoreFile_KeyNameMap const* map = snapshot_enter(self, &epoch);
+
+    // The cursor holds the map slot at which the search for the next key
+    // starts. The snapshot used by a later call may have another capacity.
+    int slot = (cursor->pos >= map->capacity) ? -1 :
+               OS_KeystoreFile_KeyNameMap_getNext(map, (int) cursor->pos);
+
+    if (slot < 0)
+    {
+        cursor->pos = map->capacity;
+        err = OS_ERROR_NOT_FOUND;
+    }
+    else
+    {
+        OS_KeystoreFile_KeyName const* keyName =
+            OS_KeystoreFile_KeyNameMap_getKeyAt(map, slot);
+        size_t nameLen = strlen(keyName->buffer);
+
+        if (nameLen >= nameSize)
+        {
+            err = OS_ERROR_BUFFER_TOO_SMALL;
+        }
+        else
+        {
+            memcpy(name, keyName->buffer, nameLen + 1);
+
+            if (NULL != keySize)
+            {
+                *keySize = OS_KeystoreFile_KeyNameMap_getValueAt(map,
+                                                                 slot)->keySize;
+            }
+
+            cursor->pos = (size_t) slot + 1;
+        }
+    }
+
+    snapshot_leave(self, map, epoch);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize)
+{
+    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+    unsigned int epoch;
+    KeyLookup lookup;
+
+    if (NULL == self || !isKeyNameOk(name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreFile_KeyNameMap const* map = snapshot_enter(self, &epoch);
+
+    map_lookupIn(map, name, &lookup);
+
+    if (map_checkKeyExists(&lookup) && (NULL != keySize))
+    {
+        *keySize = OS_KeystoreFile_KeyNameMap_getValueAt(map,
+                                                         lookup.slot)->keySize;
+    }
+
+    snapshot_leave(self, map, epoch);
+
+    return map_checkKeyExists(&lookup) ? OS_SUCCESS : OS_ERROR_NOT_FOUND;
+}
+
+static OS_Error_t
+OS_KeystoreFile_getKeystoreStats(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stats_t*    stats)
+{
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+
+    size_t used;
+
+    OS_KeystoreFile_Cache_getCounters(&self->cache, &stats->cacheHits,
+                                      &stats->cacheMisses,
+                                      &stats->cacheEvictions, &used);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreFile_beginStoreKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+    unsigned char header[OS_KeystoreFile_RECORD_HEADER_SIZE];
+    char fileName[OS_KeystoreFile_MAX_FILE_NAME_LEN + 1]; // null terminated
+    KeyLookup lookup;
+
+    if (NULL == self || !isKeyNameOk(name))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // The size goes into the record header and the index with 32 bits.
+    if (stream->keySize > UINT32_MAX - OS_KeystoreFile_RECORD_HEADER_SIZE)
+    {
+        Debug_LOG_ERROR("%s: The key size %zu is too large!",
+                        __func__, stream->keySize);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    map_lookup(self, name, &lookup);
+
+    if (map_checkKeyExists(&lookup) || (NULL != stream_findStore(self, &lookup)))
+    {
+        Debug_LOG_ERROR("%s: The key with the name %s already exists!",
+                        __func__, name);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    KeyStream* ks = calloc(1, sizeof(*ks));
+    if (NULL == ks)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    ks->lookup  = lookup;
+    ks->isStore = true;
+
+    if ((err = digest_init(self, &ks->digest)) != OS_SUCCESS)
+    {
+        goto err0;
+    }
+
+    if (self->atomicStore)
+    {
+        OS_KeystoreFile_IndexFile_Entry intent;
+
+        memset(&intent, 0, sizeof(intent));
+        intent.op   = OS_KeystoreFile_IndexFile_OP_INTENT;
+        intent.name = lookup.name;
+
+        if ((err = OS_KeystoreFile_IndexFile_append(&self->indexFile, &intent, 1))
+            != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                            __func__, err);
+            goto err1;
+        }
+    }
+
+    getFileName(self, name, sizeof(fileName), fileName);
+
+    // A streamed key always gets a file of its own.
+    err = OS_KeystoreFile_Fs_open(
+              &self->fs,
+              &ks->hFile,
+              fileName,
+              OS_FileSystem_OpenMode_RDWR,
+              OS_FileSystem_OpenFlags_CREATE);
+
+    if (err != OS_SUCCESS)
     {
-        return OS_ERROR_ABORTED;
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        fileName, err);
+        err = OS_ERROR_OPERATION_DENIED;
+        goto err1;
     }
 
-    strncpy(self->name, name, sizeof(self->name) - 1);
-    self->name[sizeof(self->name) - 1] = '\0';
-
-    self->hFs     = hFs;
-    self->hCrypto = hCrypto;
-
-    OS_KeystoreFile_TO_OS_KEYSTORE(self)->vtable = &OS_KeystoreFile_vtable;
+    ks->isFileOpen = true;
+    stream_link(self, ks);
 
-    return OS_SUCCESS;
-}
+    // The header is only written once the hash is known. Until then the file
+    // does not start with a valid record.
+    memset(header, 0, sizeof(header));
 
-static OS_Error_t
-dtor(
-    OS_KeystoreFile_t* self)
-{
-    if (self == NULL)
+    if ((err = OS_KeystoreFile_Fs_write(&self->fs, ks->hFile, 0, sizeof(header),
+                                        header)) != OS_SUCCESS)
     {
-        return OS_ERROR_INVALID_PARAMETER;
+        Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
+                        fileName, err);
+        stream_drop(self, ks);
+        return err;
     }
 
-    OS_KeystoreFile_KeyNameMap_dtor(&self->keyNameMap);
+    stream->ctx = ks;
 
     return OS_SUCCESS;
-}
-
 
-// Exported via Vtable ---------------------------------------------------------
+err1:
+    digest_free(self, &ks->digest);
+err0:
+    free(ks);
+    return err;
+}
 
 static OS_Error_t
-OS_KeystoreFile_free(
-    OS_Keystore_t* ptr)
+OS_KeystoreFile_writeKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void const*             data,
+    size_t                  len)
 {
+    OS_Error_t err;
     OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+    KeyStream* ks = stream->ctx;
+
+    if (ks->err != OS_SUCCESS)
+    {
+        return ks->err;
+    }
+
+    err = OS_KeystoreFile_Fs_write(
+              &self->fs,
+              ks->hFile,
+              OS_KeystoreFile_RECORD_HEADER_SIZE + stream->pos,
+              len,
+              data);
 
-    OS_Error_t err = dtor(self);
     if (OS_SUCCESS == err)
     {
-        free(self);
+        err = digest_process(self, &ks->digest, data, len);
+    }
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Could not write the key data, err %d!",
+                        __func__, err);
+        ks->err = err;
     }
 
     return err;
 }
 
 static OS_Error_t
-OS_KeystoreFile_storeKey(
-    OS_Keystore_t*  ptr,
-    const char*     name,
-    void const*     keyData,
-    size_t          keySize)
+OS_KeystoreFile_commitKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream)
 {
     OS_Error_t err;
-    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
-    char keyDataHash[KEY_HASH_SIZE] = {0};
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+    OS_KeystoreFile_IndexFile_Entry entry;
+    KeyStream* ks = stream->ctx;
 
-    if (!isStoreKeyParametersOk(self, name, keyData, keySize))
+    if ((err = ks->err) != OS_SUCCESS)
     {
-        return OS_ERROR_INVALID_PARAMETER;
+        goto err0;
     }
 
-    err = createKeyHash(
-              self->hCrypto,
-              keyData,
-              keySize,
-              keyDataHash);
+    memset(&entry, 0, sizeof(entry));
+    entry.op           = OS_KeystoreFile_IndexFile_OP_ADD;
+    entry.name         = ks->lookup.name;
+    entry.info.keySize = stream->keySize;
 
-    if (err != OS_SUCCESS)
+    if ((err = digest_finalize(self, &ks->digest, entry.info.hash))
+        != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: Could not hash the key data, err %d!",
-                        __func__, err);
-        return err;
+        goto err0;
     }
 
-    err = fs_writeKey(
-              self->hFs,
-              keyData,
-              keyDataHash,
-              keySize,
-              self->name,
-              name);
+    record_serializeHeader(self->record, entry.info.hash, stream->keySize);
+
+    err = OS_KeystoreFile_Fs_write(&self->fs, ks->hFile, 0,
+                                   OS_KeystoreFile_RECORD_HEADER_SIZE,
+                                   self->record);
+
+    OS_Error_t closeErr = OS_KeystoreFile_Fs_close(&self->fs, ks->hFile);
+    ks->isFileOpen = false;
+
+    if (OS_SUCCESS == err)
+    {
+        err = closeErr;
+    }
 
     if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: Could not write the key data to the file, err %d!",
+        Debug_LOG_ERROR("%s: Could not complete the key file, err %d!",
                         __func__, err);
-        return err;
+        goto err0;
     }
 
-    err = map_registerKey(self, name, keySize);
+    // As with storeKey(), the key only becomes known after a restart once its
+    // file is complete.
+    if ((err = OS_KeystoreFile_IndexFile_append(&self->indexFile, &entry, 1))
+        != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to update the index file, err %d!",
+                        __func__, err);
+        goto err0;
+    }
 
-    if (err != OS_SUCCESS)
+    if ((err = map_registerKey(self, &ks->lookup, &entry.info)) != OS_SUCCESS)
     {
         Debug_LOG_ERROR("%s: Failed to register the key name, error code %d!",
                         __func__, err);
+        entry.op = OS_KeystoreFile_IndexFile_OP_DEL;
+        OS_KeystoreFile_IndexFile_append(&self->indexFile, &entry, 1);
         goto err0;
     }
 
+    index_compactIfNeeded(self);
+    snapshot_publish(self);
+    stream_free(self, ks);
+
     return OS_SUCCESS;
 
 err0:
-    fs_deleteKey(self->hFs, self->name, name);
+    stream_drop(self, ks);
     return err;
 }
 
 static OS_Error_t
-OS_KeystoreFile_loadKey(
-    OS_Keystore_t*  ptr,
-    const char*     name,
-    void*           keyData,
-    size_t*         keySize)
+OS_KeystoreFile_beginLoadKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Stream_t*   stream)
 {
     OS_Error_t err;
-    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
-    unsigned char calculatedHash[KEY_HASH_SIZE];
-    unsigned char readHash[KEY_HASH_SIZE];
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
 
-    if (!isLoadKeyParametersOk(self, name, keyData, keySize))
+    if (NULL == self || !isKeyNameOk(name))
     {
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    if (!map_checkKeyExists(self, name))
-    {
-        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
-                        __func__, name);
-        return OS_ERROR_NOT_FOUND;
-    }
+    // Same as for loadKey(), the key is read under the lock.
+    OS_Keystore_lockShared(&self->parent);
+    err = stream_beginLoad(self, name, stream);
+    OS_Keystore_unlockShared(&self->parent);
 
-    // Get the size of the written key data from the map and check that the
-    // provided buffer is large enough
-    size_t savedKeySize = map_getKeySize(self, name);
+    return err;
+}
 
-    if (savedKeySize > *keySize)
+static OS_Error_t
+OS_KeystoreFile_readKeyChunk(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream,
+    void*                   buffer,
+    size_t                  len)
+{
+    OS_Error_t err;
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+
+    OS_Keystore_lockShared(&self->parent);
+    err = stream_readChunk(self, stream, buffer, len);
+    OS_Keystore_unlockShared(&self->parent);
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreFile_closeStream(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Stream_t*   stream)
+{
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) ptr;
+    KeyStream* ks = stream->ctx;
+
+    if (ks->isStore)
     {
-        Debug_LOG_ERROR("%s: The actual amount of key data (%zu bytes) is bigger "
-                        "than the expected size (%zu bytes)",
-                        __func__, savedKeySize, *keySize);
-        return OS_ERROR_BUFFER_TOO_SMALL;
+        stream_drop(self, ks);
+    }
+    else
+    {
+        // The writers walk the list of streams under the lock only, see
+        // stream_link().
+        OS_Keystore_lockShared(&self->parent);
+        stream_free(self, ks);
+        OS_Keystore_unlockShared(&self->parent);
     }
 
-    err = fs_readKey(
-              self->hFs,
-              keyData,
-              readHash,
-              savedKeySize,
-              self->name,
-              name);
+    return OS_SUCCESS;
+}
 
-    if (err != OS_SUCCESS)
+// Public functions ------------------------------------------------------------
+
+OS_Error_t
+OS_KeystoreFile_init(
+    OS_Keystore_Handle_t*  pHandle,
+    OS_FileSystem_Handle_t hFs,
+    OS_Crypto_Handle_t     hCrypto,
+    const char*            name)
+{
+    return OS_KeystoreFile_initWithConfig(pHandle, hFs, hCrypto, name, NULL);
+}
+
+OS_Error_t
+OS_KeystoreFile_initWithConfig(
+    OS_Keystore_Handle_t*           pHandle,
+    OS_FileSystem_Handle_t          hFs,
+    OS_Crypto_Handle_t              hCrypto,
+    const char*                     name,
+    OS_KeystoreFile_Config_t const* config)
+{
+    OS_Error_t err          = OS_ERROR_GENERIC;
+    OS_KeystoreFile_t* self = malloc(sizeof(OS_KeystoreFile_t));
+
+    if (NULL == self)
     {
-        Debug_LOG_ERROR("%s: Could not read the key data from the file, err %d!",
-                        __func__, err);
-        return err;
+        return OS_ERROR_INSUFFICIENT_SPACE;
     }
 
-    err = createKeyHash(
-              self->hCrypto,
-              keyData,
-              savedKeySize,
-              calculatedHash);
+    err = ctor(self, hFs, hCrypto, name, config);
 
     if (err != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: Could not hash the key data, err %d!",
-                        __func__, err);
-        return err;
+        free(self);
     }
-
-    if (memcmp(readHash, calculatedHash, KEY_HASH_SIZE) != 0)
+    else
     {
-        Debug_LOG_ERROR("%s: The key is corrupted - hash value does not correspond to the data!",
-                        __func__);
-        err = OS_ERROR_GENERIC;
-        return err;
+        *pHandle = OS_KeystoreFile_TO_OS_KEYSTORE(self);
     }
 
-    *keySize = savedKeySize;
-
     return err;
 }
 
-static OS_Error_t
-OS_KeystoreFile_deleteKey(
-    OS_Keystore_t*  ptr,
-    const char*     name)
+OS_Error_t
+OS_KeystoreFile_migrate(
+    OS_FileSystem_Handle_t          hFs,
+    const char*                     name,
+    OS_KeystoreFile_Config_t const* from,
+    OS_KeystoreFile_Config_t const* to)
 {
     OS_Error_t err;
-    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
-
-    if (NULL == self || NULL == name)
+    OS_Keystore_Handle_t hSrc;
+    OS_Keystore_Handle_t hDst;
+
+    // Only the layout matters, the keys are not cached during a migration.
+    OS_KeystoreFile_Config_t srcConfig = {
+        .directory       = (NULL == from) ? NULL : from->directory,
+        .numShards       = (NULL == from) ? 0 : from->numShards,
+        .packSegmentSize = (NULL == from) ? 0 : from->packSegmentSize
+    };
+    OS_KeystoreFile_Config_t dstConfig = {
+        .directory       = (NULL == to) ? NULL : to->directory,
+        .numShards       = (NULL == to) ? 0 : to->numShards,
+        .packSegmentSize = (NULL == to) ? 0 : to->packSegmentSize
+    };
+
+    const char* srcDir = (NULL == srcConfig.directory) ? "" : srcConfig.directory;
+    const char* dstDir = (NULL == dstConfig.directory) ? "" : dstConfig.directory;
+
+    // Both layouts keep their index files in their directory, so they must
+    // not share it.
+    if (strcmp(srcDir, dstDir) == 0)
     {
+        Debug_LOG_ERROR("%s: Source and target layout use the same directory!",
+                        __func__);
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    size_t nameLen = strlen(name);
-
-    if (nameLen > OS_KeystoreFile_KeyName_MAX_NAME_LEN || nameLen == 0)
+    // No digest is computed, so no crypto handle is needed.
+    if ((err = OS_KeystoreFile_initWithConfig(&hSrc, hFs, NULL, name,
+                                              &srcConfig)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
-                        __func__,
-                        nameLen,
-                        OS_KeystoreFile_KeyName_MAX_NAME_LEN);
-        return OS_ERROR_INVALID_PARAMETER;
+        return err;
     }
 
-    if (!map_checkKeyExists(self, name))
+    if ((err = OS_KeystoreFile_initWithConfig(&hDst, hFs, NULL, name,
+                                              &dstConfig)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: The key with the name %s does not exist!",
-                        __func__, name);
-        return OS_ERROR_NOT_FOUND;
+        goto err0;
     }
 
-    err = map_deregisterKey(self, name);
+    OS_KeystoreFile_t* src = (OS_KeystoreFile_t*) hSrc;
+    OS_KeystoreFile_t* dst = (OS_KeystoreFile_t*) hDst;
 
-    if (err != OS_SUCCESS)
+    for (int slot = OS_KeystoreFile_KeyNameMap_getNext(&src->keyNameMap, 0);
+         slot >= 0;
+         slot = OS_KeystoreFile_KeyNameMap_getNext(&src->keyNameMap, slot + 1))
     {
-        Debug_LOG_ERROR("%s: Failed to deregister the key name, error code %d!",
-                        __func__, err);
-        return err;
+        OS_KeystoreFile_KeyName const* keyName =
+            OS_KeystoreFile_KeyNameMap_getKeyAt(&src->keyNameMap, slot);
+        KeyLookup lookup;
+
+        // Copied by an earlier, interrupted migration.
+        map_lookup(dst, keyName->buffer, &lookup);
+        if (map_checkKeyExists(&lookup))
+        {
+            continue;
+        }
+
+        if ((err = copyKeyFile(src, keyName->buffer, dst)) != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("%s: Failed to copy the key %s, err %d!",
+                            __func__, keyName->buffer, err);
+            goto err1;
+        }
     }
 
-    err = fs_deleteKey(self->hFs, self->name, name);
+    // All keys are in the target layout now, remove the source layout.
+    if ((err = OS_KeystoreFile_wipeKeystore(hSrc)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: Failed to remove the old key files, err %d!",
+                        __func__, err);
+        goto err1;
+    }
 
-    if (err != OS_SUCCESS)
+    if ((err = OS_KeystoreFile_IndexFile_remove(&src->indexFile)) != OS_SUCCESS)
     {
-        Debug_LOG_ERROR("%s: fs_deleteKey failed with error code %d!",
+        Debug_LOG_ERROR("%s: Failed to remove the old index files, err %d!",
                         __func__, err);
-        return err;
     }
 
+err1:
+    OS_KeystoreFile_free(hDst);
+err0:
+    OS_KeystoreFile_free(hSrc);
+
     return err;
 }
 
-static OS_Error_t
-OS_KeystoreFile_copyKey(
-    OS_Keystore_t*  srcPtr,
-    const char*     name,
-    OS_Keystore_t*  dstPtr)
+OS_Error_t
+OS_KeystoreFile_compact(
+    OS_Keystore_Handle_t    hKeystore,
+    bool*                   isDone)
 {
-    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) srcPtr;
-
-    return OS_Keystore_copyKeyImpl(
-               srcPtr,
-               name,
-               dstPtr,
-               self->buffer,
-               sizeof(self->buffer));
-}
+    OS_Error_t err = OS_SUCCESS;
 
-static OS_Error_t
-OS_KeystoreFile_wipeKeystore(
-    OS_Keystore_t*  ptr)
-{
-    OS_Error_t err;
-    OS_KeystoreFile_t*  self = (OS_KeystoreFile_t*) ptr;
+    if ((NULL == hKeystore) || (hKeystore->vtable != &OS_KeystoreFile_vtable))
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
 
-    if (NULL == self)
+    if (NULL == isDone)
     {
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    int registerSize = OS_KeystoreFile_KeyNameMap_getSize(&self->keyNameMap);
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) hKeystore;
 
-    if (registerSize < 0)
-    {
-        Debug_LOG_ERROR("%s: Failed to read the key name register size!",
-                        __func__);
-        return OS_ERROR_ABORTED;
-    }
+    OS_Keystore_lock(hKeystore);
 
-    if (registerSize == 0)
+    unsigned int segment =
+        OS_KeystoreFile_PackFile_getCompactionCandidate(&self->packFile, false);
+
+    // A single segment per call keeps the time spent bounded.
+    if (segment > 0)
     {
-        Debug_LOG_INFO("%s: Trying to wipe an empty keystore! Returning...",
-                       __func__);
-        return OS_SUCCESS;
+        err = pack_compactSegment(self, segment);
     }
 
-    for (int i = registerSize - 1; i >= 0; i--)
-    {
-        OS_KeystoreFile_KeyName const* keyName =
-            OS_KeystoreFile_KeyNameMap_getKeyAt(&self->keyNameMap, i);
-        err = OS_KeystoreFile_deleteKey(ptr, keyName->buffer);
+    *isDone = (OS_KeystoreFile_PackFile_getCompactionCandidate(&self->packFile,
+                                                               false) == 0);
 
-        if (err != OS_SUCCESS)
-        {
-            Debug_LOG_ERROR("%s: Failed to delete the key %s!",
-                            __func__, keyName->buffer);
-            return err;
-        }
-    }
+    snapshot_publish(self);
+    OS_Keystore_unlock(hKeystore);
 
     return err;
 }
 
-
-// Public functions ------------------------------------------------------------
-
 OS_Error_t
-OS_KeystoreFile_init(
-    OS_Keystore_Handle_t*  pHandle,
-    OS_FileSystem_Handle_t hFs,
-    OS_Crypto_Handle_t     hCrypto,
-    const char*            name)
+OS_KeystoreFile_scrub(
+    OS_Keystore_Handle_t                    hKeystore,
+    OS_KeystoreFile_ScrubCursor_t*          cursor,
+    OS_KeystoreFile_ScrubParams_t const*    params,
+    bool*                                   isDone)
 {
-    OS_Error_t err          = OS_ERROR_GENERIC;
-    OS_KeystoreFile_t* self = malloc(sizeof(OS_KeystoreFile_t));
+    if ((NULL == hKeystore) || (hKeystore->vtable != &OS_KeystoreFile_vtable))
+    {
+        return OS_ERROR_INVALID_HANDLE;
+    }
 
-    if (NULL == self)
+    if ((NULL == cursor) || (NULL == params) || (NULL == isDone))
     {
-        return OS_ERROR_INSUFFICIENT_SPACE;
+        return OS_ERROR_INVALID_PARAMETER;
     }
 
-    err = ctor(self, hFs, hCrypto, name);
+    OS_Keystore_lock(hKeystore);
+    OS_Error_t err = scrubStep((OS_KeystoreFile_t*) hKeystore, cursor, params,
+                               isDone);
+    snapshot_publish((OS_KeystoreFile_t*) hKeystore);
+    OS_Keystore_unlock(hKeystore);
 
-    if (err != OS_SUCCESS)
+    return err;
+}
+
+OS_Error_t
+OS_KeystoreFile_getCacheStats(
+    OS_Keystore_Handle_t            hKeystore,
+    OS_KeystoreFile_CacheStats_t*   stats)
+{
+    if ((NULL == hKeystore) || (hKeystore->vtable != &OS_KeystoreFile_vtable))
     {
-        free(self);
+        return OS_ERROR_INVALID_HANDLE;
     }
-    else
+
+    if (NULL == stats)
     {
-        *pHandle = OS_KeystoreFile_TO_OS_KEYSTORE(self);
+        return OS_ERROR_INVALID_PARAMETER;
     }
 
-    return err;
+    OS_KeystoreFile_t* self = (OS_KeystoreFile_t*) hKeystore;
+
+    OS_Keystore_lock(hKeystore);
+    OS_KeystoreFile_Cache_getCounters(&self->cache, &stats->hits,
+                                      &stats->misses, &stats->evictions,
+                                      &stats->usedBytes);
+    OS_Keystore_unlock(hKeystore);
+
+    return OS_SUCCESS;
 }
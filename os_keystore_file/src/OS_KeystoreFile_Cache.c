@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreFile_Cache.h"
+#include "OS_Keystore.int.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+// Private functions -----------------------------------------------------------
+
+static int
+find(
+    OS_KeystoreFile_Cache const*    self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash)
+{
+    for (int i = 0; i < OS_KeystoreFile_Cache_MAX_ENTRIES; i++)
+    {
+        OS_KeystoreFile_Cache_Entry const* entry = &self->entries[i];
+
+        if (entry->isUsed && (entry->hash == hash)
+            && OS_KeystoreFile_KeyName_isEqual(&entry->name, name))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void
+removeEntry(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_Cache_Entry*    entry)
+{
+    OS_Keystore_zeroize(entry->data, entry->size);
+    free(entry->data);
+
+    self->used -= entry->size;
+    memset(entry, 0, sizeof(*entry));
+}
+
+static OS_KeystoreFile_Cache_Entry*
+makeRoom(
+    OS_KeystoreFile_Cache*  self,
+    size_t                  size)
+{
+    OS_KeystoreFile_Cache_Entry* freeEntry = NULL;
+
+    for (;;)
+    {
+        if (NULL == freeEntry)
+        {
+            for (int i = 0; i < OS_KeystoreFile_Cache_MAX_ENTRIES; i++)
+            {
+                if (!self->entries[i].isUsed)
+                {
+                    freeEntry = &self->entries[i];
+                    break;
+                }
+            }
+        }
+
+        if ((NULL != freeEntry) && (self->used + size <= self->budget))
+        {
+            return freeEntry;
+        }
+
+        // Advance the clock hand until it finds an entry that has not been hit
+        // since it was passed the last time. This terminates after at most two
+        // rounds, as every entry passed loses its reference bit.
+        OS_KeystoreFile_Cache_Entry* entry = &self->entries[self->hand];
+        self->hand = (self->hand + 1) % OS_KeystoreFile_Cache_MAX_ENTRIES;
+
+        if (!entry->isUsed)
+        {
+            continue;
+        }
+
+        if (entry->isReferenced)
+        {
+            entry->isReferenced = false;
+            continue;
+        }
+
+        removeEntry(self, entry);
+        self->evictions++;
+
+        if (NULL == freeEntry)
+        {
+            freeEntry = entry;
+        }
+    }
+}
+
+
+// Public functions ------------------------------------------------------------
+
+void
+OS_KeystoreFile_Cache_ctor(
+    OS_KeystoreFile_Cache*  self,
+    OS_Keystore_t*          keystore,
+    size_t                  budget)
+{
+    memset(self, 0, sizeof(*self));
+    atomic_flag_clear(&self->lock);
+    self->keystore = keystore;
+    self->budget   = budget;
+}
+
+void
+OS_KeystoreFile_Cache_dtor(
+    OS_KeystoreFile_Cache*  self)
+{
+    OS_KeystoreFile_Cache_clear(self);
+}
+
+bool
+OS_KeystoreFile_Cache_get(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash,
+    void*                           keyData,
+    size_t                          keySize)
+{
+    if (0 == self->budget)
+    {
+        return false;
+    }
+
+    OS_Keystore_spinLock(self->keystore, &self->lock);
+
+    int i = find(self, name, hash);
+    bool isHit = (i >= 0) && (self->entries[i].size == keySize);
+
+    if (isHit)
+    {
+        OS_KeystoreFile_Cache_Entry* entry = &self->entries[i];
+
+        memcpy(keyData, entry->data, entry->size);
+        entry->isReferenced = true;
+        self->hits++;
+    }
+    else
+    {
+        self->misses++;
+    }
+
+    OS_Keystore_spinUnlock(&self->lock);
+
+    return isHit;
+}
+
+void
+OS_KeystoreFile_Cache_put(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash,
+    void const*                     keyData,
+    size_t                          keySize)
+{
+    if ((keySize == 0) || (keySize > self->budget))
+    {
+        return;
+    }
+
+    // The copy is made before the lock is taken, so it is held shortly.
+    uint8_t* data = malloc(keySize);
+
+    if (NULL == data)
+    {
+        OS_KeystoreFile_Cache_remove(self, name, hash);
+        return;
+    }
+
+    memcpy(data, keyData, keySize);
+
+    OS_Keystore_spinLock(self->keystore, &self->lock);
+
+    int i = find(self, name, hash);
+
+    if (i >= 0)
+    {
+        removeEntry(self, &self->entries[i]);
+    }
+
+    OS_KeystoreFile_Cache_Entry* entry = makeRoom(self, keySize);
+
+    entry->isUsed       = true;
+    entry->isReferenced = false;
+    entry->hash         = hash;
+    entry->name         = *name;
+    entry->size         = keySize;
+    entry->data         = data;
+
+    self->used += keySize;
+
+    OS_Keystore_spinUnlock(&self->lock);
+}
+
+void
+OS_KeystoreFile_Cache_remove(
+    OS_KeystoreFile_Cache*          self,
+    OS_KeystoreFile_KeyName const*  name,
+    uint32_t                        hash)
+{
+    OS_Keystore_spinLock(self->keystore, &self->lock);
+
+    int i = find(self, name, hash);
+
+    if (i >= 0)
+    {
+        removeEntry(self, &self->entries[i]);
+    }
+
+    OS_Keystore_spinUnlock(&self->lock);
+}
+
+void
+OS_KeystoreFile_Cache_clear(
+    OS_KeystoreFile_Cache*  self)
+{
+    OS_Keystore_spinLock(self->keystore, &self->lock);
+
+    for (int i = 0; i < OS_KeystoreFile_Cache_MAX_ENTRIES; i++)
+    {
+        if (self->entries[i].isUsed)
+        {
+            removeEntry(self, &self->entries[i]);
+        }
+    }
+
+    OS_Keystore_spinUnlock(&self->lock);
+}
+
+void
+OS_KeystoreFile_Cache_getCounters(
+    OS_KeystoreFile_Cache*  self,
+    uint64_t*               hits,
+    uint64_t*               misses,
+    uint64_t*               evictions,
+    size_t*                 used)
+{
+    OS_Keystore_spinLock(self->keystore, &self->lock);
+
+    *hits      = self->hits;
+    *misses    = self->misses;
+    *evictions = self->evictions;
+    *used      = self->used;
+
+    OS_Keystore_spinUnlock(&self->lock);
+}
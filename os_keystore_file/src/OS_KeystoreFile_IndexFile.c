@@ -0,0 +1,735 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreFile_IndexFile.h"
+#include "OS_Keystore.int.h"
+#include "lib_debug/Debug.h"
+#include "lib_utils/BitConverter.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Layout of the file header. All multi-byte fields are stored in big endian.
+#define HEADER_MAGIC            0x4F534B49  // "OSKI"
+#define HEADER_VERSION          2
+// Version 1 entries have no location of the key data, as all keys were kept
+// in files of their own.
+#define HEADER_VERSION_1        1
+#define HEADER_OFFS_MAGIC       0
+#define HEADER_OFFS_VERSION     4
+#define HEADER_OFFS_GENERATION  8
+#define HEADER_OFFS_CHECK       12
+#define HEADER_SIZE             16
+
+// Layout of an entry.
+#define ENTRY_OFFS_OP           0
+#define ENTRY_OFFS_FLAGS        1
+#define ENTRY_OFFS_NAME         4
+#define ENTRY_OFFS_KEY_SIZE     (ENTRY_OFFS_NAME + OS_KeystoreFile_KeyName_MAX_NAME_LEN + 1)
+#define ENTRY_OFFS_HASH         (ENTRY_OFFS_KEY_SIZE + 4)
+#define ENTRY_OFFS_SEGMENT      (ENTRY_OFFS_HASH + OS_KeystoreFile_KeyInfo_HASH_SIZE)
+#define ENTRY_OFFS_OFFSET       (ENTRY_OFFS_SEGMENT + 4)
+#define ENTRY_OFFS_CHECK        (ENTRY_OFFS_OFFSET + 4)
+#define ENTRY_SIZE              (ENTRY_OFFS_CHECK + 4)
+
+#define ENTRY_V1_OFFS_CHECK     (ENTRY_OFFS_HASH + OS_KeystoreFile_KeyInfo_HASH_SIZE)
+#define ENTRY_V1_SIZE           (ENTRY_V1_OFFS_CHECK + 4)
+
+// Number of entries serialized on the stack before they are written.
+#define WRITE_CHUNK_ENTRIES     16
+
+// A rewrite is done once the journal holds this many entries more than twice
+// the number of live keys.
+#define COMPACTION_SLACK        32
+
+// State of an index file, see checkFile().
+typedef enum
+{
+    FILE_MISSING,
+    //! Left behind by an interrupted rewrite, the snapshot has no END entry.
+    FILE_INCOMPLETE,
+    //! The header is damaged, so the generation of the file is unknown.
+    FILE_BAD_HEADER,
+    //! An entry of the snapshot is damaged.
+    FILE_CORRUPT,
+    FILE_VALID
+}
+FileState;
+
+
+// Private functions -----------------------------------------------------------
+
+static inline uint32_t
+calcCheck(
+    const uint8_t*  data,
+    size_t          len)
+{
+    // Only used to detect torn or garbled entries
+    return OS_Keystore_hashName(data, len);
+}
+
+static void
+serializeHeader(
+    uint8_t*    buf,
+    uint32_t    generation)
+{
+    memset(buf, 0, HEADER_SIZE);
+    BitConverter_putUint32BE(HEADER_MAGIC, &buf[HEADER_OFFS_MAGIC]);
+    buf[HEADER_OFFS_VERSION] = HEADER_VERSION;
+    BitConverter_putUint32BE(generation, &buf[HEADER_OFFS_GENERATION]);
+    BitConverter_putUint32BE(calcCheck(buf, HEADER_OFFS_CHECK),
+                             &buf[HEADER_OFFS_CHECK]);
+}
+
+static bool
+parseHeader(
+    const uint8_t*  buf,
+    size_t          len,
+    uint32_t*       generation,
+    uint8_t*        version)
+{
+    if ((len < HEADER_SIZE)
+        || (BitConverter_getUint32BE(&buf[HEADER_OFFS_MAGIC]) != HEADER_MAGIC)
+        || ((buf[HEADER_OFFS_VERSION] != HEADER_VERSION)
+            && (buf[HEADER_OFFS_VERSION] != HEADER_VERSION_1))
+        || (BitConverter_getUint32BE(&buf[HEADER_OFFS_CHECK]) !=
+            calcCheck(buf, HEADER_OFFS_CHECK)))
+    {
+        return false;
+    }
+
+    *generation = BitConverter_getUint32BE(&buf[HEADER_OFFS_GENERATION]);
+    *version    = buf[HEADER_OFFS_VERSION];
+
+    return true;
+}
+
+static inline size_t
+getEntrySize(
+    uint8_t version)
+{
+    return (HEADER_VERSION_1 == version) ? ENTRY_V1_SIZE : ENTRY_SIZE;
+}
+
+static void
+serializeEntry(
+    uint8_t*                                buf,
+    OS_KeystoreFile_IndexFile_Entry const*  entry)
+{
+    memset(buf, 0, ENTRY_SIZE);
+    buf[ENTRY_OFFS_OP]    = (uint8_t) entry->op;
+    buf[ENTRY_OFFS_FLAGS] = entry->info.flags;
+    memcpy(&buf[ENTRY_OFFS_NAME], entry->name.buffer,
+           OS_KeystoreFile_KeyName_MAX_NAME_LEN);
+    BitConverter_putUint32BE((uint32_t) entry->info.keySize,
+                             &buf[ENTRY_OFFS_KEY_SIZE]);
+    memcpy(&buf[ENTRY_OFFS_HASH], entry->info.hash,
+           OS_KeystoreFile_KeyInfo_HASH_SIZE);
+    BitConverter_putUint32BE(entry->info.segment, &buf[ENTRY_OFFS_SEGMENT]);
+    BitConverter_putUint32BE(entry->info.offset, &buf[ENTRY_OFFS_OFFSET]);
+    BitConverter_putUint32BE(calcCheck(buf, ENTRY_OFFS_CHECK),
+                             &buf[ENTRY_OFFS_CHECK]);
+}
+
+static bool
+parseEntry(
+    const uint8_t*                      buf,
+    uint8_t                             version,
+    OS_KeystoreFile_IndexFile_Entry*    entry)
+{
+    size_t offsCheck = (HEADER_VERSION_1 == version) ?
+                       ENTRY_V1_OFFS_CHECK : ENTRY_OFFS_CHECK;
+
+    if (BitConverter_getUint32BE(&buf[offsCheck]) != calcCheck(buf, offsCheck))
+    {
+        return false;
+    }
+
+    switch (buf[ENTRY_OFFS_OP])
+    {
+    case OS_KeystoreFile_IndexFile_OP_ADD:
+    case OS_KeystoreFile_IndexFile_OP_DEL:
+    case OS_KeystoreFile_IndexFile_OP_END:
+    case OS_KeystoreFile_IndexFile_OP_INTENT:
+        break;
+    default:
+        return false;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->op = (OS_KeystoreFile_IndexFile_Op) buf[ENTRY_OFFS_OP];
+    memcpy(entry->name.buffer, &buf[ENTRY_OFFS_NAME],
+           OS_KeystoreFile_KeyName_MAX_NAME_LEN);
+    entry->info.keySize = BitConverter_getUint32BE(&buf[ENTRY_OFFS_KEY_SIZE]);
+    memcpy(entry->info.hash, &buf[ENTRY_OFFS_HASH],
+           OS_KeystoreFile_KeyInfo_HASH_SIZE);
+
+    // Keys of a version 1 index are all in files of their own and have no
+    // flags, which is what the zeroed fields mean.
+    if (version != HEADER_VERSION_1)
+    {
+        entry->info.segment = BitConverter_getUint32BE(&buf[ENTRY_OFFS_SEGMENT]);
+        entry->info.offset  = BitConverter_getUint32BE(&buf[ENTRY_OFFS_OFFSET]);
+        entry->info.flags   = buf[ENTRY_OFFS_FLAGS];
+    }
+
+    return true;
+}
+
+// Reads a whole index file into a newly allocated buffer. A missing file is
+// reported with *buf set to NULL.
+static OS_Error_t
+readFile(
+    OS_KeystoreFile_Fs const*   fs,
+    const char*             fileName,
+    uint8_t**               buf,
+    size_t*                 len)
+{
+    OS_Error_t err;
+    OS_FileSystemFile_Handle_t hFile;
+    off_t sz;
+
+    *buf = NULL;
+    *len = 0;
+
+    err = OS_KeystoreFile_Fs_getSize(fs, fileName, &sz);
+    if (OS_ERROR_FS_FILE_NOT_FOUND == err)
+    {
+        return OS_SUCCESS;
+    }
+    else if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_getSize() failed on '%s' with %d",
+                        fileName, err);
+        return err;
+    }
+
+    if (sz < HEADER_SIZE)
+    {
+        // Cannot be a valid index, the caller treats it like a corrupted one.
+        *buf = malloc(HEADER_SIZE);
+        return (NULL == *buf) ? OS_ERROR_INSUFFICIENT_SPACE : OS_SUCCESS;
+    }
+
+    if ((*buf = malloc(sz)) == NULL)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    err = OS_KeystoreFile_Fs_open(
+              fs,
+              &hFile,
+              fileName,
+              OS_FileSystem_OpenMode_RDONLY,
+              OS_FileSystem_OpenFlags_NONE);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        fileName, err);
+        goto err0;
+    }
+
+    OS_Error_t readErr = OS_KeystoreFile_Fs_read(fs, hFile, 0, sz, *buf);
+    if (readErr != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+                        fileName, readErr);
+    }
+
+    if ((err = OS_KeystoreFile_Fs_close(fs, hFile)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
+                        fileName, err);
+    }
+
+    err = (readErr != OS_SUCCESS) ? readErr : err;
+    if (err != OS_SUCCESS)
+    {
+        goto err0;
+    }
+
+    *len = sz;
+
+    return OS_SUCCESS;
+
+err0:
+    free(*buf);
+    *buf = NULL;
+
+    return err;
+}
+
+// Checks that a file has a valid header and a complete snapshot. A snapshot
+// is written with a single pass, so an interrupted rewrite can only leave
+// invalid entries at its end. An invalid entry followed by a valid one means
+// the file is damaged.
+static FileState
+checkFile(
+    const uint8_t*  buf,
+    size_t          len,
+    uint32_t*       generation,
+    uint8_t*        version)
+{
+    OS_KeystoreFile_IndexFile_Entry entry;
+    bool isTorn = false;
+
+    if (NULL == buf)
+    {
+        return FILE_MISSING;
+    }
+
+    if (len < HEADER_SIZE)
+    {
+        // The rewrite was interrupted before the header was complete.
+        return FILE_INCOMPLETE;
+    }
+
+    if (!parseHeader(buf, len, generation, version))
+    {
+        return FILE_BAD_HEADER;
+    }
+
+    size_t entrySize = getEntrySize(*version);
+
+    for (size_t offs = HEADER_SIZE; offs + entrySize <= len; offs += entrySize)
+    {
+        if (!parseEntry(&buf[offs], *version, &entry))
+        {
+            isTorn = true;
+        }
+        else if (isTorn)
+        {
+            return FILE_CORRUPT;
+        }
+        else if (OS_KeystoreFile_IndexFile_OP_END == entry.op)
+        {
+            return FILE_VALID;
+        }
+    }
+
+    return FILE_INCOMPLETE;
+}
+
+static OS_Error_t
+writeEntries(
+    OS_KeystoreFile_Fs const*               fs,
+    OS_FileSystemFile_Handle_t              hFile,
+    size_t                                  offs,
+    OS_KeystoreFile_IndexFile_Entry const*  entries,
+    size_t                                  numEntries)
+{
+    OS_Error_t err;
+    uint8_t buf[WRITE_CHUNK_ENTRIES * ENTRY_SIZE];
+
+    while (numEntries > 0)
+    {
+        size_t n = (numEntries > WRITE_CHUNK_ENTRIES) ?
+                   WRITE_CHUNK_ENTRIES : numEntries;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            serializeEntry(&buf[i * ENTRY_SIZE], &entries[i]);
+        }
+
+        err = OS_KeystoreFile_Fs_write(fs, hFile, offs, n * ENTRY_SIZE, buf);
+        if (err != OS_SUCCESS)
+        {
+            return err;
+        }
+
+        offs       += n * ENTRY_SIZE;
+        entries    += n;
+        numEntries -= n;
+    }
+
+    return OS_SUCCESS;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+void
+OS_KeystoreFile_IndexFile_ctor(
+    OS_KeystoreFile_IndexFile*  self,
+    OS_KeystoreFile_Fs const*   fs,
+    const char*                 prefix)
+{
+    memset(self, 0, sizeof(*self));
+
+    self->fs = fs;
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        snprintf(self->fileName[i], sizeof(self->fileName[i]), "%s.ix%u",
+                 prefix, i);
+    }
+}
+
+OS_Error_t
+OS_KeystoreFile_IndexFile_load(
+    OS_KeystoreFile_IndexFile*          self,
+    OS_KeystoreFile_IndexFile_ReplayFn  replay,
+    void*                               ctx)
+{
+    OS_Error_t err = OS_SUCCESS;
+    OS_KeystoreFile_IndexFile_Entry entry;
+    uint8_t* buf[2] = { NULL, NULL };
+    size_t len[2];
+    uint32_t generation[2] = { 0, 0 };
+    uint8_t version[2];
+    FileState state[2];
+    int chosen = -1;
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        if ((err = readFile(self->fs, self->fileName[i], &buf[i], &len[i]))
+            != OS_SUCCESS)
+        {
+            goto exit;
+        }
+
+        state[i] = checkFile(buf[i], len[i], &generation[i], &version[i]);
+
+        if ((FILE_VALID == state[i])
+            && ((chosen < 0) || (generation[i] > generation[chosen])))
+        {
+            chosen = i;
+        }
+    }
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        // Only a file the chosen one has replaced can be damaged without
+        // losing keys, its generation is lower. Starting with fewer keys
+        // would overwrite the damaged file with the next rewrite, so the
+        // load fails instead.
+        if ((FILE_BAD_HEADER == state[i])
+            || ((FILE_CORRUPT == state[i])
+                && ((chosen < 0) || (generation[i] >= generation[chosen]))))
+        {
+            Debug_LOG_ERROR("Index file '%s' is damaged", self->fileName[i]);
+            err = OS_ERROR_INVALID_STATE;
+            goto exit;
+        }
+
+        if ((FILE_INCOMPLETE == state[i]) || (FILE_CORRUPT == state[i]))
+        {
+            Debug_LOG_WARNING("Ignoring %s index file '%s'",
+                              (FILE_CORRUPT == state[i]) ?
+                              "outdated" : "incomplete",
+                              self->fileName[i]);
+        }
+    }
+
+    if (chosen < 0)
+    {
+        // Nothing stored yet, or only the first snapshot was interrupted.
+        goto exit;
+    }
+
+    self->active      = chosen;
+    self->exists      = true;
+    self->generation  = generation[chosen];
+    self->numEntries  = 0;
+    self->isLegacy    = (version[chosen] != HEADER_VERSION);
+
+    size_t entrySize = getEntrySize(version[chosen]);
+    size_t offs;
+    // Start of the invalid entries at the end of the journal, if any.
+    size_t tornOffs = 0;
+    for (offs = HEADER_SIZE; offs + entrySize <= len[chosen]; offs += entrySize)
+    {
+        if (!parseEntry(&buf[chosen][offs], version[chosen], &entry))
+        {
+            // A torn append, as long as no valid entry follows.
+            if (0 == tornOffs)
+            {
+                tornOffs = offs;
+            }
+            continue;
+        }
+
+        if (tornOffs > 0)
+        {
+            // The invalid entry is not at the end, the journal is damaged.
+            Debug_LOG_ERROR("Invalid entry at offset %zu in '%s'",
+                            tornOffs, self->fileName[chosen]);
+            err = OS_ERROR_INVALID_STATE;
+            goto exit;
+        }
+
+        if (OS_KeystoreFile_IndexFile_OP_END == entry.op)
+        {
+            continue;
+        }
+
+        self->numEntries++;
+
+        if (!replay(ctx, &entry))
+        {
+            Debug_LOG_ERROR("Failed to replay entry for key '%s'",
+                            entry.name.buffer);
+            err = OS_ERROR_ABORTED;
+            goto exit;
+        }
+    }
+
+    if (tornOffs > 0)
+    {
+        // The next append overwrites the torn entries, so the journal stays
+        // free of invalid entries that are followed by valid ones.
+        Debug_LOG_WARNING("Dropping torn entries at offset %zu in '%s'",
+                          tornOffs, self->fileName[chosen]);
+        offs = tornOffs;
+    }
+    self->writeOffset = offs;
+
+    // A leftover of an interrupted or outdated compaction is not needed
+    // anymore.
+    if (buf[1 - chosen] != NULL)
+    {
+        OS_KeystoreFile_Fs_delete(self->fs, self->fileName[1 - chosen]);
+    }
+
+exit:
+    free(buf[0]);
+    free(buf[1]);
+
+    return err;
+}
+
+OS_Error_t
+OS_KeystoreFile_IndexFile_append(
+    OS_KeystoreFile_IndexFile*              self,
+    OS_KeystoreFile_IndexFile_Entry const*  entries,
+    size_t                                  numEntries)
+{
+    OS_Error_t err;
+    OS_FileSystemFile_Handle_t hFile;
+
+    if (!self->exists)
+    {
+        // Create the initial file with an empty snapshot.
+        if ((err = OS_KeystoreFile_IndexFile_rewrite(self, NULL, NULL, 0))
+            != OS_SUCCESS)
+        {
+            return err;
+        }
+    }
+    else if (self->isLegacy)
+    {
+        // Entries of different layouts cannot be mixed in one file.
+        Debug_LOG_ERROR("Index file '%s' has an old format and needs a rewrite",
+                        self->fileName[self->active]);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    const char* fileName = self->fileName[self->active];
+
+    err = OS_KeystoreFile_Fs_open(
+              self->fs,
+              &hFile,
+              fileName,
+              OS_FileSystem_OpenMode_RDWR,
+              OS_FileSystem_OpenFlags_NONE);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        fileName, err);
+        return err;
+    }
+
+    OS_Error_t writeErr = writeEntries(
+                              self->fs,
+                              hFile,
+                              self->writeOffset,
+                              entries,
+                              numEntries);
+    if (writeErr != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
+                        fileName, writeErr);
+    }
+
+    if ((err = OS_KeystoreFile_Fs_close(self->fs, hFile)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
+                        fileName, err);
+    }
+
+    if (writeErr != OS_SUCCESS)
+    {
+        return writeErr;
+    }
+
+    self->writeOffset += numEntries * ENTRY_SIZE;
+    self->numEntries  += numEntries;
+
+    return err;
+}
+
+OS_Error_t
+OS_KeystoreFile_IndexFile_rewrite(
+    OS_KeystoreFile_IndexFile*              self,
+    OS_KeystoreFile_IndexFile_GetEntryFn    getEntry,
+    void*                                   ctx,
+    size_t                                  numEntries)
+{
+    OS_Error_t err, writeErr = OS_SUCCESS;
+    OS_FileSystemFile_Handle_t hFile;
+    OS_KeystoreFile_IndexFile_Entry entries[WRITE_CHUNK_ENTRIES];
+    uint8_t header[HEADER_SIZE];
+    unsigned int target = self->exists ? (1 - self->active) : self->active;
+    const char* fileName = self->fileName[target];
+    uint32_t generation = self->generation + 1;
+    size_t offs;
+
+    // Get rid of a stale or damaged file first, as the FileSystem would
+    // otherwise keep its old content beyond the end of what we write.
+    err = OS_KeystoreFile_Fs_delete(self->fs, fileName);
+    if ((err != OS_SUCCESS) && (err != OS_ERROR_FS_FILE_NOT_FOUND))
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_delete() failed on '%s' with %d",
+                        fileName, err);
+        return err;
+    }
+
+    err = OS_KeystoreFile_Fs_open(
+              self->fs,
+              &hFile,
+              fileName,
+              OS_FileSystem_OpenMode_RDWR,
+              OS_FileSystem_OpenFlags_CREATE);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        fileName, err);
+        return err;
+    }
+
+    serializeHeader(header, generation);
+    writeErr = OS_KeystoreFile_Fs_write(self->fs, hFile, 0, sizeof(header),
+                                       header);
+    offs = HEADER_SIZE;
+
+    for (size_t i = 0; (writeErr == OS_SUCCESS) && (i < numEntries); )
+    {
+        size_t n = 0;
+
+        for (; (n < WRITE_CHUNK_ENTRIES) && (i < numEntries); n++, i++)
+        {
+            if (!getEntry(ctx, i, &entries[n]))
+            {
+                writeErr = OS_ERROR_ABORTED;
+                break;
+            }
+            entries[n].op = OS_KeystoreFile_IndexFile_OP_ADD;
+        }
+
+        if (writeErr == OS_SUCCESS)
+        {
+            writeErr = writeEntries(self->fs, hFile, offs, entries, n);
+            offs += n * ENTRY_SIZE;
+        }
+    }
+
+    if (writeErr == OS_SUCCESS)
+    {
+        // The END entry makes the snapshot valid, it carries the number of
+        // keys in the snapshot.
+        memset(&entries[0], 0, sizeof(entries[0]));
+        entries[0].op           = OS_KeystoreFile_IndexFile_OP_END;
+        entries[0].info.keySize = numEntries;
+
+        writeErr = writeEntries(self->fs, hFile, offs, entries, 1);
+        offs += ENTRY_SIZE;
+    }
+
+    if (writeErr != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Writing the snapshot to '%s' failed with %d",
+                        fileName, writeErr);
+    }
+
+    if ((err = OS_KeystoreFile_Fs_close(self->fs, hFile)) != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_close() failed on '%s' with %d",
+                        fileName, err);
+    }
+
+    if ((writeErr != OS_SUCCESS) || (err != OS_SUCCESS))
+    {
+        OS_KeystoreFile_Fs_delete(self->fs, fileName);
+        return (writeErr != OS_SUCCESS) ? writeErr : err;
+    }
+
+    // The new snapshot is complete, the old file can go now.
+    if (self->exists)
+    {
+        err = OS_KeystoreFile_Fs_delete(self->fs, self->fileName[self->active]);
+        if (err != OS_SUCCESS)
+        {
+            // Not fatal, the next load picks the file with the higher
+            // generation and removes the other one.
+            Debug_LOG_WARNING("OS_FileSystemFile_delete() failed on '%s' with %d",
+                              self->fileName[self->active], err);
+        }
+    }
+
+    self->active      = target;
+    self->exists      = true;
+    self->isLegacy    = false;
+    self->generation  = generation;
+    self->writeOffset = offs;
+    self->numEntries  = numEntries;
+
+    return OS_SUCCESS;
+}
+
+bool
+OS_KeystoreFile_IndexFile_needsCompaction(
+    OS_KeystoreFile_IndexFile const*    self,
+    size_t                              numLiveKeys)
+{
+    return self->isLegacy ||
+           (self->numEntries > (2 * numLiveKeys + COMPACTION_SLACK));
+}
+
+OS_Error_t
+OS_KeystoreFile_IndexFile_remove(
+    OS_KeystoreFile_IndexFile*  self)
+{
+    OS_Error_t result = OS_SUCCESS;
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        OS_Error_t err = OS_KeystoreFile_Fs_delete(self->fs, self->fileName[i]);
+        if ((err != OS_SUCCESS) && (err != OS_ERROR_FS_FILE_NOT_FOUND))
+        {
+            Debug_LOG_ERROR("OS_FileSystemFile_delete() failed on '%s' with %d",
+                            self->fileName[i], err);
+            if (OS_SUCCESS == result)
+            {
+                result = err;
+            }
+        }
+    }
+
+    if (OS_SUCCESS == result)
+    {
+        self->active      = 0;
+        self->exists      = false;
+        self->isLegacy    = false;
+        self->generation  = 0;
+        self->writeOffset = 0;
+        self->numEntries  = 0;
+    }
+
+    return result;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreFile_KeyInfo.h"
+
+
+bool
+OS_KeystoreFile_KeyInfo_ctorCopy(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src)
+{
+    return OS_KeystoreFile_KeyInfo_assign(dst, src);
+}
+
+bool
+OS_KeystoreFile_KeyInfo_ctorMove(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src)
+{
+    return OS_KeystoreFile_KeyInfo_assign(dst, src);
+}
+
+bool
+OS_KeystoreFile_KeyInfo_assign(
+    OS_KeystoreFile_KeyInfo*       dst,
+    OS_KeystoreFile_KeyInfo const* src)
+{
+    *dst = *src;
+    return true;
+}
+
+void
+OS_KeystoreFile_KeyInfo_dtor(
+    OS_KeystoreFile_KeyInfo* el)
+{
+    return;
+}
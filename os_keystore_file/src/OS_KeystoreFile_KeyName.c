@@ -7,6 +7,7 @@
  */
 
 #include "OS_KeystoreFile_KeyName.h"
+#include "OS_Keystore.int.h"
 
 #include <string.h>
 
@@ -52,3 +53,12 @@ OS_KeystoreFile_KeyName_isEqual(
 {
     return !strncmp(a->buffer, b->buffer, sizeof(a->buffer));
 }
+
+uint32_t
+OS_KeystoreFile_KeyName_getHash(
+    OS_KeystoreFile_KeyName const* self)
+{
+    // Hash the name up to the null terminator.
+    return OS_Keystore_hashName(self->buffer,
+                                strnlen(self->buffer, sizeof(self->buffer)));
+}
@@ -8,7 +8,261 @@
 
 #include "OS_KeystoreFile_KeyNameMap.h"
 
-MapT_DEFINE(
-    OS_KeystoreFile_KeyName,
-    OS_KeystoreFile_KeySize,
-    OS_KeystoreFile_KeyNameMap);
+#include <string.h>
+#include <stdlib.h>
+
+#define MIN_CAPACITY    16
+
+
+// Private functions -----------------------------------------------------------
+
+static inline size_t
+getHome(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    uint32_t                            hash)
+{
+    return hash & (self->capacity - 1);
+}
+
+static void
+placeSlot(
+    OS_KeystoreFile_KeyNameMap_Slot*        slots,
+    size_t                                  capacity,
+    OS_KeystoreFile_KeyNameMap_Slot const*  src)
+{
+    size_t i = src->hash & (capacity - 1);
+
+    while (slots[i].isUsed)
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    slots[i] = *src;
+}
+
+static bool
+grow(
+    OS_KeystoreFile_KeyNameMap* self)
+{
+    size_t capacity = self->capacity * 2;
+    OS_KeystoreFile_KeyNameMap_Slot* slots = calloc(capacity, sizeof(*slots));
+
+    if (NULL == slots)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < self->capacity; i++)
+    {
+        if (self->slots[i].isUsed)
+        {
+            placeSlot(slots, capacity, &self->slots[i]);
+        }
+    }
+
+    free(self->slots);
+    self->slots    = slots;
+    self->capacity = capacity;
+
+    return true;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+bool
+OS_KeystoreFile_KeyNameMap_ctor(
+    OS_KeystoreFile_KeyNameMap* self,
+    size_t                      capacity)
+{
+    size_t cap = MIN_CAPACITY;
+
+    while (cap < capacity)
+    {
+        cap *= 2;
+    }
+
+    self->slots = calloc(cap, sizeof(*self->slots));
+    if (NULL == self->slots)
+    {
+        return false;
+    }
+
+    self->capacity = cap;
+    self->size     = 0;
+
+    return true;
+}
+
+void
+OS_KeystoreFile_KeyNameMap_dtor(
+    OS_KeystoreFile_KeyNameMap* self)
+{
+    free(self->slots);
+    memset(self, 0, sizeof(*self));
+}
+
+int
+OS_KeystoreFile_KeyNameMap_find(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    OS_KeystoreFile_KeyName const*      key,
+    uint32_t                            hash)
+{
+    // The load factor is kept below 1, so there is always an empty slot that
+    // terminates the probe sequence.
+    for (size_t i = getHome(self, hash);
+         self->slots[i].isUsed;
+         i = (i + 1) & (self->capacity - 1))
+    {
+        if ((self->slots[i].hash == hash)
+            && OS_KeystoreFile_KeyName_isEqual(&self->slots[i].key, key))
+        {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+bool
+OS_KeystoreFile_KeyNameMap_insert(
+    OS_KeystoreFile_KeyNameMap*     self,
+    OS_KeystoreFile_KeyName const*  key,
+    uint32_t                        hash,
+    OS_KeystoreFile_KeyInfo const*  value)
+{
+    OS_KeystoreFile_KeyNameMap_Slot slot;
+
+    // Keep the load factor at or below 3/4.
+    if (((self->size + 1) * 4 > self->capacity * 3) && !grow(self))
+    {
+        return false;
+    }
+
+    slot.isUsed = true;
+    slot.hash   = hash;
+    OS_KeystoreFile_KeyName_ctorCopy(&slot.key, key);
+    OS_KeystoreFile_KeyInfo_ctorCopy(&slot.value, value);
+
+    placeSlot(self->slots, self->capacity, &slot);
+    self->size++;
+
+    return true;
+}
+
+void
+OS_KeystoreFile_KeyNameMap_removeAt(
+    OS_KeystoreFile_KeyNameMap* self,
+    int                         slot)
+{
+    size_t mask = self->capacity - 1;
+    size_t hole = (size_t) slot;
+
+    memset(&self->slots[hole], 0, sizeof(self->slots[hole]));
+    self->size--;
+
+    // Backward shift deletion: move up every following entry of the cluster
+    // whose home slot is not between the hole and its current position, so
+    // lookups never need tombstones.
+    for (size_t i = (hole + 1) & mask; self->slots[i].isUsed; i = (i + 1) & mask)
+    {
+        size_t home = getHome(self, self->slots[i].hash);
+
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            self->slots[hole] = self->slots[i];
+            memset(&self->slots[i], 0, sizeof(self->slots[i]));
+            hole = i;
+        }
+    }
+}
+
+bool
+OS_KeystoreFile_KeyNameMap_assign(
+    OS_KeystoreFile_KeyNameMap*         self,
+    OS_KeystoreFile_KeyNameMap const*   src)
+{
+    if (self->capacity != src->capacity)
+    {
+        OS_KeystoreFile_KeyNameMap_Slot* slots =
+            malloc(src->capacity * sizeof(*slots));
+
+        if (NULL == slots)
+        {
+            return false;
+        }
+
+        free(self->slots);
+        self->slots    = slots;
+        self->capacity = src->capacity;
+    }
+
+    memcpy(self->slots, src->slots, src->capacity * sizeof(*self->slots));
+    self->size = src->size;
+
+    return true;
+}
+
+void
+OS_KeystoreFile_KeyNameMap_clear(
+    OS_KeystoreFile_KeyNameMap* self)
+{
+    memset(self->slots, 0, self->capacity * sizeof(*self->slots));
+    self->size = 0;
+}
+
+int
+OS_KeystoreFile_KeyNameMap_getNext(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot)
+{
+    for (size_t i = (slot < 0) ? 0 : (size_t) slot; i < self->capacity; i++)
+    {
+        if (self->slots[i].isUsed)
+        {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+OS_KeystoreFile_KeyName const*
+OS_KeystoreFile_KeyNameMap_getKeyAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot)
+{
+    return &self->slots[slot].key;
+}
+
+OS_KeystoreFile_KeyInfo const*
+OS_KeystoreFile_KeyNameMap_getValueAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot)
+{
+    return &self->slots[slot].value;
+}
+
+void
+OS_KeystoreFile_KeyNameMap_setValueAt(
+    OS_KeystoreFile_KeyNameMap*     self,
+    int                             slot,
+    OS_KeystoreFile_KeyInfo const*  value)
+{
+    OS_KeystoreFile_KeyInfo_assign(&self->slots[slot].value, value);
+}
+
+uint32_t
+OS_KeystoreFile_KeyNameMap_getHashAt(
+    OS_KeystoreFile_KeyNameMap const*   self,
+    int                                 slot)
+{
+    return self->slots[slot].hash;
+}
+
+size_t
+OS_KeystoreFile_KeyNameMap_getSize(
+    OS_KeystoreFile_KeyNameMap const*   self)
+{
+    return self->size;
+}
@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreFile_PackFile.h"
+#include "lib_debug/Debug.h"
+
+#include <string.h>
+#include <stdio.h>
+
+
+// Private functions -----------------------------------------------------------
+
+static inline OS_KeystoreFile_PackFile_Segment*
+getSegment(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment)
+{
+    return &self->segments[segment - 1];
+}
+
+static inline bool
+isSegmentOk(
+    unsigned int segment)
+{
+    return (segment > 0) && (segment <= OS_KeystoreFile_PackFile_MAX_SEGMENTS);
+}
+
+// Opens the file of a segment on first use, it then stays open.
+static OS_Error_t
+openSegment(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    OS_FileSystem_OpenFlags_t   flags)
+{
+    OS_KeystoreFile_PackFile_Segment* seg = getSegment(self, segment);
+
+    if (seg->isOpen)
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_Error_t err = OS_KeystoreFile_Fs_open(
+                         self->fs,
+                         &seg->hFile,
+                         self->fileName[segment - 1],
+                         OS_FileSystem_OpenMode_RDWR,
+                         flags);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_open() failed on '%s' with %d",
+                        self->fileName[segment - 1], err);
+        return err;
+    }
+
+    seg->isOpen = true;
+
+    return OS_SUCCESS;
+}
+
+static void
+closeSegment(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment)
+{
+    OS_KeystoreFile_PackFile_Segment* seg = getSegment(self, segment);
+
+    if (!seg->isOpen)
+    {
+        return;
+    }
+
+    OS_Error_t err = OS_KeystoreFile_Fs_close(self->fs, seg->hFile);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_WARNING("OS_FileSystemFile_close() failed on '%s' with %d",
+                          self->fileName[segment - 1], err);
+    }
+
+    seg->isOpen = false;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+void
+OS_KeystoreFile_PackFile_ctor(
+    OS_KeystoreFile_PackFile*   self,
+    OS_KeystoreFile_Fs const*   fs,
+    const char*                 prefix,
+    size_t                      segmentSize)
+{
+    memset(self, 0, sizeof(*self));
+    atomic_flag_clear(&self->openLock);
+
+    self->fs          = fs;
+    self->segmentSize = segmentSize;
+
+    for (unsigned int i = 0; i < OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        snprintf(self->fileName[i], sizeof(self->fileName[i]), "%s.pk%u",
+                 prefix, i + 1);
+    }
+}
+
+void
+OS_KeystoreFile_PackFile_dtor(
+    OS_KeystoreFile_PackFile*   self)
+{
+    for (unsigned int i = 1; i <= OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        closeSegment(self, i);
+    }
+}
+
+OS_Error_t
+OS_KeystoreFile_PackFile_load(
+    OS_KeystoreFile_PackFile*   self)
+{
+    OS_Error_t err;
+    off_t sz;
+
+    for (unsigned int i = 0; i < OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        err = OS_KeystoreFile_Fs_getSize(self->fs, self->fileName[i], &sz);
+        if (OS_ERROR_FS_FILE_NOT_FOUND == err)
+        {
+            continue;
+        }
+        else if (err != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("OS_FileSystemFile_getSize() failed on '%s' with %d",
+                            self->fileName[i], err);
+            return err;
+        }
+
+        // Whatever is beyond the last record in the index is dead, e.g. a
+        // record whose index entry never got written.
+        self->segments[i].size = sz;
+    }
+
+    return OS_SUCCESS;
+}
+
+void
+OS_KeystoreFile_PackFile_addLive(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    size_t                      len)
+{
+    if (isSegmentOk(segment))
+    {
+        getSegment(self, segment)->liveBytes += len;
+    }
+}
+
+void
+OS_KeystoreFile_PackFile_release(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    size_t                      len)
+{
+    if (isSegmentOk(segment))
+    {
+        OS_KeystoreFile_PackFile_Segment* seg = getSegment(self, segment);
+
+        seg->liveBytes = (seg->liveBytes > len) ? (seg->liveBytes - len) : 0;
+    }
+}
+
+unsigned int
+OS_KeystoreFile_PackFile_allocate(
+    OS_KeystoreFile_PackFile*   self,
+    size_t                      len)
+{
+    unsigned int numEmpty = 0;
+    unsigned int empty    = 0;
+
+    if ((self->active > 0)
+        && (getSegment(self, self->active)->size + len <= self->segmentSize))
+    {
+        return self->active;
+    }
+
+    // Continue with any segment that still has room, e.g. the target of a
+    // compaction, before a new one is started.
+    for (unsigned int i = 1; i <= OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        size_t size = getSegment(self, i)->size;
+
+        if (0 == size)
+        {
+            numEmpty++;
+            empty = (0 == empty) ? i : empty;
+        }
+        else if (size + len <= self->segmentSize)
+        {
+            self->active = i;
+            return i;
+        }
+    }
+
+    // The last empty segment is the spare for compactions.
+    if (numEmpty < 2)
+    {
+        return 0;
+    }
+
+    self->active = empty;
+
+    return empty;
+}
+
+OS_Error_t
+OS_KeystoreFile_PackFile_write(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    void const*                 record,
+    size_t                      len,
+    uint32_t*                   offset)
+{
+    OS_Error_t err;
+
+    if (!isSegmentOk(segment))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreFile_PackFile_Segment* seg = getSegment(self, segment);
+
+    if ((err = openSegment(self, segment, OS_FileSystem_OpenFlags_CREATE))
+        != OS_SUCCESS)
+    {
+        return err;
+    }
+
+    err = OS_KeystoreFile_Fs_write(self->fs, seg->hFile, seg->size, len, record);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_write() failed on '%s' with %d",
+                        self->fileName[segment - 1], err);
+        // The state of the file is unknown, open it again next time.
+        closeSegment(self, segment);
+        return err;
+    }
+
+    *offset         = (uint32_t) seg->size;
+    seg->size      += len;
+    seg->liveBytes += len;
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+OS_KeystoreFile_PackFile_read(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment,
+    uint32_t                    offset,
+    void*                       record,
+    size_t                      len)
+{
+    OS_Error_t err;
+
+    if (!isSegmentOk(segment))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // Only one of the reads running in parallel opens the file, the others
+    // wait for it.
+    if (!atomic_load(&getSegment(self, segment)->isOpen))
+    {
+        OS_Keystore_spinLock(self->fs->keystore, &self->openLock);
+        err = openSegment(self, segment, OS_FileSystem_OpenFlags_NONE);
+        OS_Keystore_spinUnlock(&self->openLock);
+
+        if (err != OS_SUCCESS)
+        {
+            return err;
+        }
+    }
+
+    err = OS_KeystoreFile_Fs_read(self->fs, getSegment(self, segment)->hFile,
+                                 offset, len, record);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_read() failed on '%s' with %d",
+                        self->fileName[segment - 1], err);
+    }
+
+    return err;
+}
+
+unsigned int
+OS_KeystoreFile_PackFile_getEmpty(
+    OS_KeystoreFile_PackFile const* self)
+{
+    for (unsigned int i = 0; i < OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        if (0 == self->segments[i].size)
+        {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+unsigned int
+OS_KeystoreFile_PackFile_getCompactionCandidate(
+    OS_KeystoreFile_PackFile const* self,
+    bool                            force)
+{
+    unsigned int candidate = 0;
+    size_t maxDead = 0;
+
+    for (unsigned int i = 0; i < OS_KeystoreFile_PackFile_MAX_SEGMENTS; i++)
+    {
+        OS_KeystoreFile_PackFile_Segment const* seg = &self->segments[i];
+        size_t dead = (seg->size > seg->liveBytes) ?
+                      (seg->size - seg->liveBytes) : 0;
+
+        if ((dead > maxDead) && (force || (dead * 2 >= seg->size)))
+        {
+            candidate = i + 1;
+            maxDead   = dead;
+        }
+    }
+
+    return candidate;
+}
+
+OS_Error_t
+OS_KeystoreFile_PackFile_remove(
+    OS_KeystoreFile_PackFile*   self,
+    unsigned int                segment)
+{
+    if (!isSegmentOk(segment))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreFile_PackFile_Segment* seg = getSegment(self, segment);
+
+    // Nothing has been written, there is at most an empty file.
+    if ((0 == seg->size) && !seg->isOpen)
+    {
+        return OS_SUCCESS;
+    }
+
+    closeSegment(self, segment);
+
+    OS_Error_t err = OS_KeystoreFile_Fs_delete(self->fs,
+                                              self->fileName[segment - 1]);
+    if ((err != OS_SUCCESS) && (err != OS_ERROR_FS_FILE_NOT_FOUND))
+    {
+        Debug_LOG_ERROR("OS_FileSystemFile_delete() failed on '%s' with %d",
+                        self->fileName[segment - 1], err);
+        return err;
+    }
+
+    seg->size      = 0;
+    seg->liveBytes = 0;
+
+    if (self->active == segment)
+    {
+        self->active = 0;
+    }
+
+    return OS_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2019-2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "OS_KeystoreFile_Sha256.h"
+#include "lib_utils/BitConverter.h"
+
+#include <string.h>
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+// Private functions -----------------------------------------------------------
+
+static void
+processBlock(
+    OS_KeystoreFile_Sha256* self,
+    const uint8_t*          block)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        w[i] = BitConverter_getUint32BE(&block[i * 4]);
+    }
+    for (unsigned int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = self->state[0];
+    b = self->state[1];
+    c = self->state[2];
+    d = self->state[3];
+    e = self->state[4];
+    f = self->state[5];
+    g = self->state[6];
+    h = self->state[7];
+
+    for (unsigned int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + K[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    self->state[0] += a;
+    self->state[1] += b;
+    self->state[2] += c;
+    self->state[3] += d;
+    self->state[4] += e;
+    self->state[5] += f;
+    self->state[6] += g;
+    self->state[7] += h;
+}
+
+
+// Public functions ------------------------------------------------------------
+
+void
+OS_KeystoreFile_Sha256_init(
+    OS_KeystoreFile_Sha256* self)
+{
+    static const uint32_t iv[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(self->state, iv, sizeof(self->state));
+    self->length   = 0;
+    self->blockLen = 0;
+}
+
+void
+OS_KeystoreFile_Sha256_process(
+    OS_KeystoreFile_Sha256* self,
+    const void*             data,
+    size_t                  len)
+{
+    const uint8_t* p = data;
+
+    self->length += len;
+
+    while (len > 0)
+    {
+        if ((0 == self->blockLen) && (len >= sizeof(self->block)))
+        {
+            processBlock(self, p);
+            p   += sizeof(self->block);
+            len -= sizeof(self->block);
+            continue;
+        }
+
+        size_t n = sizeof(self->block) - self->blockLen;
+        n = (n > len) ? len : n;
+
+        memcpy(&self->block[self->blockLen], p, n);
+        self->blockLen += n;
+        p   += n;
+        len -= n;
+
+        if (self->blockLen == sizeof(self->block))
+        {
+            processBlock(self, self->block);
+            self->blockLen = 0;
+        }
+    }
+}
+
+void
+OS_KeystoreFile_Sha256_finalize(
+    OS_KeystoreFile_Sha256* self,
+    uint8_t                 digest[OS_KeystoreFile_Sha256_SIZE])
+{
+    uint64_t bitLen = self->length * 8;
+
+    self->block[self->blockLen++] = 0x80;
+
+    if (self->blockLen > sizeof(self->block) - 8)
+    {
+        memset(&self->block[self->blockLen], 0,
+               sizeof(self->block) - self->blockLen);
+        processBlock(self, self->block);
+        self->blockLen = 0;
+    }
+
+    memset(&self->block[self->blockLen], 0,
+           sizeof(self->block) - 8 - self->blockLen);
+    BitConverter_putUint32BE((uint32_t)(bitLen >> 32), &self->block[56]);
+    BitConverter_putUint32BE((uint32_t) bitLen, &self->block[60]);
+    processBlock(self, self->block);
+
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        BitConverter_putUint32BE(self->state[i], &digest[i * 4]);
+    }
+
+    // Do not leave traces of the hashed data behind.
+    memset(self, 0, sizeof(*self));
+}
@@ -20,8 +20,36 @@
  * API architecture. KeystoreRamFV is the formally verified module which
  * contains all the real business logic.
  *
+ * Optionally, OS_KeystoreRamFV_initWithConfig() adds slabs to the instance. A
+ * slab is a second memory buffer split into slots of a fixed size, e.g. 32
+ * bytes for AES keys. Every element of KeystoreRamFV reserves room for the
+ * largest possible key, so storing small keys in a slab of a matching slot
+ * size allows to keep many more keys in the same amount of RAM. A key is
+ * stored in the slab with the smallest slots it fits into that has a free
+ * slot, and in KeystoreRamFV if there is none.
+ *
  * NOTE: This implementation stores the keys without additional hashing.
  *
+ * NOTE: Keys held in a slab are managed by the wrapper and not by the formally
+ * verified KeystoreRamFV.
+ *
+ * NOTE: If the handle is shared between threads, see OS_Keystore_setLock(),
+ * loadKey(), listKeys() and getKeyInfo() do not take the lock to look up a
+ * name. Keys held in a slab are loaded without any lock, keys held by
+ * KeystoreRamFV under the lock taken as reader. Writers publish a new copy of
+ * the name registry and wait until the readers of the previous copy are done,
+ * so storing and deleting keys gets more expensive with the size of the
+ * registry. A writer that waits for a preempted reader calls the yield
+ * callback of the lock, see OS_Keystore_RwLock_t. A load of a key held by
+ * KeystoreRamFV needs a whole record, the read buffer of the config provides
+ * one per load that may run in parallel.
+ *
+ * NOTE: OS_Keystore_borrowKey() lends keys held in a slab without copying
+ * them, e.g. RSA keys from a slab with slots of OS_KeystoreRamFV_MAX_KEY_SIZE
+ * bytes. Keys held by KeystoreRamFV are copied, it only hands out copies of
+ * its records, as are keys that are about to be deleted. Borrowing takes no
+ * lock, like loadKey().
+ *
  * NOTE: There is no persistence of the keys after a power-cycle or after an
  * init()-free()-cycle.
  */
@@ -33,6 +61,8 @@
 
 #include "lib_debug/Debug.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 
@@ -80,10 +110,113 @@ Debug_STATIC_ASSERT(
 #define OS_KeystoreRamFV_NUM_ELEMENTS_BUFFER(size_of_buffer) \
     ((size_of_buffer) / sizeof(KeystoreRamFV_ElementRecord_t))
 
+//! Macro to translate an amount of loads of keys held by KeystoreRamFV that
+//! may run in parallel into the needed amount of bytes in memory, see
+//! OS_KeystoreRamFV_Config_t.
+#define OS_KeystoreRamFV_SIZE_OF_READ_BUFFER(num_readers) \
+    ((num_readers) * sizeof(KeystoreRamFV_KeyRecord_t))
+
+//! Maximum number of slabs of an instance.
+#define OS_KeystoreRamFV_MAX_SLABS  4
+
+//! Macro to translate an amount of slots of a slab into the needed amount of
+//! bytes in memory to store them.
+#define OS_KeystoreRamFV_SIZE_OF_SLAB(slot_size, num_slots) \
+    ((slot_size) * (num_slots))
+
+//! Flag in the lease counter of a slot whose key is about to be deleted.
+#define OS_KeystoreRamFV_LEASE_DELETING 0x80000000u
+
 //! Macro to get the pointer to the parent struct OS_Keystore_t.
 #define OS_KeystoreRamFV_TO_OS_KEYSTORE(self)   (&((self)->parent))
 
 
+/**
+ * Entry of the name registry of the wrapper. KeystoreRamFV only offers access
+ * to a key by its name, the registry allows to enumerate the keys and to query
+ * their sizes without fetching the key records.
+ *
+ * The registry is a hash table with linear probing, so the wrapper resolves a
+ * name without scanning all records. It is authoritative for the existence of
+ * a key, KeystoreRamFV is only called for keys found in the registry.
+ */
+typedef struct
+{
+    bool        isUsed;
+    uint32_t    hash;
+    //! Zero if the key is held by KeystoreRamFV, otherwise the index + 1 of
+    //! the slab that holds the key.
+    uint8_t     slab;
+    //! Slot of the key in the slab.
+    uint32_t    slot;
+    uint32_t    keySize;
+    //! Zero padded name as passed to KeystoreRamFV.
+    char        name[KeystoreRamFV_KEY_NAME_SIZE];
+}
+OS_KeystoreRamFV_NameEntry;
+
+/**
+ * Name registry. Readers use it without taking a lock, so writers modify a
+ * copy and publish it afterwards.
+ */
+typedef struct
+{
+    OS_KeystoreRamFV_NameEntry* names;
+    //! Number of used entries in names.
+    size_t                      usedNames;
+}
+OS_KeystoreRamFV_Registry;
+
+/**
+ * Settings of a slab, see OS_KeystoreRamFV_Config_t.
+ */
+typedef struct
+{
+    //! Size of a slot in bytes, i.e. the maximum size of a key in the slab.
+    size_t  slotSize;
+    //! The memory area that will hold the keys of the slab.
+    void*   buf;
+    //! The capacity, in bytes, of buf. See OS_KeystoreRamFV_SIZE_OF_SLAB().
+    size_t  bufSize;
+}
+OS_KeystoreRamFV_SlabConfig_t;
+
+/**
+ * Settings of an instance, see OS_KeystoreRamFV_initWithConfig().
+ */
+typedef struct
+{
+    //! The memory area that will hold the keys managed by KeystoreRamFV.
+    void*                           buf;
+    //! The capacity, in bytes, of buf. See OS_KeystoreRamFV_SIZE_OF_BUFFER().
+    size_t                          bufSize;
+    //! Number of used entries in slabs.
+    size_t                          numSlabs;
+    //! Slabs ordered by ascending slot size.
+    OS_KeystoreRamFV_SlabConfig_t   slabs[OS_KeystoreRamFV_MAX_SLABS];
+    //! Optional memory area for the records of loads of keys held by
+    //! KeystoreRamFV, without it these loads run one at a time.
+    void*                           readBuf;
+    //! The capacity, in bytes, of readBuf. See
+    //! OS_KeystoreRamFV_SIZE_OF_READ_BUFFER().
+    size_t                          readBufSize;
+}
+OS_KeystoreRamFV_Config_t;
+
+typedef struct
+{
+    size_t          slotSize;
+    size_t          numSlots;
+    uint8_t*        slots;
+    //! Stack of the indices of the free slots.
+    uint32_t*       freeSlots;
+    size_t          numFree;
+    //! Number of times the key of a slot is lent, see borrowKey(), or'ed
+    //! with OS_KeystoreRamFV_LEASE_DELETING while the key is deleted.
+    atomic_uint*    leases;
+}
+OS_KeystoreRamFV_Slab;
+
 /**
  * OS_KeystoreRamFV context.
  */
@@ -93,8 +226,33 @@ typedef struct
     OS_Keystore_t               parent;
     //! KeystoreRamFV_t context which implements the kernel functions.
     KeystoreRamFV_t             fvKeystore;
-    //! Temporary support record for operations.
+    //! Temporary support record for storeKey() and copyKey().
     KeystoreRamFV_KeyRecord_t   keyRecord;
+    //! Number of leading bytes of the key data in keyRecord that may be
+    //! non-zero, all following bytes are zero.
+    size_t                      recordUsed;
+    OS_KeystoreRamFV_Slab       slabs[OS_KeystoreRamFV_MAX_SLABS];
+    size_t                      numSlabs;
+    //! Number of entries of a name registry, a power of two that allows to
+    //! hold a name per element of the key buffer and per slot of the slabs.
+    size_t                      numNames;
+    //! The published name registry and the spare one for the next update.
+    OS_KeystoreRamFV_Registry   registries[2];
+    _Atomic(OS_KeystoreRamFV_Registry*) registry;
+    //! Epoch and number of readers per epoch, used to wait until the readers
+    //! of a replaced registry are done.
+    atomic_uint                 epoch;
+    atomic_size_t               readers[2];
+    //! Number of lent keys of all slabs.
+    atomic_size_t               numLeases;
+    //! Set while wipeKeystore() runs, no keys are lent meanwhile.
+    atomic_bool                 isWiping;
+    //! Records of loadKey() for keys held by KeystoreRamFV, the ones of the
+    //! read buffer or readRecord, and whether they are in use.
+    KeystoreRamFV_KeyRecord_t*  readRecords;
+    size_t                      numReadRecords;
+    atomic_bool*                readBusy;
+    KeystoreRamFV_KeyRecord_t   readRecord;
 }
 OS_KeystoreRamFV_t;
 
@@ -105,7 +263,8 @@ OS_KeystoreRamFV_t;
  *
  * @retval OS_SUCCESS                   Operation was successful.
  * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
- *                                      OS_KeystoreRamFV_t context.
+ *                                      OS_KeystoreRamFV_t context or its name
+ *                                      registry.
  * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
  *                                      valid for some reason.
  *
@@ -120,3 +279,24 @@ OS_KeystoreRamFV_init(
     OS_Keystore_Handle_t*   pHandle,
     void*                   buf,
     size_t                  bufSize);
+
+/**
+ * Same as OS_KeystoreRamFV_init(), but allows to add slabs for small keys to
+ * the instance.
+ *
+ * @retval OS_SUCCESS                   Operation was successful.
+ * @retval OS_ERROR_INSUFFICIENT_SPACE  Failed to allocate space for the
+ *                                      OS_KeystoreRamFV_t context or its name
+ *                                      registry.
+ * @retval OS_ERROR_INVALID_PARAMETER   Some of the needed parameters are not
+ *                                      valid for some reason, e.g. the slabs
+ *                                      are not ordered by ascending slot size.
+ *
+ * @param[out] pHandle  Pointer to the variable of the caller supposed to hold
+ *                      the OS_Keystore_Handle_t return value.
+ * @param[in]  config   Memory areas of KeystoreRamFV and of the slabs.
+ */
+OS_Error_t
+OS_KeystoreRamFV_initWithConfig(
+    OS_Keystore_Handle_t*               pHandle,
+    OS_KeystoreRamFV_Config_t const*    config);
@@ -19,6 +19,10 @@
 // same appId here defined.
 #define APP_ID 0
 
+// Number of times a writer polls the readers before it yields, see
+// registry_commit().
+#define MAX_SPINS 64
+
 
 // Vtable definition -----------------------------------------------------------
 
@@ -55,6 +59,31 @@ static OS_Error_t
 OS_KeystoreRamFV_wipeKeystore(
     OS_Keystore_t*  ptr);
 
+static OS_Error_t
+OS_KeystoreRamFV_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize);
+
+static OS_Error_t
+OS_KeystoreRamFV_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize);
+
+static OS_Error_t
+OS_KeystoreRamFV_borrowKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Lease_t*    lease);
+
+static OS_Error_t
+OS_KeystoreRamFV_releaseKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Lease_t*    lease);
+
 static const OS_Keystore_Vtable_t OS_KeystoreRamFV_vtable =
 {
     .free           = OS_KeystoreRamFV_free,
@@ -63,7 +92,17 @@ static const OS_Keystore_Vtable_t OS_KeystoreRamFV_vtable =
     .deleteKey      = OS_KeystoreRamFV_deleteKey,
     .copyKey        = OS_KeystoreRamFV_copyKey,
     .moveKey        = OS_Keystore_moveKeyImpl,
-    .wipeKeystore   = OS_KeystoreRamFV_wipeKeystore
+    .wipeKeystore   = OS_KeystoreRamFV_wipeKeystore,
+    .storeKeys      = OS_Keystore_storeKeysImpl,
+    .loadKeys       = OS_Keystore_loadKeysImpl,
+    .deleteKeys     = OS_Keystore_deleteKeysImpl,
+    .listKeys       = OS_KeystoreRamFV_listKeys,
+    .getKeyInfo     = OS_KeystoreRamFV_getKeyInfo,
+    .borrowKey      = OS_KeystoreRamFV_borrowKey,
+    .releaseKey     = OS_KeystoreRamFV_releaseKey,
+    // Loads synchronize with writers through the registry and the shared
+    // lock, see loadKey().
+    .hasLockFreeReads = true
 };
 
 
@@ -135,27 +174,466 @@ isStoreKeyParametersOk(
     return true;
 }
 
+static inline uint32_t
+names_getHash(
+    const char* cleanName)
+{
+    // Hash the name up to the zero padding.
+    size_t len = strnlen(cleanName, KeystoreRamFV_KEY_NAME_SIZE);
+
+    return OS_Keystore_hashName(cleanName, len);
+}
+
+static inline size_t
+names_getHome(
+    OS_KeystoreRamFV_t const*   self,
+    uint32_t                    hash)
+{
+    return hash & (self->numNames - 1);
+}
+
+static int
+names_find(
+    OS_KeystoreRamFV_t const*           self,
+    OS_KeystoreRamFV_Registry const*    registry,
+    const char*                         cleanName)
+{
+    if (0 == self->numNames)
+    {
+        return -1;
+    }
+
+    uint32_t hash = names_getHash(cleanName);
+
+    // The registry is never full, so there is always an unused entry that
+    // terminates the probe sequence.
+    for (size_t i = names_getHome(self, hash);
+         registry->names[i].isUsed;
+         i = (i + 1) & (self->numNames - 1))
+    {
+        if ((registry->names[i].hash == hash)
+            && (memcmp(registry->names[i].name, cleanName,
+                       KeystoreRamFV_KEY_NAME_SIZE) == 0))
+        {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+static bool
+names_add(
+    OS_KeystoreRamFV_t const*   self,
+    OS_KeystoreRamFV_Registry*  registry,
+    const char*                 cleanName,
+    size_t                      keySize,
+    uint8_t                     slab,
+    uint32_t                    slot)
+{
+    if (registry->usedNames + 1 >= self->numNames)
+    {
+        return false;
+    }
+
+    uint32_t hash = names_getHash(cleanName);
+    size_t i      = names_getHome(self, hash);
+
+    while (registry->names[i].isUsed)
+    {
+        i = (i + 1) & (self->numNames - 1);
+    }
+
+    registry->names[i].isUsed  = true;
+    registry->names[i].hash    = hash;
+    registry->names[i].slab    = slab;
+    registry->names[i].slot    = slot;
+    registry->names[i].keySize = keySize;
+    memcpy(registry->names[i].name, cleanName, KeystoreRamFV_KEY_NAME_SIZE);
+    registry->usedNames++;
+
+    return true;
+}
+
+static void
+names_removeAt(
+    OS_KeystoreRamFV_t const*   self,
+    OS_KeystoreRamFV_Registry*  registry,
+    int                         entry)
+{
+    OS_KeystoreRamFV_NameEntry* names = registry->names;
+    size_t mask = self->numNames - 1;
+    size_t hole = (size_t) entry;
+
+    memset(&names[hole], 0, sizeof(names[hole]));
+    registry->usedNames--;
+
+    // Backward shift deletion: move up every following entry of the cluster
+    // whose home is not between the hole and its current position, so lookups
+    // never need tombstones.
+    for (size_t i = (hole + 1) & mask; names[i].isUsed; i = (i + 1) & mask)
+    {
+        size_t home = names_getHome(self, names[i].hash);
+
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            names[hole] = names[i];
+            memset(&names[i], 0, sizeof(names[i]));
+            hole = i;
+        }
+    }
+}
+
+static OS_KeystoreRamFV_Registry const*
+registry_enter(
+    OS_KeystoreRamFV_t* self,
+    unsigned int*       epoch)
+{
+    // Count this reader in the current epoch before the registry is fetched,
+    // so a writer that publishes a new registry afterwards waits for it, see
+    // registry_commit().
+    *epoch = atomic_load(&self->epoch) & 1;
+    atomic_fetch_add(&self->readers[*epoch], 1);
+
+    return atomic_load(&self->registry);
+}
+
+static void
+registry_leave(
+    OS_KeystoreRamFV_t* self,
+    unsigned int        epoch)
+{
+    atomic_fetch_sub(&self->readers[epoch], 1);
+}
+
+static inline OS_KeystoreRamFV_Registry*
+registry_get(
+    OS_KeystoreRamFV_t* self)
+{
+    // Only used by writers, which are serialized, so the registry cannot be
+    // replaced while it is used.
+    return atomic_load(&self->registry);
+}
+
+static OS_KeystoreRamFV_Registry*
+registry_beginUpdate(
+    OS_KeystoreRamFV_t* self)
+{
+    OS_KeystoreRamFV_Registry* current = registry_get(self);
+
+    // Without a lock the handle is not shared, so there are no readers and
+    // the registry can be modified in place.
+    if (NULL == OS_KeystoreRamFV_TO_OS_KEYSTORE(self)->lock.lockWrite)
+    {
+        return current;
+    }
+
+    // The spare registry is not used by any reader, registry_commit() waited
+    // for them when it was replaced.
+    OS_KeystoreRamFV_Registry* next = (current == &self->registries[0]) ?
+                                      &self->registries[1] :
+                                      &self->registries[0];
+
+    if (self->numNames > 0)
+    {
+        memcpy(next->names, current->names,
+               self->numNames * sizeof(*next->names));
+    }
+    next->usedNames = current->usedNames;
+
+    return next;
+}
+
+static void
+registry_commit(
+    OS_KeystoreRamFV_t*         self,
+    OS_KeystoreRamFV_Registry*  next)
+{
+    if (next == registry_get(self))
+    {
+        return;
+    }
+
+    atomic_store(&self->registry, next);
+
+    // Wait until the readers of the previous registry are done. Readers that
+    // fetched the epoch just before it is advanced may still count themselves
+    // in the previous epoch, so both epochs are drained one after the other.
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        unsigned int epoch = atomic_fetch_add(&self->epoch, 1) & 1;
+
+        for (unsigned int spins = 1; atomic_load(&self->readers[epoch]) > 0;
+             spins++)
+        {
+            // Readers only copy an entry or a key, so this is short unless a
+            // reader was preempted. Then it needs the CPU to get done.
+            if (spins >= MAX_SPINS)
+            {
+                OS_Keystore_yield(OS_KeystoreRamFV_TO_OS_KEYSTORE(self));
+                spins = 0;
+            }
+        }
+    }
+}
+
+static void
+slab_reset(
+    OS_KeystoreRamFV_Slab*  slab)
+{
+    if (slab->numSlots > 0)
+    {
+        memset(slab->slots, 0, slab->numSlots * slab->slotSize);
+    }
+
+    // Hand out the slots in ascending order.
+    for (size_t i = 0; i < slab->numSlots; i++)
+    {
+        slab->freeSlots[i] = (uint32_t) (slab->numSlots - 1 - i);
+    }
+    slab->numFree = slab->numSlots;
+}
+
+static int
+slab_select(
+    OS_KeystoreRamFV_t* self,
+    size_t              keySize)
+{
+    // The slabs are ordered by ascending slot size, so the first match wastes
+    // the least memory.
+    for (size_t i = 0; i < self->numSlabs; i++)
+    {
+        if ((keySize <= self->slabs[i].slotSize) && (self->slabs[i].numFree > 0))
+        {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+static inline uint8_t*
+slab_getSlot(
+    OS_KeystoreRamFV_Slab const*    slab,
+    uint32_t                        slot)
+{
+    return slab->slots + ((size_t) slot * slab->slotSize);
+}
+
+static bool
+slab_beginDelete(
+    OS_KeystoreRamFV_Slab*  slab,
+    uint32_t                slot)
+{
+    // Flag the slot first, borrowKey() refuses to lend a flagged key. A lease
+    // taken before is counted already, then the key cannot be deleted.
+    unsigned int leases = atomic_fetch_or(&slab->leases[slot],
+                                          OS_KeystoreRamFV_LEASE_DELETING);
+
+    if ((leases & ~OS_KeystoreRamFV_LEASE_DELETING) > 0)
+    {
+        atomic_fetch_and(&slab->leases[slot], ~OS_KeystoreRamFV_LEASE_DELETING);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+slab_release(
+    OS_KeystoreRamFV_Slab*  slab,
+    uint32_t                slot)
+{
+    memset(slab_getSlot(slab, slot), 0, slab->slotSize);
+    atomic_store(&slab->leases[slot], 0);
+    slab->freeSlots[slab->numFree++] = slot;
+}
+
+static bool
+isConfigOk(
+    OS_KeystoreRamFV_Config_t const* config)
+{
+    if (config->numSlabs > OS_KeystoreRamFV_MAX_SLABS)
+    {
+        Debug_LOG_ERROR("%s: At most %d slabs are supported!",
+                        __func__, OS_KeystoreRamFV_MAX_SLABS);
+        return false;
+    }
+
+    for (size_t i = 0; i < config->numSlabs; i++)
+    {
+        OS_KeystoreRamFV_SlabConfig_t const* slab = &config->slabs[i];
+
+        if ((slab->slotSize == 0)
+            || (slab->slotSize > OS_KeystoreRamFV_MAX_KEY_SIZE)
+            || ((i > 0) && (slab->slotSize <= config->slabs[i - 1].slotSize)))
+        {
+            Debug_LOG_ERROR("%s: Slot size %zu of slab %zu is invalid, slot "
+                            "sizes must be ascending and in the range [1;%d]!",
+                            __func__, slab->slotSize, i,
+                            OS_KeystoreRamFV_MAX_KEY_SIZE);
+            return false;
+        }
+
+        if ((slab->bufSize / slab->slotSize > UINT32_MAX)
+            || ((slab->bufSize > 0) && (NULL == slab->buf)))
+        {
+            Debug_LOG_ERROR("%s: Buffer of slab %zu is invalid!", __func__, i);
+            return false;
+        }
+    }
+
+    if ((config->readBufSize > 0) && (NULL == config->readBuf))
+    {
+        Debug_LOG_ERROR("%s: Read buffer is invalid!", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+static KeystoreRamFV_KeyRecord_t*
+fv_claimRecord(
+    OS_KeystoreRamFV_t* self,
+    size_t*             index)
+{
+    for (;;)
+    {
+        for (size_t i = 0; i < self->numReadRecords; i++)
+        {
+            if (!atomic_load_explicit(&self->readBusy[i], memory_order_relaxed)
+                && !atomic_exchange(&self->readBusy[i], true))
+            {
+                *index = i;
+                return &self->readRecords[i];
+            }
+        }
+
+        // All records are used by loads that run under the shared lock as
+        // well, they are done soon.
+        OS_Keystore_yield(OS_KeystoreRamFV_TO_OS_KEYSTORE(self));
+    }
+}
+
 static OS_Error_t
-ctor(
+fv_loadKey(
     OS_KeystoreRamFV_t* self,
-    void*               buf,
-    size_t              bufSize)
+    const char*         cleanName,
+    void*               keyData,
+    size_t              keySize)
 {
-    if (NULL == self)
+    size_t index;
+    KeystoreRamFV_KeyRecord_t* record = fv_claimRecord(self, &index);
+    OS_KeystoreRamFV_DataSubRecord* subRecord =
+        (OS_KeystoreRamFV_DataSubRecord*) record->data;
+    OS_Error_t err = OS_SUCCESS;
+
+    // The registry resolved the name, KeystoreRamFV still validates the hit.
+    KeystoreRamFV_Result_t result = KeystoreRamFV_get(
+                                        &self->fvKeystore,
+                                        APP_ID,
+                                        cleanName,
+                                        record);
+    if (result.error)
     {
-        return OS_ERROR_INVALID_PARAMETER;
+        Debug_LOG_ERROR("%s: KeystoreRamFV_get() failed, err %d!",
+                        __func__,
+                        result.error);
+        memset(record, 0, sizeof(*record));
+        atomic_store(&self->readBusy[index], false);
+        return result.error == KeystoreRamFV_ERR_NOT_FOUND ?
+               OS_ERROR_NOT_FOUND : OS_ERROR_INVALID_PARAMETER;
     }
 
-    memset(self, 0, sizeof(OS_KeystoreRamFV_t));
+    // All records are stored with a zeroed tail, so only the key data of the
+    // loaded record may be non-zero.
+    size_t used = (subRecord->keySize > OS_KeystoreRamFV_MAX_KEY_SIZE) ?
+                  OS_KeystoreRamFV_MAX_KEY_SIZE : subRecord->keySize;
 
-    KeystoreRamFV_init(
-        &self->fvKeystore,
-        OS_KeystoreRamFV_NUM_ELEMENTS_BUFFER(bufSize),
-        buf);
+    if (subRecord->keySize != keySize)
+    {
+        Debug_LOG_ERROR("%s: Record holds key size %u, expected %zu!",
+                        __func__, subRecord->keySize, keySize);
+        err = OS_ERROR_GENERIC;
+    }
+    else
+    {
+        memcpy(keyData, subRecord->keyData, keySize);
+    }
 
-    OS_KeystoreRamFV_TO_OS_KEYSTORE(self)->vtable = &OS_KeystoreRamFV_vtable;
+    // Do not leave a copy of the key in the record.
+    memset(subRecord->keyData, 0, used);
+    atomic_store(&self->readBusy[index], false);
 
-    return OS_SUCCESS;
+    return err;
+}
+
+static OS_Error_t
+loadKey(
+    OS_KeystoreRamFV_t* self,
+    const char*         cleanName,
+    void*               keyData,
+    size_t*             keySize,
+    bool                isLocked)
+{
+    OS_Error_t err;
+    unsigned int epoch;
+    OS_KeystoreRamFV_Registry const* registry = registry_enter(self, &epoch);
+
+    int i = names_find(self, registry, cleanName);
+
+    if (i < 0)
+    {
+        registry_leave(self, epoch);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    OS_KeystoreRamFV_NameEntry entry = registry->names[i];
+
+    if (entry.keySize > *keySize)
+    {
+        registry_leave(self, epoch);
+        Debug_LOG_ERROR("%s: The actual amount of key data (%u bytes) is bigger "
+                        "than the expected size (%zu bytes)",
+                        __func__, entry.keySize, *keySize);
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    if (entry.slab > 0)
+    {
+        // The slot is not reused before all readers of the registry are done.
+        memcpy(keyData,
+               slab_getSlot(&self->slabs[entry.slab - 1], entry.slot),
+               entry.keySize);
+        registry_leave(self, epoch);
+
+        *keySize = entry.keySize;
+
+        return OS_SUCCESS;
+    }
+
+    registry_leave(self, epoch);
+
+    if (!isLocked)
+    {
+        // KeystoreRamFV modifies its records in place, so its keys are read
+        // under the lock. The key may have changed in the meantime, so it is
+        // looked up again.
+        OS_Keystore_lockShared(OS_KeystoreRamFV_TO_OS_KEYSTORE(self));
+        err = loadKey(self, cleanName, keyData, keySize, true);
+        OS_Keystore_unlockShared(OS_KeystoreRamFV_TO_OS_KEYSTORE(self));
+
+        return err;
+    }
+
+    err = fv_loadKey(self, cleanName, keyData, entry.keySize);
+
+    if (OS_SUCCESS == err)
+    {
+        *keySize = entry.keySize;
+    }
+
+    return err;
 }
 
 static OS_Error_t
@@ -167,6 +645,125 @@ dtor(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
+    for (size_t i = 0; i < self->numSlabs; i++)
+    {
+        free(self->slabs[i].freeSlots);
+        free(self->slabs[i].leases);
+    }
+
+    free(self->registries[0].names);
+    free(self->registries[1].names);
+    free(self->readBusy);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+ctor(
+    OS_KeystoreRamFV_t*                 self,
+    OS_KeystoreRamFV_Config_t const*    config)
+{
+    if (NULL == self || NULL == config)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(self, 0, sizeof(OS_KeystoreRamFV_t));
+
+    if (!isConfigOk(config))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // The registry has to hold as many names as KeystoreRamFV and the slabs
+    // can hold keys.
+    size_t maxKeys = OS_KeystoreRamFV_NUM_ELEMENTS_BUFFER(config->bufSize);
+
+    for (size_t i = 0; i < config->numSlabs; i++)
+    {
+        OS_KeystoreRamFV_Slab* slab = &self->slabs[i];
+
+        slab->slotSize = config->slabs[i].slotSize;
+        slab->numSlots = config->slabs[i].bufSize / slab->slotSize;
+        slab->slots    = config->slabs[i].buf;
+
+        if (slab->numSlots > 0)
+        {
+            slab->freeSlots = calloc(slab->numSlots, sizeof(*slab->freeSlots));
+            slab->leases    = calloc(slab->numSlots, sizeof(*slab->leases));
+
+            if ((NULL == slab->freeSlots) || (NULL == slab->leases))
+            {
+                dtor(self);
+                return OS_ERROR_INSUFFICIENT_SPACE;
+            }
+        }
+
+        slab_reset(slab);
+        self->numSlabs++;
+        maxKeys += slab->numSlots;
+    }
+
+    if (maxKeys > 0)
+    {
+        // Keep the load factor at or below 3/4.
+        self->numNames = 16;
+        while (self->numNames * 3 < maxKeys * 4)
+        {
+            self->numNames *= 2;
+        }
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            self->registries[i].names = calloc(self->numNames,
+                                               sizeof(OS_KeystoreRamFV_NameEntry));
+
+            if (NULL == self->registries[i].names)
+            {
+                dtor(self);
+                return OS_ERROR_INSUFFICIENT_SPACE;
+            }
+        }
+    }
+
+    self->numReadRecords = config->readBufSize
+                           / sizeof(KeystoreRamFV_KeyRecord_t);
+    if (self->numReadRecords > 0)
+    {
+        self->readRecords = config->readBuf;
+    }
+    else
+    {
+        self->readRecords    = &self->readRecord;
+        self->numReadRecords = 1;
+    }
+
+    self->readBusy = calloc(self->numReadRecords, sizeof(*self->readBusy));
+    if (NULL == self->readBusy)
+    {
+        dtor(self);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    for (size_t i = 0; i < self->numReadRecords; i++)
+    {
+        atomic_init(&self->readBusy[i], false);
+    }
+
+    atomic_init(&self->registry, &self->registries[0]);
+    atomic_init(&self->epoch, 0);
+    atomic_init(&self->readers[0], 0);
+    atomic_init(&self->readers[1], 0);
+    atomic_init(&self->numLeases, 0);
+    atomic_init(&self->isWiping, false);
+
+    KeystoreRamFV_init(
+        &self->fvKeystore,
+        OS_KeystoreRamFV_NUM_ELEMENTS_BUFFER(config->bufSize),
+        config->buf);
+
+    OS_KeystoreRamFV_TO_OS_KEYSTORE(self)->vtable = &OS_KeystoreRamFV_vtable;
+
     return OS_SUCCESS;
 }
 
@@ -179,6 +776,12 @@ OS_KeystoreRamFV_free(
 {
     OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) ptr;
 
+    if ((NULL != self) && (atomic_load(&self->numLeases) > 0))
+    {
+        Debug_LOG_ERROR("%s: Keys are still lent!", __func__);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
     OS_Error_t err = dtor(self);
     if (OS_SUCCESS == err)
     {
@@ -202,13 +805,61 @@ OS_KeystoreRamFV_storeKey(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    memset(&self->keyRecord, 0, sizeof(self->keyRecord));
+    char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
+    strncpy(cleanName, name, sizeof(cleanName) - 1);
+
+    // KeystoreRamFV only detects duplicates among its own keys.
+    if (names_find(self, registry_get(self), cleanName) >= 0)
+    {
+        Debug_LOG_ERROR("%s: Key '%s' already exists!", __func__, cleanName);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_KeystoreRamFV_Registry* registry = registry_beginUpdate(self);
+
+    if (self->numSlabs > 0)
+    {
+        int i = slab_select(self, keySize);
+
+        if (i >= 0)
+        {
+            OS_KeystoreRamFV_Slab* slab = &self->slabs[i];
+            uint32_t slot = slab->freeSlots[--slab->numFree];
+
+            // The slot is free, so no reader can see it before the key is
+            // published.
+            memcpy(slab_getSlot(slab, slot), keyData, keySize);
+
+            if (!names_add(self, registry, cleanName, keySize,
+                           (uint8_t) (i + 1), slot))
+            {
+                Debug_LOG_ERROR("%s: Failed to register the key name!", __func__);
+                slab_release(slab, slot);
+                return OS_ERROR_INSUFFICIENT_SPACE;
+            }
 
+            registry_commit(self, registry);
+
+            return OS_SUCCESS;
+        }
+    }
+
+    // Only the name and the key data left over from a previous operation
+    // need to be cleared, the rest of the record is zero already.
+    memset(self->keyRecord.name, 0, sizeof(self->keyRecord.name));
     strncpy(self->keyRecord.name, name, sizeof(self->keyRecord.name) - 1);
     OS_KeystoreRamFV_DataSubRecord* subRecord =
         (OS_KeystoreRamFV_DataSubRecord*) self->keyRecord.data;
     subRecord->keySize = keySize;
-    memcpy(subRecord->keyData, keyData, keySize);
+    if (keyData != subRecord->keyData)
+    {
+        memcpy(subRecord->keyData, keyData, keySize);
+    }
+    if (self->recordUsed > keySize)
+    {
+        memset(&subRecord->keyData[keySize], 0, self->recordUsed - keySize);
+    }
+    self->recordUsed = keySize;
 
     KeystoreRamFV_Result_t result = KeystoreRamFV_add(
                                         &self->fvKeystore,
@@ -223,6 +874,17 @@ OS_KeystoreRamFV_storeKey(
                OS_ERROR_INSUFFICIENT_SPACE : OS_ERROR_INVALID_PARAMETER;
     }
 
+    if (!names_add(self, registry, self->keyRecord.name, keySize, 0, 0))
+    {
+        // Can only happen if the registry is out of sync with KeystoreRamFV,
+        // keep them consistent by dropping the key again.
+        Debug_LOG_ERROR("%s: Failed to register the key name!", __func__);
+        KeystoreRamFV_delete(&self->fvKeystore, APP_ID, self->keyRecord.name);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    registry_commit(self, registry);
+
     return OS_SUCCESS;
 }
 
@@ -246,38 +908,7 @@ OS_KeystoreRamFV_loadKey(
     char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
     strncpy(cleanName, name, sizeof(cleanName) - 1);
 
-    KeystoreRamFV_Result_t result = KeystoreRamFV_get(
-                                        &self->fvKeystore,
-                                        APP_ID,
-                                        cleanName,
-                                        &self->keyRecord);
-    if (result.error)
-    {
-        Debug_LOG_ERROR("%s: KeystoreRamFV_get() failed, err %d!",
-                        __func__,
-                        result.error);
-        return result.error == KeystoreRamFV_ERR_NOT_FOUND ?
-               OS_ERROR_NOT_FOUND : OS_ERROR_INVALID_PARAMETER;
-    }
-
-    OS_KeystoreRamFV_DataSubRecord* subRecord =
-        (OS_KeystoreRamFV_DataSubRecord*) self->keyRecord.data;
-
-    if (subRecord->keySize > *keySize)
-    {
-        Debug_LOG_ERROR("%s: The actual amount of key data (%u bytes) is bigger "
-                        "than the expected size (%zu bytes)",
-                        __func__, subRecord->keySize, *keySize);
-        return OS_ERROR_BUFFER_TOO_SMALL;
-    }
-
-    if (keyData != subRecord->keyData)
-    {
-        memcpy(keyData, subRecord->keyData, subRecord->keySize);
-    }
-    *keySize = subRecord->keySize;
-
-    return OS_SUCCESS;
+    return loadKey(self, cleanName, keyData, keySize, false);
 }
 
 static OS_Error_t
@@ -309,14 +940,43 @@ OS_KeystoreRamFV_deleteKey(
     char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
     strncpy(cleanName, name, sizeof(cleanName) - 1);
 
-    unsigned int err = KeystoreRamFV_delete(
-                           &self->fvKeystore,
-                           APP_ID,
-                           cleanName);
-    if (err)
+    int i = names_find(self, registry_get(self), cleanName);
+
+    if (i < 0)
     {
-        return err == KeystoreRamFV_ERR_NOT_FOUND ?
-               OS_ERROR_NOT_FOUND : OS_ERROR_INVALID_PARAMETER;
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    OS_KeystoreRamFV_NameEntry entry = registry_get(self)->names[i];
+
+    if ((entry.slab > 0) && !slab_beginDelete(&self->slabs[entry.slab - 1],
+                                              entry.slot))
+    {
+        Debug_LOG_ERROR("%s: Key '%s' is lent!", __func__, cleanName);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
+    if (0 == entry.slab)
+    {
+        unsigned int err = KeystoreRamFV_delete(
+                               &self->fvKeystore,
+                               APP_ID,
+                               cleanName);
+        if (err)
+        {
+            return err == KeystoreRamFV_ERR_NOT_FOUND ?
+                   OS_ERROR_NOT_FOUND : OS_ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    OS_KeystoreRamFV_Registry* registry = registry_beginUpdate(self);
+    names_removeAt(self, registry, i);
+    registry_commit(self, registry);
+
+    // No reader can see the key anymore, so the slot can be reused.
+    if (entry.slab > 0)
+    {
+        slab_release(&self->slabs[entry.slab - 1], entry.slot);
     }
 
     return OS_SUCCESS;
@@ -329,15 +989,46 @@ OS_KeystoreRamFV_copyKey(
     OS_Keystore_t*  dstPtr)
 {
     OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) srcPtr;
+
+    if (NULL == self || NULL == dstPtr)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
     OS_KeystoreRamFV_DataSubRecord* subRecord =
         (OS_KeystoreRamFV_DataSubRecord*) self->keyRecord.data;
+    size_t keySize = sizeof(subRecord->keyData);
+
+    if (!isLoadKeyParametersOk(self, name, subRecord->keyData, &keySize))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
+    strncpy(cleanName, name, sizeof(cleanName) - 1);
+
+    // The API holds the locks of both keystores already.
+    OS_Error_t err = loadKey(self, cleanName, subRecord->keyData, &keySize,
+                             true);
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: loadKey failed with err %d!", __func__, err);
+        return err;
+    }
+
+    if (keySize > self->recordUsed)
+    {
+        self->recordUsed = keySize;
+    }
 
-    return OS_Keystore_copyKeyImpl(
-               srcPtr,
-               name,
-               dstPtr,
-               subRecord->keyData,
-               sizeof(subRecord->keyData));
+    err = dstPtr->vtable->storeKey(dstPtr, name, subRecord->keyData, keySize);
+
+    if (err != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("%s: storeKey failed with err %d!", __func__, err);
+    }
+
+    return err;
 }
 
 static OS_Error_t
@@ -351,8 +1042,234 @@ OS_KeystoreRamFV_wipeKeystore(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
+    // Same as for deleteKey(), but for all keys at once, see
+    // slab_beginDelete().
+    atomic_store(&self->isWiping, true);
+
+    if (atomic_load(&self->numLeases) > 0)
+    {
+        atomic_store(&self->isWiping, false);
+        Debug_LOG_ERROR("%s: Keys are still lent!", __func__);
+        return OS_ERROR_OPERATION_DENIED;
+    }
+
+    OS_KeystoreRamFV_Registry* registry = registry_beginUpdate(self);
+
+    if (self->numNames > 0)
+    {
+        memset(registry->names, 0, self->numNames * sizeof(*registry->names));
+    }
+    registry->usedNames = 0;
+
+    registry_commit(self, registry);
+
     KeystoreRamFV_wipe(&self->fvKeystore);
 
+    for (size_t i = 0; i < self->numSlabs; i++)
+    {
+        slab_reset(&self->slabs[i]);
+    }
+
+    atomic_store(&self->isWiping, false);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreRamFV_listKeys(
+    OS_Keystore_t*              ptr,
+    OS_Keystore_ListCursor_t*   cursor,
+    char*                       name,
+    size_t                      nameSize,
+    size_t*                     keySize)
+{
+    OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) ptr;
+
+    if (NULL == self || NULL == cursor || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = OS_ERROR_NOT_FOUND;
+    unsigned int epoch;
+    OS_KeystoreRamFV_Registry const* registry = registry_enter(self, &epoch);
+    size_t i;
+
+    // The cursor holds the registry entry at which the search for the next
+    // key starts.
+    for (i = cursor->pos; i < self->numNames; i++)
+    {
+        OS_KeystoreRamFV_NameEntry const* entry = &registry->names[i];
+
+        if (!entry->isUsed)
+        {
+            continue;
+        }
+
+        size_t nameLen = strnlen(entry->name, sizeof(entry->name));
+
+        if (nameLen >= nameSize)
+        {
+            err = OS_ERROR_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        memcpy(name, entry->name, nameLen);
+        name[nameLen] = '\0';
+
+        if (NULL != keySize)
+        {
+            *keySize = entry->keySize;
+        }
+
+        cursor->pos = i + 1;
+        err         = OS_SUCCESS;
+        break;
+    }
+
+    registry_leave(self, epoch);
+
+    if (OS_ERROR_NOT_FOUND == err)
+    {
+        cursor->pos = self->numNames;
+    }
+
+    return err;
+}
+
+static OS_Error_t
+OS_KeystoreRamFV_getKeyInfo(
+    OS_Keystore_t*  ptr,
+    const char*     name,
+    size_t*         keySize)
+{
+    OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) ptr;
+
+    if (NULL == self || NULL == name)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    size_t nameLen = strlen(name);
+
+    if (nameLen > OS_KeystoreRamFV_MAX_NAME_LEN || nameLen == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
+                        __func__,
+                        nameLen,
+                        OS_KeystoreRamFV_MAX_NAME_LEN);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
+    strncpy(cleanName, name, sizeof(cleanName) - 1);
+
+    unsigned int epoch;
+    OS_KeystoreRamFV_Registry const* registry = registry_enter(self, &epoch);
+
+    int i = names_find(self, registry, cleanName);
+
+    if ((i >= 0) && (NULL != keySize))
+    {
+        *keySize = registry->names[i].keySize;
+    }
+
+    registry_leave(self, epoch);
+
+    return (i < 0) ? OS_ERROR_NOT_FOUND : OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreRamFV_borrowKey(
+    OS_Keystore_t*          ptr,
+    const char*             name,
+    OS_Keystore_Lease_t*    lease)
+{
+    OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) ptr;
+
+    if (NULL == self || NULL == name || NULL == lease)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    size_t nameLen = strlen(name);
+
+    if (nameLen > OS_KeystoreRamFV_MAX_NAME_LEN || nameLen == 0)
+    {
+        Debug_LOG_ERROR("%s: The length of the passed key name %zu is invalid, must be in the range [1;%d]!",
+                        __func__,
+                        nameLen,
+                        OS_KeystoreRamFV_MAX_NAME_LEN);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    char cleanName[KeystoreRamFV_KEY_NAME_SIZE] = { 0 };
+    strncpy(cleanName, name, sizeof(cleanName) - 1);
+
+    unsigned int epoch;
+    OS_KeystoreRamFV_Registry const* registry = registry_enter(self, &epoch);
+
+    int i = names_find(self, registry, cleanName);
+
+    if (i < 0)
+    {
+        registry_leave(self, epoch);
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    OS_KeystoreRamFV_NameEntry const* entry = &registry->names[i];
+
+    if (0 == entry->slab)
+    {
+        // KeystoreRamFV only hands out copies of its records, the API falls
+        // back to loadKey().
+        registry_leave(self, epoch);
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    OS_KeystoreRamFV_Slab* slab = &self->slabs[entry->slab - 1];
+
+    // The lease is counted before the key is checked for a pending delete,
+    // so either the writer sees the lease or the key is not lent, see
+    // slab_beginDelete().
+    unsigned int leases = atomic_fetch_add(&slab->leases[entry->slot], 1);
+    atomic_fetch_add(&self->numLeases, 1);
+
+    if ((leases & OS_KeystoreRamFV_LEASE_DELETING)
+        || atomic_load(&self->isWiping))
+    {
+        atomic_fetch_sub(&slab->leases[entry->slot], 1);
+        atomic_fetch_sub(&self->numLeases, 1);
+        registry_leave(self, epoch);
+
+        // The key is about to be deleted, the API falls back to loadKey().
+        return OS_ERROR_NOT_SUPPORTED;
+    }
+
+    lease->keyData = slab_getSlot(slab, entry->slot);
+    lease->keySize = entry->keySize;
+    lease->ref     = &slab->leases[entry->slot];
+
+    registry_leave(self, epoch);
+
+    return OS_SUCCESS;
+}
+
+static OS_Error_t
+OS_KeystoreRamFV_releaseKey(
+    OS_Keystore_t*          ptr,
+    OS_Keystore_Lease_t*    lease)
+{
+    OS_KeystoreRamFV_t* self = (OS_KeystoreRamFV_t*) ptr;
+
+    if (NULL == self || NULL == lease || NULL == lease->ref)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    atomic_fetch_sub((atomic_uint*) lease->ref, 1);
+    atomic_fetch_sub(&self->numLeases, 1);
+
     return OS_SUCCESS;
 }
 
@@ -364,6 +1281,21 @@ OS_KeystoreRamFV_init(
     OS_Keystore_Handle_t*   pHandle,
     void*                   buf,
     size_t                  bufSize)
+{
+    OS_KeystoreRamFV_Config_t config =
+    {
+        .buf        = buf,
+        .bufSize    = bufSize,
+        .numSlabs   = 0
+    };
+
+    return OS_KeystoreRamFV_initWithConfig(pHandle, &config);
+}
+
+OS_Error_t
+OS_KeystoreRamFV_initWithConfig(
+    OS_Keystore_Handle_t*               pHandle,
+    OS_KeystoreRamFV_Config_t const*    config)
 {
     OS_Error_t err = OS_ERROR_GENERIC;
     OS_KeystoreRamFV_t* self = malloc(sizeof(OS_KeystoreRamFV_t));
@@ -373,7 +1305,7 @@ OS_KeystoreRamFV_init(
         return OS_ERROR_INSUFFICIENT_SPACE;
     }
 
-    err = ctor(self, buf, bufSize);
+    err = ctor(self, config);
 
     if (err != OS_SUCCESS)
     {